@@ -0,0 +1,20 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+// every resident texture, see BindlessTable
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform Material {
+    uint textureIndex;
+} material;
+
+void main()
+{
+    // the index is uniform across the draw, so nonuniformEXT is not needed
+    outColor = texture(textures[material.textureIndex], fragTexCoord);
+}
@@ -3,20 +3,238 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+
 namespace engine
 {
-    Image::Image(const std::string &path)
+    namespace
     {
-        pixels = stbi_load(path.c_str(), &width, &height, &nrChannels, STBI_rgb_alpha);
+        const uint8_t Ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+        const size_t Ktx2HeaderSize = 80;
+        const size_t Ktx2LevelIndexSize = 24;
+
+        // Compressed variants in order of preference, the first one the device can sample wins
+        const char *const CompressedSuffixes[] = {".bc.ktx2", ".astc.ktx2", ".etc2.ktx2"};
 
-        if (!pixels)
+        template <typename T>
+        T read(const uint8_t *bytes, size_t offset)
         {
-            throw std::runtime_error("Failed to load image: " + path);
+            T value;
+            memcpy(&value, bytes + offset, sizeof(T));
+            return value;
+        }
+
+        bool endsWith(const std::string &value, const std::string &suffix)
+        {
+            return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+    }
+
+    Image::Image(const std::string &path, vk::PhysicalDevice phyDevice)
+    {
+        if (endsWith(path, ".ktx2"))
+        {
+            if (!loadKtx2(path, phyDevice, true))
+            {
+                throw std::runtime_error("Failed to load image: " + path);
+            }
+            return;
+        }
+
+        std::string stem = path.substr(0, path.find_last_of('.'));
+        for (const char *suffix : CompressedSuffixes)
+        {
+            if (loadKtx2(stem + suffix, phyDevice, false))
+            {
+                return;
+            }
+        }
+
+        loadPixels(path, phyDevice);
+    }
+
+    bool Image::IsFormatSupported(vk::PhysicalDevice phyDevice, vk::Format format)
+    {
+        vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eSampledImage |
+                                          vk::FormatFeatureFlagBits::eSampledImageFilterLinear |
+                                          vk::FormatFeatureFlagBits::eTransferDst;
+        return (phyDevice.getFormatProperties(format).optimalTilingFeatures & required) == required;
+    }
+
+    bool Image::loadKtx2(const std::string &path, vk::PhysicalDevice phyDevice, bool required)
+    {
+        if (!file.Open(path))
+        {
+            return false;
+        }
+
+        // a probed sidecar that cannot be used falls back to the next variant or the source image
+        auto reject = [&](const std::string &reason)
+        {
+            file.Close();
+            if (required)
+            {
+                throw std::runtime_error(reason + ": " + path);
+            }
+            std::cout << "Skipping " << path << ": " << reason << std::endl;
+            return false;
+        };
+
+        const uint8_t *bytes = file.data();
+        if (file.size() < Ktx2HeaderSize || memcmp(bytes, Ktx2Identifier, sizeof(Ktx2Identifier)) != 0)
+        {
+            return reject("Not a KTX2 file");
+        }
+
+        uint32_t vkFormat = read<uint32_t>(bytes, 12);
+        uint32_t pixelWidth = read<uint32_t>(bytes, 20);
+        uint32_t pixelHeight = read<uint32_t>(bytes, 24);
+        uint32_t pixelDepth = read<uint32_t>(bytes, 28);
+        uint32_t layerCount = read<uint32_t>(bytes, 32);
+        uint32_t faceCount = read<uint32_t>(bytes, 36);
+        uint32_t levelCount = std::max(read<uint32_t>(bytes, 40), 1u);
+        uint32_t supercompression = read<uint32_t>(bytes, 44);
+
+        // Basis Universal (VK_FORMAT_UNDEFINED) and supercompressed payloads need a transcoder
+        vk::Format levelFormat = static_cast<vk::Format>(vkFormat);
+        if (vkFormat == 0 || supercompression != 0 || pixelDepth > 1 || layerCount > 1 || faceCount != 1 ||
+            pixelWidth == 0 || pixelHeight == 0 || vk::blockSize(levelFormat) == 0)
+        {
+            return reject("Unsupported KTX2 layout");
+        }
+
+        uint32_t fullChain = 1;
+        while ((std::max(pixelWidth, pixelHeight) >> fullChain) != 0)
+        {
+            fullChain++;
+        }
+        if (levelCount > fullChain)
+        {
+            return reject("KTX2 level count exceeds the mip chain");
+        }
+        if (file.size() < Ktx2HeaderSize + levelCount * Ktx2LevelIndexSize)
+        {
+            return reject("Truncated KTX2 file");
         }
+
+        if (!IsFormatSupported(phyDevice, levelFormat))
+        {
+            file.Close();
+            return false;
+        }
+
+        std::array<uint8_t, 3> blockExtent = vk::blockExtent(levelFormat);
+        levels.clear();
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            size_t entry = Ktx2HeaderSize + level * Ktx2LevelIndexSize;
+            ImageLevel imageLevel;
+            imageLevel.offset = read<uint64_t>(bytes, entry);
+            imageLevel.size = read<uint64_t>(bytes, entry + 8);
+            imageLevel.width = std::max(pixelWidth >> level, 1u);
+            imageLevel.height = std::max(pixelHeight >> level, 1u);
+
+            uint64_t blocksX = (imageLevel.width + blockExtent[0] - 1) / blockExtent[0];
+            uint64_t blocksY = (imageLevel.height + blockExtent[1] - 1) / blockExtent[1];
+            if (imageLevel.size != blocksX * blocksY * vk::blockSize(levelFormat))
+            {
+                levels.clear();
+                return reject("KTX2 level " + std::to_string(level) + " has the wrong size");
+            }
+            if (imageLevel.offset > file.size() || imageLevel.size > file.size() - imageLevel.offset)
+            {
+                levels.clear();
+                return reject("Truncated KTX2 file");
+            }
+            levels.push_back(imageLevel);
+        }
+
+        source = path;
+        format = levelFormat;
+        data = bytes;
+        size = file.size();
+        return true;
     }
 
-    Image::~Image()
+    void Image::loadPixels(const std::string &path, vk::PhysicalDevice phyDevice)
     {
-        stbi_image_free(pixels);
+        int width, height, nrChannels;
+        if (!stbi_info(path.c_str(), &width, &height, &nrChannels))
+        {
+            throw std::runtime_error("Failed to load image: " + path);
+        }
+
+        // 24 bit texels cannot sit at the 16 byte aligned staging offsets, so RGB always goes to RGBA
+        uint32_t channels = 4;
+        format = vk::Format::eR8G8B8A8Unorm;
+        components = vk::ComponentMapping();
+        if (nrChannels == 1 && IsFormatSupported(phyDevice, vk::Format::eR8Unorm))
+        {
+            channels = 1;
+            format = vk::Format::eR8Unorm;
+            components = {vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eOne};
+        }
+        else if (nrChannels == 2 && IsFormatSupported(phyDevice, vk::Format::eR8G8Unorm))
+        {
+            channels = 2;
+            format = vk::Format::eR8G8Unorm;
+            components = {vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG};
+        }
+
+        stbi_uc *decoded = stbi_load(path.c_str(), &width, &height, &nrChannels, channels);
+        if (!decoded)
+        {
+            throw std::runtime_error("Failed to load image: " + path);
+        }
+
+        // level offsets stay 16 byte aligned for buffer to image copies
+        levels.clear();
+        uint64_t total = 0;
+        for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+        {
+            levels.push_back({total, uint64_t(w) * h * channels, w, h});
+            total += (levels.back().size + 15) & ~uint64_t(15);
+            if (w == 1 && h == 1)
+            {
+                break;
+            }
+        }
+
+        pixels.resize(total);
+        memcpy(pixels.data(), decoded, levels[0].size);
+        stbi_image_free(decoded);
+
+        // 2x2 box filter, the last row / column is reused for odd sizes
+        for (size_t level = 1; level < levels.size(); level++)
+        {
+            const ImageLevel &parent = levels[level - 1];
+            const ImageLevel &child = levels[level];
+            const uint8_t *src = pixels.data() + parent.offset;
+            uint8_t *dst = pixels.data() + child.offset;
+
+            for (uint32_t y = 0; y < child.height; y++)
+            {
+                uint32_t y0 = std::min(y * 2, parent.height - 1);
+                uint32_t y1 = std::min(y * 2 + 1, parent.height - 1);
+                for (uint32_t x = 0; x < child.width; x++)
+                {
+                    uint32_t x0 = std::min(x * 2, parent.width - 1);
+                    uint32_t x1 = std::min(x * 2 + 1, parent.width - 1);
+                    for (uint32_t c = 0; c < channels; c++)
+                    {
+                        uint32_t sum = src[(y0 * parent.width + x0) * channels + c] + src[(y0 * parent.width + x1) * channels + c] +
+                                       src[(y1 * parent.width + x0) * channels + c] + src[(y1 * parent.width + x1) * channels + c];
+                        dst[(y * child.width + x) * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        source = path;
+        data = pixels.data();
+        size = total;
     }
-}
\ No newline at end of file
+}
@@ -1,23 +1,61 @@
 #pragma once
 
 #include "context.hpp"
+#include "mapped_file.hpp"
 
 #include "stb_image.h"
 
 namespace engine
 {
+    // One mip level, offset is relative to Image::get_data()
+    struct ImageLevel
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Texture pixels with a full mip chain. A pre-mipped, block compressed KTX2 next to path
+    // (<stem>.bc.ktx2, <stem>.astc.ktx2, <stem>.etc2.ktx2) is used when phyDevice can sample its format,
+    // otherwise path is decoded and the mips are box filtered at load time. Grey and grey-alpha sources
+    // keep one / two channels and are swizzled back to RGBA in the view, RGB is expanded to RGBA.
+    // Only reads files and queries format support, so it can be constructed on a worker thread.
     class Image
     {
     public:
-        Image(const std::string &path);
-        ~Image();
-        uint64_t get_device_size() const { return width * height * 4; }
-        stbi_uc *get_pixels() const { return pixels; }
-        uint32_t get_width() const { return width; }
-        uint32_t get_height() const { return height; }
+        Image(const std::string &path, vk::PhysicalDevice phyDevice);
+        ~Image() = default;
+
+        Image(const Image &) = delete;
+        Image &operator=(const Image &) = delete;
+
+        uint64_t get_device_size() const { return size; }
+        const uint8_t *get_data() const { return data; }
+        vk::Format get_format() const { return format; }
+        vk::ComponentMapping get_components() const { return components; }
+        uint32_t get_width() const { return levels[0].width; }
+        uint32_t get_height() const { return levels[0].height; }
+        uint32_t get_level_count() const { return static_cast<uint32_t>(levels.size()); }
+        const std::vector<ImageLevel> &get_levels() const { return levels; }
+        const std::string &get_source() const { return source; }
+
+        static bool IsFormatSupported(vk::PhysicalDevice phyDevice, vk::Format format);
 
     private:
-        stbi_uc *pixels;
-        int width, height, nrChannels;
+        std::string source;
+        vk::Format format = vk::Format::eR8G8B8A8Unorm;
+        vk::ComponentMapping components;
+        std::vector<ImageLevel> levels;
+        const uint8_t *data = nullptr;
+        uint64_t size = 0;
+
+        MappedFile file;
+        std::vector<uint8_t> pixels;
+
+        // false when the file is missing or its format cannot be sampled. A malformed or unsupported container
+        // throws when required, otherwise it is skipped like a missing one
+        bool loadKtx2(const std::string &path, vk::PhysicalDevice phyDevice, bool required);
+        void loadPixels(const std::string &path, vk::PhysicalDevice phyDevice);
     };
-}
\ No newline at end of file
+}
@@ -1,17 +1,305 @@
 #include "StaticMesh.hpp"
+#include "cpu_profiler.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
 
 namespace engine
 {
-    StaticMesh::StaticMesh(const std::string &path) : filepath(path)
+    StaticMesh::StaticMesh(const std::string &path, ThreadPool *pool, const MeshImportSettings &settings)
+        : filepath(path), pool(pool), settings(settings)
+    {
+        PROFILE_FUNCTION();
+        uint32_t processFlags = (settings.optimize ? ProcessOptimize : 0) | (settings.quantize ? ProcessQuantize : 0) |
+                                (settings.meshlets ? ProcessMeshlets : 0);
+        uint64_t settingsHash = HashBytes(settings.lods.data(), settings.lods.size() * sizeof(LodSettings));
+        settingsHash = HashCombine(settingsHash, HashValue(settings.meshletMaxVertices));
+        settingsHash = HashCombine(settingsHash, HashValue(settings.meshletMaxTriangles));
+
+        std::string cachePath = path + ".lvmesh";
+        MeshCacheKey key = {MeshCache::HashFile(path), ImportFlags, processFlags, sizeof(Vertex), settingsHash};
+
+        if (openCache(cachePath, key))
+        {
+            return;
+        }
+
+        importScene(path);
+
+        if (settings.optimize)
+        {
+            auto stats = OptimizeMesh(vertices, indices, submeshes, pool);
+            std::cout << "Optimized mesh " << path << ": vertices " << stats.vertexCountBefore << " -> " << stats.vertexCountAfter
+                      << ", ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter << std::endl;
+        }
+
+        if (settings.quantize)
+        {
+            auto report = QuantizeVertices(Span<const Vertex>(vertices.data(), vertices.size()), packedVertices, quantization);
+            std::cout << "Quantized mesh " << path << ": " << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " bytes/vertex"
+                      << ", max position error " << report.maxPositionError
+                      << " (extent " << report.extent.x << " x " << report.extent.y << " x " << report.extent.z << ")"
+                      << ", max uv error " << report.maxTexCoordError << std::endl;
+        }
+
+        computeBounds();
+        // before the lods are appended, so meshlet triangle offsets index lod 0 directly
+        buildMeshlets();
+        buildLods();
+
+        std::vector<MeshCacheSectionData> sections = {
+            {MeshCacheSectionType::Vertices, vertices.data(), vertices.size() * sizeof(Vertex)},
+            {MeshCacheSectionType::Indices, indices.data(), indices.size() * sizeof(uint32_t)},
+            {MeshCacheSectionType::SubMeshes, submeshes.data(), submeshes.size() * sizeof(SubMesh)},
+            {MeshCacheSectionType::PackedVertices, packedVertices.data(), packedVertices.size() * sizeof(PackedVertex)},
+            {MeshCacheSectionType::Quantization, &quantization, sizeof(QuantizationInfo)},
+            {MeshCacheSectionType::Lods, lods.data(), lods.size() * sizeof(MeshLod)},
+            {MeshCacheSectionType::Bounds, &bounds, sizeof(MeshBounds)},
+            {MeshCacheSectionType::Meshlets, meshlets.meshlets.data(), meshlets.meshlets.size() * sizeof(Meshlet)},
+            {MeshCacheSectionType::MeshletBounds, meshlets.bounds.data(), meshlets.bounds.size() * sizeof(MeshletBounds)},
+            {MeshCacheSectionType::MeshletVertices, meshlets.vertices.data(), meshlets.vertices.size() * sizeof(uint32_t)},
+            {MeshCacheSectionType::MeshletTriangles, meshlets.triangles.data(), meshlets.triangles.size() * sizeof(uint32_t)},
+        };
+
+        if (MeshCache::Write(cachePath, key, sections) && openCache(cachePath, key))
+        {
+            vertices = {};
+            indices = {};
+            submeshes = {};
+            packedVertices = {};
+            lods = {};
+            meshlets = {};
+            return;
+        }
+
+        std::cout << "Failed to write mesh cache: " << cachePath << std::endl;
+
+        vertexView = Span<const Vertex>(vertices.data(), vertices.size());
+        indexView = Span<const uint32_t>(indices.data(), indices.size());
+        submeshView = Span<const SubMesh>(submeshes.data(), submeshes.size());
+        packedVertexView = Span<const PackedVertex>(packedVertices.data(), packedVertices.size());
+        quantizationView = Span<const QuantizationInfo>(&quantization, 1);
+        lodView = Span<const MeshLod>(lods.data(), lods.size());
+        boundsView = Span<const MeshBounds>(&bounds, 1);
+        meshletView = Span<const Meshlet>(meshlets.meshlets.data(), meshlets.meshlets.size());
+        meshletBoundsView = Span<const MeshletBounds>(meshlets.bounds.data(), meshlets.bounds.size());
+        meshletVertexView = Span<const uint32_t>(meshlets.vertices.data(), meshlets.vertices.size());
+        meshletTriangleView = Span<const uint32_t>(meshlets.triangles.data(), meshlets.triangles.size());
+    }
+
+    const QuantizationInfo &StaticMesh::get_quantization() const
+    {
+        static const QuantizationInfo Identity = {glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 0.0f};
+        return quantizationView.empty() ? Identity : quantizationView[0];
+    }
+
+    void StaticMesh::parallelFor(uint32_t count, const std::function<void(uint32_t)> &func)
+    {
+        if (pool)
+        {
+            pool->ParallelFor(count, func);
+            return;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            func(i);
+        }
+    }
+
+    bool StaticMesh::openCache(const std::string &cachePath, const MeshCacheKey &key)
+    {
+        if (!cache.Open(cachePath, key))
+        {
+            return false;
+        }
+
+        vertexView = cache.GetSection<Vertex>(MeshCacheSectionType::Vertices);
+        indexView = cache.GetSection<uint32_t>(MeshCacheSectionType::Indices);
+        submeshView = cache.GetSection<SubMesh>(MeshCacheSectionType::SubMeshes);
+        packedVertexView = cache.GetSection<PackedVertex>(MeshCacheSectionType::PackedVertices);
+        quantizationView = cache.GetSection<QuantizationInfo>(MeshCacheSectionType::Quantization);
+        lodView = cache.GetSection<MeshLod>(MeshCacheSectionType::Lods);
+        boundsView = cache.GetSection<MeshBounds>(MeshCacheSectionType::Bounds);
+        meshletView = cache.GetSection<Meshlet>(MeshCacheSectionType::Meshlets);
+        meshletBoundsView = cache.GetSection<MeshletBounds>(MeshCacheSectionType::MeshletBounds);
+        meshletVertexView = cache.GetSection<uint32_t>(MeshCacheSectionType::MeshletVertices);
+        meshletTriangleView = cache.GetSection<uint32_t>(MeshCacheSectionType::MeshletTriangles);
+
+        // a cache missing what every mesh has is treated as stale and re-imported
+        if (vertexView.empty() || indexView.empty() || submeshView.empty() || lodView.empty() || boundsView.empty())
+        {
+            cache.Close();
+            return false;
+        }
+        cached = true;
+
+        return true;
+    }
+
+    void StaticMesh::importScene(const std::string &path)
     {
+        PROFILE_FUNCTION();
         Assimp::Importer import;
-        const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+        const aiScene *scene = import.ReadFile(path, ImportFlags);
 
         if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             throw std::runtime_error("ERROR::ASSIMP::" + std::string(import.GetErrorString()));
         }
 
-        this->processNode(scene->mRootNode, scene);
+        std::vector<const aiMesh *> meshes;
+        collectMeshes(scene->mRootNode, scene, meshes);
+        uint32_t meshCount = static_cast<uint32_t>(meshes.size());
+
+        // 1. counting pass, sizes every output exactly
+        submeshes.resize(meshCount);
+        parallelFor(meshCount, [&](uint32_t i)
+                    {
+                        submeshes[i].vertexCount = meshes[i]->mNumVertices;
+                        submeshes[i].indexCount = countIndices(meshes[i]); });
+
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        for (auto &submesh : submeshes)
+        {
+            submesh.vertexOffset = vertexCount;
+            submesh.indexOffset = indexCount;
+            vertexCount += submesh.vertexCount;
+            indexCount += submesh.indexCount;
+        }
+
+        // 2. fill pass, every submesh writes only its own slice
+        vertices.resize(vertexCount);
+        indices.resize(indexCount);
+        parallelFor(meshCount, [&](uint32_t i)
+                    { fillMesh(meshes[i], scene, submeshes[i], vertices.data(), indices.data()); });
+    }
+
+    void StaticMesh::computeBounds()
+    {
+        bounds = {};
+        if (vertices.empty())
+        {
+            return;
+        }
+
+        glm::vec3 minPosition = vertices[0].position;
+        glm::vec3 maxPosition = vertices[0].position;
+        for (auto &vertex : vertices)
+        {
+            minPosition = glm::min(minPosition, vertex.position);
+            maxPosition = glm::max(maxPosition, vertex.position);
+        }
+
+        bounds.center = (minPosition + maxPosition) * 0.5f;
+        for (auto &vertex : vertices)
+        {
+            bounds.radius = std::max(bounds.radius, glm::length(vertex.position - bounds.center));
+        }
+    }
+
+    void StaticMesh::buildMeshlets()
+    {
+        PROFILE_FUNCTION();
+        meshlets = {};
+        if (!settings.meshlets)
+        {
+            return;
+        }
+
+        // meshlets map onto lod 0 triangle ranges, which needs a pure triangle list
+        std::vector<uint32_t> breaks;
+        for (auto &submesh : submeshes)
+        {
+            if (submesh.indexCount % 3 != 0)
+            {
+                std::cout << "Skipping meshlets for " << filepath << ": submesh is not a triangle list" << std::endl;
+                return;
+            }
+            breaks.push_back(submesh.indexOffset);
+        }
+
+        BuildMeshlets(indices.data(), indices.size(), vertices.data(), vertices.size(), breaks,
+                      settings.meshletMaxVertices, settings.meshletMaxTriangles, meshlets);
+
+        std::cout << "Built " << meshlets.meshlets.size() << " meshlets for " << filepath << ": "
+                  << static_cast<float>(meshlets.vertices.size()) / std::max<size_t>(meshlets.meshlets.size(), 1) << " vertices, "
+                  << static_cast<float>(meshlets.triangles.size()) / std::max<size_t>(meshlets.meshlets.size(), 1) << " triangles on average"
+                  << ", lod 0 ACMR " << ComputeACMR(indices.data(), indices.size()) << std::endl;
+    }
+
+    void StaticMesh::buildLods()
+    {
+        PROFILE_FUNCTION();
+        lods.clear();
+        lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f, 0});
+
+        float meshScale = ComputeMeshScale(vertices.data(), vertices.size());
+        uint32_t submeshCount = static_cast<uint32_t>(submeshes.size());
+
+        // every submesh simplifies its previous level, the levels of all submeshes are concatenated
+        std::vector<std::vector<uint32_t>> previous(submeshCount);
+        for (uint32_t i = 0; i < submeshCount; i++)
+        {
+            const SubMesh &submesh = submeshes[i];
+            previous[i].assign(indices.begin() + submesh.indexOffset, indices.begin() + submesh.indexOffset + submesh.indexCount);
+        }
+
+        for (const LodSettings &level : settings.lods)
+        {
+            std::vector<std::vector<uint32_t>> current(submeshCount);
+            std::vector<float> errors(submeshCount, 0.0f);
+
+            parallelFor(submeshCount, [&](uint32_t i)
+                        {
+                            const SubMesh &submesh = submeshes[i];
+                            const Vertex *submeshVertices = vertices.data() + submesh.vertexOffset;
+                            float submeshScale = ComputeMeshScale(submeshVertices, submesh.vertexCount);
+                            if (submeshScale <= 0.0f)
+                            {
+                                current[i] = previous[i];
+                                return;
+                            }
+
+                            std::vector<uint32_t> local(previous[i]);
+                            for (uint32_t &index : local)
+                            {
+                                index -= submesh.vertexOffset;
+                            }
+
+                            size_t target = static_cast<size_t>(local.size() * level.targetRatio) / 3 * 3;
+                            float relativeError = 0.0f;
+                            SimplifyMesh(local.data(), local.size(), submeshVertices, submesh.vertexCount,
+                                         target, level.targetError * meshScale / submeshScale, current[i], &relativeError);
+
+                            for (uint32_t &index : current[i])
+                            {
+                                index += submesh.vertexOffset;
+                            }
+                            errors[i] = relativeError * submeshScale; });
+
+            MeshLod lod = {static_cast<uint32_t>(indices.size()), 0, 0.0f, 0};
+            float levelError = 0.0f;
+            for (uint32_t i = 0; i < submeshCount; i++)
+            {
+                indices.insert(indices.end(), current[i].begin(), current[i].end());
+                levelError = std::max(levelError, errors[i]);
+            }
+            lod.indexCount = static_cast<uint32_t>(indices.size()) - lod.indexOffset;
+            // errors of successive levels accumulate since each one simplifies the previous
+            lod.error = lods.back().error + levelError;
+
+            // stop once the simplifier cannot make meaningful progress
+            if (lod.indexCount == 0 || lod.indexCount > lods.back().indexCount * 0.95f)
+            {
+                indices.resize(lod.indexOffset);
+                break;
+            }
+
+            std::cout << "Mesh LOD " << lods.size() << ": " << lod.indexCount / 3 << " triangles, error " << lod.error << std::endl;
+            lods.push_back(lod);
+            previous = std::move(current);
+        }
     }
-}
\ No newline at end of file
+}
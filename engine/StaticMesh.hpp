@@ -1,6 +1,12 @@
 #pragma once
 
 #include "context.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_quantizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet_builder.hpp"
+#include "thread_pool.hpp"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -8,122 +14,158 @@
 
 namespace engine
 {
-    struct Mesh
+    struct LodSettings
     {
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec4> colors;
-        std::vector<glm::vec2> texCoords;
-        std::vector<glm::vec3> normals;
-        std::vector<glm::uint> indices;
+        float targetRatio; // index count relative to the previous level
+        float targetError; // relative to the mesh extent
+    };
+
+    struct MeshImportSettings
+    {
+        bool optimize = true;
+        bool quantize = true;
+        std::vector<LodSettings> lods = {{0.5f, 0.01f}, {0.5f, 0.02f}, {0.5f, 0.05f}};
+        // meshlets are built for lod 0 only
+        bool meshlets = true;
+        uint32_t meshletMaxVertices = MeshletMaxVertices;
+        uint32_t meshletMaxTriangles = MeshletMaxTriangles;
     };
 
     class StaticMesh
     {
     public:
-        StaticMesh(const std::string &path);
+        // pool is optional, without it submeshes are converted on the calling thread
+        StaticMesh(const std::string &path, ThreadPool *pool = nullptr, const MeshImportSettings &settings = {});
         ~StaticMesh() = default;
 
+        static constexpr uint32_t ImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+        // Post-import processing baked into the cache
+        enum ProcessFlagBits : uint32_t
+        {
+            ProcessOptimize = 1 << 0,
+            ProcessQuantize = 1 << 1,
+            ProcessMeshlets = 1 << 2,
+        };
+
+        Span<const Vertex> get_vertices() const { return vertexView; }
+        Span<const uint32_t> get_indices() const { return indexView; }
+        Span<const SubMesh> get_submeshes() const { return submeshView; }
+        Span<const PackedVertex> get_packed_vertices() const { return packedVertexView; }
+        // identity when the mesh was imported without quantize
+        const QuantizationInfo &get_quantization() const;
+        const MeshImportSettings &get_settings() const { return settings; }
+        // lod 0 is the full index stream, coarser levels follow it in the same index buffer
+        Span<const MeshLod> get_lods() const { return lodView; }
+        const MeshBounds &get_bounds() const { return boundsView[0]; }
+        // meshlet i draws lod 0 indices [3 * triangleOffset, 3 * (triangleOffset + triangleCount))
+        Span<const Meshlet> get_meshlets() const { return meshletView; }
+        Span<const MeshletBounds> get_meshlet_bounds() const { return meshletBoundsView; }
+        Span<const uint32_t> get_meshlet_vertices() const { return meshletVertexView; }
+        Span<const uint32_t> get_meshlet_triangles() const { return meshletTriangleView; }
+        bool is_cached() const { return cached; }
+
     private:
         std::string filepath;
-        std::vector<Mesh> meshes;
+        ThreadPool *pool;
+        MeshImportSettings settings;
+
+        // cooked streams, backed either by the mapped cache or by the vectors below
+        MeshCache cache;
+        bool cached = false;
+        Span<const Vertex> vertexView;
+        Span<const uint32_t> indexView;
+        Span<const SubMesh> submeshView;
+        Span<const PackedVertex> packedVertexView;
+        Span<const QuantizationInfo> quantizationView;
+        Span<const MeshLod> lodView;
+        Span<const MeshBounds> boundsView;
+        Span<const Meshlet> meshletView;
+        Span<const MeshletBounds> meshletBoundsView;
+        Span<const uint32_t> meshletVertexView;
+        Span<const uint32_t> meshletTriangleView;
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<SubMesh> submeshes;
+        std::vector<PackedVertex> packedVertices;
+        QuantizationInfo quantization = {};
+        std::vector<MeshLod> lods;
+        MeshBounds bounds = {};
+        MeshletData meshlets;
+
+        bool openCache(const std::string &cachePath, const MeshCacheKey &key);
+        void importScene(const std::string &path);
+        void parallelFor(uint32_t count, const std::function<void(uint32_t)> &func);
+        void buildLods();
+        void computeBounds();
+        void buildMeshlets();
 
-        void processNode(aiNode *node, const aiScene *scene)
+        // 按深度优先顺序收集节点引用的Mesh
+        void collectMeshes(const aiNode *node, const aiScene *scene, std::vector<const aiMesh *> &result)
         {
-            // 添加当前节点中的所有Mesh
             for (uint32_t i = 0; i < node->mNumMeshes; i++)
             {
-                aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-                this->meshes.push_back(this->processMesh(mesh, scene));
+                result.push_back(scene->mMeshes[node->mMeshes[i]]);
             }
-            // 递归处理该节点的子孙节点
             for (uint32_t i = 0; i < node->mNumChildren; i++)
             {
-                this->processNode(node->mChildren[i], scene);
+                collectMeshes(node->mChildren[i], scene, result);
             }
         }
 
-        Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+        static uint32_t countIndices(const aiMesh *mesh)
+        {
+            uint32_t count = 0;
+            for (uint32_t i = 0; i < mesh->mNumFaces; i++)
+            {
+                count += mesh->mFaces[i].mNumIndices;
+            }
+            return count;
+        }
+
+        // Converts one aiMesh into its preallocated slice of the flat streams
+        static void fillMesh(const aiMesh *mesh, const aiScene *scene, const SubMesh &range, Vertex *outVertices, uint32_t *outIndices)
         {
             // mtl
-            aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+            const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
             aiColor3D color;
             material->Get(AI_MATKEY_COLOR_AMBIENT, color);
 
-            Mesh result;
+            const aiColor4D *colors = mesh->mColors[0];
+            const aiVector3D *texCoords = mesh->mTextureCoords[0];
 
-            for (uint32_t i = 0; i < mesh->mNumVertices; i++)
+            Vertex *vertex = outVertices + range.vertexOffset;
+            for (uint32_t i = 0; i < mesh->mNumVertices; i++, vertex++)
             {
-                result.positions.push_back(glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
-                if (mesh->mColors[0])
-                {
-                    result.colors.push_back(glm::vec4(mesh->mColors[0][i].r, mesh->mColors[0][i].g, mesh->mColors[0][i].b, mesh->mColors[0][i].a));
-                }
-                else
-                {
-                    result.colors.push_back(glm::vec4(color.r, color.g, color.b, 1.0f));
-                }
-                if (mesh->mTextureCoords[0])
+                vertex->position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+                if (colors)
                 {
-                    result.texCoords.push_back(glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y));
+                    vertex->color = glm::vec4(colors[i].r, colors[i].g, colors[i].b, colors[i].a);
                 }
                 else
                 {
-                    result.texCoords.push_back(glm::vec2(0.0f, 0.0f));
+                    vertex->color = glm::vec4(color.r, color.g, color.b, 1.0f);
                 }
-                if (mesh->mNormals)
+                if (texCoords)
                 {
-                    result.normals.push_back(glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z));
+                    vertex->texCoord = glm::vec2(texCoords[i].x, texCoords[i].y);
                 }
                 else
                 {
-                    result.normals.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+                    vertex->texCoord = glm::vec2(0.0f, 0.0f);
                 }
             }
+
+            uint32_t *index = outIndices + range.indexOffset;
             for (uint32_t i = 0; i < mesh->mNumFaces; i++)
             {
-                aiFace face = mesh->mFaces[i];
+                const aiFace &face = mesh->mFaces[i];
                 for (uint32_t j = 0; j < face.mNumIndices; j++)
                 {
-                    result.indices.push_back(face.mIndices[j]);
-                }
-            }
-
-            return result;
-        }
-
-    public:
-        std::vector<Vertex> get_one_vertices()
-        {
-            std::vector<Vertex> vertices;
-            for (auto &mesh : this->meshes)
-            {
-                for (int i = 0; i < mesh.positions.size(); i++)
-                {
-                    Vertex vertex;
-                    vertex.position = mesh.positions[i];
-                    vertex.color = mesh.colors[i];
-                    vertex.texCoord = mesh.texCoords[i];
-                    vertices.push_back(vertex);
-                }
-            }
-
-            return vertices;
-        }
-
-        std::vector<uint32_t> get_one_indices()
-        {
-            std::vector<uint32_t> indices;
-            uint32_t offset = 0;
-            for (auto &mesh : this->meshes)
-            {
-                for (auto &index : mesh.indices)
-                {
-                    indices.push_back(index + offset);
+                    *index++ = face.mIndices[j] + range.vertexOffset;
                 }
-                offset += mesh.positions.size();
             }
-
-            return indices;
         }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,274 @@
+#include "benchmark.hpp"
+#include "json_writer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        // seconds per turn of the default orbit
+        const float OrbitPeriod = 10.0f;
+
+        bool hasGpuTiming(const Engine *engine)
+        {
+            return engine->gpuProfiler && engine->gpuProfiler->is_supported() && engine->gpuProfiler->enabled;
+        }
+
+        void writeStats(std::ofstream &file, const char *name, const std::vector<double> &samples, bool available)
+        {
+            file << "  \"" << name << "\": ";
+            if (!available)
+            {
+                file << "null";
+                return;
+            }
+            FrameTimeStats stats = Benchmark::Summarize(samples);
+            file << "{\"count\": " << stats.count << ", \"min\": " << stats.min << ", \"p50\": " << stats.p50
+                 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max
+                 << ", \"mean\": " << stats.mean << ", \"variance\": " << stats.variance << "}";
+        }
+    }
+
+    Benchmark::Benchmark(Engine *engine, const BenchmarkSettings &settings)
+        : engine(engine), settings(settings)
+    {
+        if (settings.timestep <= 0.0f)
+        {
+            throw std::runtime_error("Benchmark timestep must be positive");
+        }
+        std::stable_sort(this->settings.cameraPath.begin(), this->settings.cameraPath.end(),
+                         [](const CameraKey &a, const CameraKey &b)
+                         { return a.time < b.time; });
+
+        // every run sees the same animation, whatever the frame rate
+        engine->fixedTimestep = settings.timestep;
+        cpuMilliseconds.reserve(settings.frameCount);
+        gpuMilliseconds.reserve(settings.frameCount);
+    }
+
+    bool Benchmark::BeginFrame()
+    {
+        if (!settled)
+        {
+            settled = isSettled();
+            if (!settled && settleTicks == MaxSettleTicks)
+            {
+                std::cout << "Benchmark: asynchronous loads did not settle after " << MaxSettleTicks << " ticks, measuring anyway" << std::endl;
+                settled = true;
+            }
+            if (!settled)
+            {
+                settleTicks++;
+            }
+            else
+            {
+                // the warmup starts from the same animation state whatever the loads took
+                engine->animationTime = 0.0f;
+            }
+        }
+
+        uint32_t total = settings.warmupFrames + settings.frameCount;
+        if (tick >= total)
+        {
+            // the last frames' GPU times are read back once their slots are reused
+            bool gpuPending = hasGpuTiming(engine) && !pendingFrames.empty();
+            if (!gpuPending || drainTicks > engine->framesInFlight)
+            {
+                return false;
+            }
+            drainTicks++;
+        }
+
+        engine->cameraPosition = cameraAt(tick * settings.timestep);
+        tickBegin = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void Benchmark::EndFrame()
+    {
+        if (!settled)
+        {
+            return;
+        }
+
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tickBegin).count();
+        uint32_t total = settings.warmupFrames + settings.frameCount;
+        bool measured = tick >= settings.warmupFrames && tick < total;
+        if (measured)
+        {
+            cpuMilliseconds.push_back(milliseconds);
+        }
+
+        // a tick that did not render, e.g. minimized, has no profiler frame of its own. One that was out of date
+        // has a frame without scopes, which resolves without a time
+        if (engine->gpuProfiler)
+        {
+            uint64_t frameNumber = engine->gpuProfiler->get_frame_number();
+            if (measured && frameNumber != lastFrameNumber)
+            {
+                pendingFrames.insert(frameNumber);
+            }
+            lastFrameNumber = frameNumber;
+
+            float frameMilliseconds = 0.0f;
+            uint64_t resolved = engine->gpuProfiler->get_resolved_frame();
+            if (resolved != 0 && pendingFrames.erase(resolved) && engine->gpuProfiler->GetResolved("frame", frameMilliseconds))
+            {
+                gpuMilliseconds.push_back(frameMilliseconds);
+            }
+        }
+        tick++;
+    }
+
+    void Benchmark::WriteReport(const std::string &path) const
+    {
+        vk::PhysicalDeviceProperties properties = engine->context->phyDevice.getProperties();
+
+        std::ofstream file(path);
+        file << "{\n  \"device\": ";
+        WriteJsonString(file, std::string(properties.deviceName));
+        file << ",\n  \"driver_version\": " << properties.driverVersion
+             << ",\n  \"api_version\": \"" << VK_VERSION_MAJOR(properties.apiVersion) << '.' << VK_VERSION_MINOR(properties.apiVersion)
+             << '.' << VK_VERSION_PATCH(properties.apiVersion) << "\""
+             << ",\n  \"mode\": \"" << (engine->offscreen ? "headless" : "windowed") << "\""
+             << ",\n  \"model\": ";
+        WriteJsonString(file, engine->modelPath);
+        file << ",\n  \"width\": " << engine->targetExtent.width << ",\n  \"height\": " << engine->targetExtent.height
+             << ",\n  \"frames_in_flight\": " << engine->framesInFlight
+             << ",\n  \"settle_ticks\": " << settleTicks << ",\n  \"warmup_frames\": " << settings.warmupFrames << ",\n  \"frames\": " << settings.frameCount
+             << ",\n  \"timestep\": " << settings.timestep << ",\n";
+        writeStats(file, "cpu_ms", cpuMilliseconds, true);
+        file << ",\n";
+        writeStats(file, "gpu_ms", gpuMilliseconds, hasGpuTiming(engine));
+        file << "\n}\n";
+
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write " + path);
+        }
+    }
+
+    std::vector<CameraKey> Benchmark::LoadCameraPath(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open camera path " + path);
+        }
+
+        std::vector<CameraKey> keys;
+        std::string line;
+        uint32_t lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+
+            std::istringstream stream(line);
+            CameraKey key;
+            std::string rest;
+            if (!(stream >> key.time >> key.position.x >> key.position.y >> key.position.z) || (stream >> rest))
+            {
+                throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": expected \"time x y z\"");
+            }
+            keys.push_back(key);
+        }
+
+        if (keys.empty())
+        {
+            throw std::runtime_error("Camera path " + path + " has no keys");
+        }
+        return keys;
+    }
+
+    FrameTimeStats Benchmark::Summarize(std::vector<double> samples)
+    {
+        FrameTimeStats stats;
+        if (samples.empty())
+        {
+            return stats;
+        }
+        std::sort(samples.begin(), samples.end());
+
+        size_t count = samples.size();
+        auto percentile = [&](double p)
+        {
+            size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * count));
+            return samples[std::max<size_t>(rank, 1) - 1];
+        };
+
+        double total = 0.0;
+        for (double sample : samples)
+        {
+            total += sample;
+        }
+        double mean = total / count;
+        double squares = 0.0;
+        for (double sample : samples)
+        {
+            squares += (sample - mean) * (sample - mean);
+        }
+
+        stats.count = static_cast<uint32_t>(count);
+        stats.min = samples.front();
+        stats.p50 = percentile(50.0);
+        stats.p95 = percentile(95.0);
+        stats.p99 = percentile(99.0);
+        stats.max = samples.back();
+        stats.mean = mean;
+        stats.variance = squares / count;
+        return stats;
+    }
+
+    bool Benchmark::isSettled() const
+    {
+        return engine->textureLoader->get_pending_count() == 0 && engine->pipelines->get_compiling_count() == 0 &&
+               engine->uploads->IsComplete(engine->uploadTicket);
+    }
+
+    glm::vec3 Benchmark::cameraAt(float time) const
+    {
+        const std::vector<CameraKey> &path = settings.cameraPath;
+        if (path.empty())
+        {
+            // circles the z axis at the distance and height of the default camera
+            float radius = 1.8f;
+            float angle = time / OrbitPeriod * glm::radians(360.0f);
+            return glm::vec3(radius * std::sin(angle), radius * std::cos(angle), 1.8f);
+        }
+        if (path.size() == 1)
+        {
+            return path.front().position;
+        }
+
+        float begin = path.front().time;
+        float duration = path.back().time - begin;
+        float t = duration > 0.0f ? begin + std::fmod(time, duration) : begin;
+        auto next = std::upper_bound(path.begin(), path.end(), t,
+                                     [](float value, const CameraKey &key)
+                                     { return value < key.time; });
+        if (next == path.begin())
+        {
+            return next->position;
+        }
+        if (next == path.end())
+        {
+            return path.back().position;
+        }
+
+        auto previous = next - 1;
+        float span = next->time - previous->time;
+        float blend = span > 0.0f ? (t - previous->time) / span : 0.0f;
+        return glm::mix(previous->position, next->position, blend);
+    }
+}
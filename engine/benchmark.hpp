@@ -0,0 +1,89 @@
+#pragma once
+
+#include "engine.hpp"
+
+#include <chrono>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace engine
+{
+    struct CameraKey
+    {
+        float time = 0.0f;
+        glm::vec3 position = glm::vec3(0.0f);
+    };
+
+    struct BenchmarkSettings
+    {
+        uint32_t warmupFrames = 60;
+        uint32_t frameCount = 600;
+        // simulated seconds per frame, the animation and camera never look at the wall clock
+        float timestep = 1.0f / 60.0f;
+        // interpolated linearly and looped, empty orbits the model
+        std::vector<CameraKey> cameraPath;
+    };
+
+    // Milliseconds, percentiles are nearest rank
+    struct FrameTimeStats
+    {
+        uint32_t count = 0;
+        double min = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+        double variance = 0.0;
+    };
+
+    // Drives an initialized engine through a fixed-timestep camera path and records per-frame times.
+    // Nothing is counted, warmup included, until texture decodes, uploads and pipeline compiles have settled.
+    // CPU time is the wall time of each tick, GPU time the profiler's frame scope, which is read back
+    // frames-in-flight frames late, so a few ticks after the last measured frame only collect GPU times.
+    class Benchmark final
+    {
+    public:
+        // ticks waited for asynchronous work before measuring anyway
+        static constexpr uint32_t MaxSettleTicks = 6000;
+
+        Benchmark(Engine *engine, const BenchmarkSettings &settings);
+
+        Benchmark(const Benchmark &) = delete;
+        Benchmark &operator=(const Benchmark &) = delete;
+
+        // Places the camera for the next tick, false once every frame has been measured
+        bool BeginFrame();
+        void EndFrame();
+
+        // Throws when the file cannot be written
+        void WriteReport(const std::string &path) const;
+
+        // One "time x y z" key per line, '#' starts a comment. Throws on a malformed file
+        static std::vector<CameraKey> LoadCameraPath(const std::string &path);
+        static FrameTimeStats Summarize(std::vector<double> samples);
+
+        const std::vector<double> &get_cpu_milliseconds() const { return cpuMilliseconds; }
+        const std::vector<double> &get_gpu_milliseconds() const { return gpuMilliseconds; }
+
+    private:
+        Engine *engine;
+        BenchmarkSettings settings;
+        bool settled = false;
+        uint32_t settleTicks = 0;
+        // counted from the first settled tick
+        uint32_t tick = 0;
+        // extra ticks for the GPU times still in flight
+        uint32_t drainTicks = 0;
+        // profiler frame numbers of measured ticks that have not been resolved yet
+        std::unordered_set<uint64_t> pendingFrames;
+        uint64_t lastFrameNumber = 0;
+        std::chrono::steady_clock::time_point tickBegin;
+        std::vector<double> cpuMilliseconds;
+        std::vector<double> gpuMilliseconds;
+
+        glm::vec3 cameraAt(float time) const;
+        bool isSettled() const;
+    };
+}
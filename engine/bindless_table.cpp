@@ -0,0 +1,87 @@
+#include "bindless_table.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine
+{
+    BindlessTable::BindlessTable(const Context *context, uint32_t frameCount)
+        : context(context), frameCount(frameCount), capacity(context->bindlessCapacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::runtime_error("Descriptor indexing is not supported");
+        }
+
+        // the same request a shader's sampler2D textures[] reflects to, so their layouts are identical
+        vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, 0, vk::ShaderStageFlagBits::eAll);
+        layout = context->layoutCache->GetSetLayout({binding});
+
+        vk::DescriptorPoolSize poolSize(vk::DescriptorType::eCombinedImageSampler, capacity);
+        vk::DescriptorPoolCreateInfo poolInfo;
+        poolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+            .setMaxSets(1)
+            .setPoolSizes(poolSize);
+        pool = context->device.createDescriptorPool(poolInfo);
+
+        vk::DescriptorSetAllocateInfo allocInfo;
+        allocInfo.setDescriptorPool(pool)
+            .setSetLayouts(layout);
+        set = context->device.allocateDescriptorSets(allocInfo).front();
+    }
+
+    BindlessTable::~BindlessTable()
+    {
+        // the layout belongs to the layout cache
+        context->device.destroyDescriptorPool(pool);
+    }
+
+    uint32_t BindlessTable::Add(vk::ImageView view, vk::Sampler sampler)
+    {
+        uint32_t index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else if (next < capacity)
+        {
+            index = next++;
+        }
+        else
+        {
+            throw std::runtime_error("Bindless texture table is full");
+        }
+
+        // update after bind, so frames in flight that never index this slot are unaffected
+        vk::DescriptorImageInfo imageInfo(sampler, view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        vk::WriteDescriptorSet write;
+        write.setDstSet(set)
+            .setDstBinding(0)
+            .setDstArrayElement(index)
+            .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+            .setImageInfo(imageInfo);
+        context->device.updateDescriptorSets(write, nullptr);
+
+        count++;
+        return index;
+    }
+
+    void BindlessTable::Remove(uint32_t index)
+    {
+        retired.push_back({index, frame + frameCount});
+        count--;
+    }
+
+    void BindlessTable::BeginFrame()
+    {
+        frame++;
+        auto expired = std::partition(retired.begin(), retired.end(), [this](const RetiredSlot &slot)
+                                      { return slot.frame > frame; });
+        for (auto it = expired; it != retired.end(); ++it)
+        {
+            freeSlots.push_back(it->index);
+        }
+        retired.erase(expired, retired.end());
+    }
+}
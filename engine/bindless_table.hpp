@@ -0,0 +1,57 @@
+#pragma once
+
+#include "context.hpp"
+
+#include <vector>
+
+namespace engine
+{
+    // Every texture in one partially bound, update after bind array of combined image samplers
+    // (set layout binding 0 with descriptorCount 0 in the LayoutCache). The set is bound once per
+    // command buffer and materials select textures by index, so draws never rebind descriptors.
+    // Not thread safe, textures are registered from the main thread
+    class BindlessTable final
+    {
+    public:
+        BindlessTable(const Context *context, uint32_t frameCount);
+        ~BindlessTable();
+
+        BindlessTable(const BindlessTable &) = delete;
+        BindlessTable &operator=(const BindlessTable &) = delete;
+
+        // Returns the array index of the texture, throws when the table is full
+        uint32_t Add(vk::ImageView view, vk::Sampler sampler);
+        // The slot is reused once the frames in flight can no longer read it
+        void Remove(uint32_t index);
+
+        // Call once per frame after waiting for its fence
+        void BeginFrame();
+
+        static bool IsSupported(const Context *context) { return context->bindlessCapacity > 0; }
+
+        vk::DescriptorSet get_set() const { return set; }
+        vk::DescriptorSetLayout get_layout() const { return layout; }
+        uint32_t get_capacity() const { return capacity; }
+        uint32_t get_count() const { return count; }
+
+    private:
+        struct RetiredSlot
+        {
+            uint32_t index;
+            uint64_t frame;
+        };
+
+        const Context *context;
+        uint32_t frameCount;
+        uint32_t capacity;
+        vk::DescriptorSetLayout layout;
+        vk::DescriptorPool pool;
+        vk::DescriptorSet set;
+
+        uint32_t next = 0;
+        uint32_t count = 0;
+        uint64_t frame = 0;
+        std::vector<uint32_t> freeSlots;
+        std::vector<RetiredSlot> retired;
+    };
+}
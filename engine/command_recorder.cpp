@@ -0,0 +1,97 @@
+#include "command_recorder.hpp"
+
+#include <algorithm>
+
+namespace engine
+{
+    namespace
+    {
+        // below this a chunk costs more to hand out than to record
+        const uint32_t MinItemsPerChunk = 256;
+    }
+
+    CommandRecorder::CommandRecorder(const Context *context, ThreadPool *threadPool, uint32_t frameCount)
+        : context(context), threadPool(threadPool), slotCount(threadPool->get_thread_count() + 1)
+    {
+        // transient, the pools are reset every frame
+        vk::CommandPoolCreateInfo poolInfo;
+        poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(context->queueFamilyIndices.graphicsQueue.value());
+
+        slots.resize(frameCount * slotCount);
+        for (auto &slot : slots)
+        {
+            slot.pool = context->device.createCommandPool(poolInfo);
+        }
+    }
+
+    CommandRecorder::~CommandRecorder()
+    {
+        for (auto &slot : slots)
+        {
+            context->device.destroyCommandPool(slot.pool);
+        }
+    }
+
+    void CommandRecorder::BeginFrame(uint32_t frameIndex)
+    {
+        this->frameIndex = frameIndex;
+        for (uint32_t i = 0; i < slotCount; i++)
+        {
+            Slot &slot = slots[frameIndex * slotCount + i];
+            context->device.resetCommandPool(slot.pool);
+            slot.used = 0;
+        }
+    }
+
+    std::vector<vk::CommandBuffer> CommandRecorder::Record(uint32_t count, vk::RenderPass renderPass, uint32_t subpass,
+                                                           vk::Framebuffer framebuffer, const RecordFunction &record)
+    {
+        uint32_t chunkCount = std::min(slotCount, (count + MinItemsPerChunk - 1) / MinItemsPerChunk);
+        chunkCount = std::max(chunkCount, 1u);
+        lastChunkCount = chunkCount;
+
+        std::vector<vk::CommandBuffer> commandBuffers(chunkCount);
+        threadPool->ParallelFor(chunkCount, [&](uint32_t chunk)
+                                {
+                                    uint32_t first = static_cast<uint32_t>(uint64_t(count) * chunk / chunkCount);
+                                    uint32_t last = static_cast<uint32_t>(uint64_t(count) * (chunk + 1) / chunkCount);
+
+                                    vk::CommandBuffer commandBuffer = begin(chunk, renderPass, subpass, framebuffer);
+                                    record(commandBuffer, first, last);
+                                    commandBuffer.end();
+                                    commandBuffers[chunk] = commandBuffer; });
+        return commandBuffers;
+    }
+
+    vk::CommandBuffer CommandRecorder::BeginSecondary(vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer)
+    {
+        return begin(0, renderPass, subpass, framebuffer);
+    }
+
+    vk::CommandBuffer CommandRecorder::begin(uint32_t slotIndex, vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer)
+    {
+        Slot &slot = slots[frameIndex * slotCount + slotIndex];
+        if (slot.used == slot.buffers.size())
+        {
+            vk::CommandBufferAllocateInfo allocInfo;
+            allocInfo.setCommandPool(slot.pool)
+                .setLevel(vk::CommandBufferLevel::eSecondary)
+                .setCommandBufferCount(1);
+            slot.buffers.push_back(context->device.allocateCommandBuffers(allocInfo).front());
+        }
+        vk::CommandBuffer commandBuffer = slot.buffers[slot.used++];
+
+        vk::CommandBufferInheritanceInfo inheritanceInfo;
+        inheritanceInfo.setRenderPass(renderPass)
+            .setSubpass(subpass)
+            .setFramebuffer(framebuffer)
+            .setPipelineStatistics(pipelineStatistics);
+
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+            .setPInheritanceInfo(&inheritanceInfo);
+        commandBuffer.begin(beginInfo);
+        return commandBuffer;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "context.hpp"
+#include "thread_pool.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace engine
+{
+    // Records draws into secondary command buffers on the thread pool. Every frame in flight has one
+    // command pool per recording slot, a slot is only ever used by the thread running its chunk, so
+    // no pool is shared between threads. The primary executes the returned buffers inside the render pass
+    class CommandRecorder final
+    {
+    public:
+        // called with the secondary to record into and the [begin, end) range of items of its chunk
+        using RecordFunction = std::function<void(vk::CommandBuffer commandBuffer, uint32_t begin, uint32_t end)>;
+
+        CommandRecorder(const Context *context, ThreadPool *threadPool, uint32_t frameCount);
+        ~CommandRecorder();
+
+        CommandRecorder(const CommandRecorder &) = delete;
+        CommandRecorder &operator=(const CommandRecorder &) = delete;
+
+        // Resets the pools of frameIndex, the caller must have waited for that frame's fence
+        void BeginFrame(uint32_t frameIndex);
+
+        // Splits count items into chunks recorded in parallel, returns their secondaries in item order.
+        // Nothing but record may touch the recorder until it returns
+        std::vector<vk::CommandBuffer> Record(uint32_t count, vk::RenderPass renderPass, uint32_t subpass,
+                                              vk::Framebuffer framebuffer, const RecordFunction &record);
+
+        // A secondary for the calling thread, e.g. for ImGui, which must record into the same subpass
+        vk::CommandBuffer BeginSecondary(vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer);
+
+        // statistics queries the primary may have active while the secondaries execute
+        void set_pipeline_statistics(vk::QueryPipelineStatisticFlags flags) { pipelineStatistics = flags; }
+
+        uint32_t get_slot_count() const { return slotCount; }
+        uint32_t get_last_chunk_count() const { return lastChunkCount; }
+
+    private:
+        struct Slot
+        {
+            vk::CommandPool pool;
+            std::vector<vk::CommandBuffer> buffers;
+            uint32_t used = 0;
+        };
+
+        const Context *context;
+        ThreadPool *threadPool;
+        uint32_t slotCount;
+        // frames * slotCount, slot s of frame f at f * slotCount + s
+        std::vector<Slot> slots;
+        uint32_t frameIndex = 0;
+        uint32_t lastChunkCount = 0;
+        vk::QueryPipelineStatisticFlags pipelineStatistics;
+
+        vk::CommandBuffer begin(uint32_t slot, vk::RenderPass renderPass, uint32_t subpass, vk::Framebuffer framebuffer);
+    };
+}
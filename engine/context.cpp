@@ -1,22 +1,37 @@
 #include "context.hpp"
+
+#include <algorithm>
+#include <string>
+
 #define IM_ARRAYSIZE(_ARR) ((int)(sizeof(_ARR) / sizeof(*(_ARR))))
 
 namespace engine
 {
-    Context::Context(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface)
+    namespace
+    {
+        const uint32_t MaxBindlessTextures = 4096;
+    }
+
+    Context::Context(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface,
+                     const std::string &pipelineCachePath)
     {
         CreateInstance(extensions);
         pickupPhysicalDevice();
-        surface = createSurface(instance);
+        if (createSurface)
+        {
+            surface = createSurface(instance);
+        }
         queryQueueFamilyIndices();
         createLogicalDevice();
         createDescriptorPool();
-        createDescriptorSetLayout();
+        pipelineCache = std::make_unique<PipelineCache>(phyDevice, device, pipelineCachePath, pipelineCreationFeedback);
+        layoutCache = std::make_unique<LayoutCache>(device, bindlessCapacity);
     }
 
     Context::~Context()
     {
-        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        pipelineCache.reset();
+        layoutCache.reset();
         device.destroyDescriptorPool(descriptorPool);
         // instance.destroySurfaceKHR(surface);
         device.destroy();
@@ -32,7 +47,15 @@ namespace engine
         createInfo.setPApplicationInfo(&appInfo);
         instance = vk::createInstance(createInfo);
 
-        std::vector<const char *> layers = {"VK_LAYER_KHRONOS_validation"};
+        // render nodes and CI usually have no SDK installed, requesting a missing layer fails instance creation
+        std::vector<const char *> layers;
+        for (const auto &layer : vk::enumerateInstanceLayerProperties())
+        {
+            if (std::string(layer.layerName.data()) == "VK_LAYER_KHRONOS_validation")
+            {
+                layers.push_back("VK_LAYER_KHRONOS_validation");
+            }
+        }
 
         createInfo.setPEnabledLayerNames(layers)
             .setPEnabledExtensionNames(extensions);
@@ -48,7 +71,37 @@ namespace engine
             throw std::runtime_error("Failed to find GPUs with Vulkan support!");
         }
 
+        // upload tickets are timeline semaphores, which need Vulkan 1.2
+        std::vector<vk::PhysicalDevice> candidates;
+        std::string rejected;
         for (auto &device : physicalDevices)
+        {
+            auto properties = device.getProperties();
+            bool timelineSemaphore = false;
+            if (properties.apiVersion >= VK_API_VERSION_1_2)
+            {
+                auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+                timelineSemaphore = features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore;
+            }
+
+            if (timelineSemaphore)
+            {
+                candidates.push_back(device);
+            }
+            else
+            {
+                rejected += std::string(rejected.empty() ? "" : ", ") + properties.deviceName.data() + " (Vulkan " +
+                            std::to_string(VK_VERSION_MAJOR(properties.apiVersion)) + "." +
+                            std::to_string(VK_VERSION_MINOR(properties.apiVersion)) + ")";
+            }
+        }
+
+        if (candidates.empty())
+        {
+            throw std::runtime_error("Failed to find a GPU with Vulkan 1.2 and timeline semaphores, found: " + rejected);
+        }
+
+        for (auto &device : candidates)
         {
             auto properties = device.getProperties();
             auto features = device.getFeatures();
@@ -62,7 +115,7 @@ namespace engine
 
         if (!phyDevice)
         {
-            phyDevice = physicalDevices[0];
+            phyDevice = candidates[0];
         }
 
         std::cout << "Physical Device: " << phyDevice.getProperties().deviceName << std::endl;
@@ -70,28 +123,38 @@ namespace engine
 
     void Context::createLogicalDevice()
     {
-        std::array<const char *, 1> extensions = {
-            VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        };
+        std::vector<const char *> extensions;
+        if (surface)
+        {
+            extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+
+        // core in 1.3, without it the pipeline cache cannot tell hits from misses
+        pipelineCreationFeedback = phyDevice.getProperties().apiVersion >= VK_API_VERSION_1_3;
+        if (!pipelineCreationFeedback)
+        {
+            for (const auto &extension : phyDevice.enumerateDeviceExtensionProperties())
+            {
+                if (std::string(extension.extensionName.data()) == VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)
+                {
+                    extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+                    pipelineCreationFeedback = true;
+                    break;
+                }
+            }
+        }
         vk::DeviceCreateInfo createInfo;
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
         float priorities = 1.0f;
-        if (queueFamilyIndices.presentQueue.value() == queueFamilyIndices.graphicsQueue.value())
-        {
-            vk::DeviceQueueCreateInfo queueCreateInfo;
-            queueCreateInfo.setQueueFamilyIndex(queueFamilyIndices.graphicsQueue.value())
-                .setQueueCount(1)
-                .setPQueuePriorities(&priorities);
-            queueCreateInfos.push_back(std::move(queueCreateInfo));
-        }
-        else
+        std::vector<uint32_t> families = {queueFamilyIndices.graphicsQueue.value(),
+                                          queueFamilyIndices.presentQueue.value(),
+                                          queueFamilyIndices.transferQueue.value()};
+        std::sort(families.begin(), families.end());
+        families.erase(std::unique(families.begin(), families.end()), families.end());
+        for (uint32_t family : families)
         {
             vk::DeviceQueueCreateInfo queueCreateInfo;
-            queueCreateInfo.setQueueFamilyIndex(queueFamilyIndices.graphicsQueue.value())
-                .setQueueCount(1)
-                .setPQueuePriorities(&priorities);
-            queueCreateInfos.push_back(queueCreateInfo);
-            queueCreateInfo.setQueueFamilyIndex(queueFamilyIndices.presentQueue.value())
+            queueCreateInfo.setQueueFamilyIndex(family)
                 .setQueueCount(1)
                 .setPQueuePriorities(&priorities);
             queueCreateInfos.push_back(queueCreateInfo);
@@ -110,8 +173,42 @@ namespace engine
         };
 
         deviceFeatures.setSamplerAnisotropy(checkSamplerAnisotropy());
+
+        // the scene pass is recorded into secondaries, its statistics query has to be inherited
+        auto supported = phyDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        const auto &supportedFeatures = supported.get<vk::PhysicalDeviceFeatures2>().features;
+        pipelineStatistics = supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries;
+        deviceFeatures.setPipelineStatisticsQuery(pipelineStatistics)
+            .setInheritedQueries(pipelineStatistics);
         createInfo.setPEnabledFeatures(&deviceFeatures);
 
+        // timeline semaphores back the upload tickets
+        const auto &supported12 = supported.get<vk::PhysicalDeviceVulkan12Features>();
+        hostQueryReset = supported12.hostQueryReset;
+        vk::PhysicalDeviceVulkan12Features vulkan12Features;
+        vulkan12Features.setTimelineSemaphore(VK_TRUE)
+            .setHostQueryReset(hostQueryReset);
+        createInfo.setPNext(&vulkan12Features);
+
+        // one partially bound, update after bind sampler array holds every texture
+        if (supported12.descriptorIndexing && supported12.runtimeDescriptorArray &&
+            supported12.descriptorBindingPartiallyBound && supported12.descriptorBindingSampledImageUpdateAfterBind)
+        {
+            vulkan12Features.setDescriptorIndexing(VK_TRUE)
+                .setRuntimeDescriptorArray(VK_TRUE)
+                .setDescriptorBindingPartiallyBound(VK_TRUE)
+                .setDescriptorBindingSampledImageUpdateAfterBind(VK_TRUE)
+                .setShaderSampledImageArrayNonUniformIndexing(supported12.shaderSampledImageArrayNonUniformIndexing);
+
+            auto properties = phyDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+            const auto &properties12 = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+            bindlessCapacity = std::min({MaxBindlessTextures,
+                                         properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+                                         properties12.maxDescriptorSetUpdateAfterBindSamplers,
+                                         properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                         properties12.maxPerStageDescriptorUpdateAfterBindSamplers});
+        }
+
         device = phyDevice.createDevice(createInfo);
         if (!device)
         {
@@ -120,6 +217,7 @@ namespace engine
 
         graphicsQueue = device.getQueue(queueFamilyIndices.graphicsQueue.value(), 0);
         presentQueue = device.getQueue(queueFamilyIndices.presentQueue.value(), 0);
+        transferQueue = device.getQueue(queueFamilyIndices.transferQueue.value(), 0);
     }
 
     void Context::queryQueueFamilyIndices()
@@ -128,111 +226,49 @@ namespace engine
         for (int i = 0; i < queueFamilies.size(); i++)
         {
             const auto &queueFamily = queueFamilies[i];
-            if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
+            if (!queueFamilyIndices.graphicsQueue && queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
             {
                 queueFamilyIndices.graphicsQueue = i;
             }
-            if (phyDevice.getSurfaceSupportKHR(i, surface))
+            if (surface && !queueFamilyIndices.presentQueue && phyDevice.getSurfaceSupportKHR(i, surface))
             {
                 queueFamilyIndices.presentQueue = i;
             }
 
-            if (queueFamilyIndices)
+            // prefer a pure copy family over an async compute one
+            if (queueFamily.queueFlags & vk::QueueFlagBits::eTransfer && !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics))
             {
-                break;
+                bool pureTransfer = !(queueFamily.queueFlags & vk::QueueFlagBits::eCompute);
+                if (!queueFamilyIndices.transferQueue || pureTransfer)
+                {
+                    queueFamilyIndices.transferQueue = i;
+                }
             }
         }
+
+        if (!queueFamilyIndices.transferQueue)
+        {
+            queueFamilyIndices.transferQueue = queueFamilyIndices.graphicsQueue;
+        }
+        // headless, nothing is presented
+        if (!surface)
+        {
+            queueFamilyIndices.presentQueue = queueFamilyIndices.graphicsQueue;
+        }
     }
 
     void Context::createDescriptorPool()
     {
+        // ImGui only allocates combined image samplers, one for the font plus any textures it displays
         VkDescriptorPoolSize pool_sizes[] =
             {
-                {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-                {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-                {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-                {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-                {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}};
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16}};
         VkDescriptorPoolCreateInfo pool_info = {};
         pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-        pool_info.maxSets = 1000 * IM_ARRAYSIZE(pool_sizes);
+        pool_info.maxSets = 16;
         pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(pool_sizes);
         pool_info.pPoolSizes = pool_sizes;
         descriptorPool = device.createDescriptorPool(pool_info);
     }
-
-    void Context::createDescriptorSets(std::vector<vk::Buffer> &uniformBuffers, uint32_t swapChainImagesCount, vk::ImageView textureImageView, vk::Sampler textureSampler)
-    {
-        std::vector<vk::DescriptorSetLayout> layouts(swapChainImagesCount, descriptorSetLayout);
-        vk::DescriptorSetAllocateInfo allocInfo;
-        allocInfo.setDescriptorPool(descriptorPool)
-            .setDescriptorSetCount(swapChainImagesCount)
-            .setPSetLayouts(layouts.data());
-
-        descriptorSets = device.allocateDescriptorSets(allocInfo);
-
-        for (size_t i = 0; i < swapChainImagesCount; i++)
-        {
-            vk::DescriptorBufferInfo bufferInfo;
-            bufferInfo.setBuffer(uniformBuffers[i])
-                .setOffset(0)
-                .setRange(sizeof(UniformBufferObject));
-
-            vk::DescriptorImageInfo imageInfo;
-            imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-                .setImageView(textureImageView)
-                .setSampler(textureSampler);
-
-            vk::WriteDescriptorSet bufferdescriptorWrite;
-            bufferdescriptorWrite.setDstSet(descriptorSets[i])
-                .setDstBinding(0)
-                .setDstArrayElement(0)
-                .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-                .setDescriptorCount(1)
-                .setPBufferInfo(&bufferInfo);
-
-            vk::WriteDescriptorSet samplerdescriptorWrite;
-            samplerdescriptorWrite.setDstSet(descriptorSets[i])
-                .setDstBinding(1)
-                .setDstArrayElement(0)
-                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-                .setDescriptorCount(1)
-                .setPImageInfo(&imageInfo);
-            
-            std::array<vk::WriteDescriptorSet, 2> descriptorWrite = {bufferdescriptorWrite, samplerdescriptorWrite};
-
-            device.updateDescriptorSets(descriptorWrite, nullptr);
-        }
-    }
-
-    void Context::createDescriptorSetLayout()
-    {
-        vk::DescriptorSetLayoutCreateInfo layoutInfo;
-
-        vk::DescriptorSetLayoutBinding uboLayoutBinding;
-        uboLayoutBinding.setBinding(0)
-            .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-            .setStageFlags(vk::ShaderStageFlagBits::eVertex)
-            .setDescriptorCount(1);
-
-        vk::DescriptorSetLayoutBinding samplerLayoutBinding;
-        samplerLayoutBinding.setBinding(1)
-            .setDescriptorCount(1)
-            .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-            .setPImmutableSamplers(nullptr)
-            .setStageFlags(vk::ShaderStageFlagBits::eFragment);
-
-        std::array<vk::DescriptorSetLayoutBinding, 2> binding = {uboLayoutBinding, samplerLayoutBinding};
-
-        layoutInfo.setBindings(binding);
-
-        descriptorSetLayout = device.createDescriptorSetLayout(layoutInfo);
-    }
 }
\ No newline at end of file
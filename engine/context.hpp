@@ -9,17 +9,13 @@
 #include <functional>
 
 #include "glm/glm.hpp"
+#include "mesh_data.hpp"
+#include "pipeline_cache.hpp"
+#include "layout_cache.hpp"
 
 namespace engine
 {
     using CreateSurfaceFunction = std::function<VkSurfaceKHR(vk::Instance)>;
-    struct Vertex
-    {
-        glm::vec3 position;
-        glm::vec4 color;
-        glm::vec2 texCoord;
-    };
-
     struct UniformBufferObject
     {
         glm::mat4 model;
@@ -30,13 +26,17 @@ namespace engine
     class Context final
     {
     public:
-        Context(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface);
+        // an empty createSurface makes a headless context, without a surface or the swapchain extension
+        Context(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface,
+                const std::string &pipelineCachePath = "pipeline_cache.bin");
         ~Context();
 
         struct QueueFamilyIndices final
         {
             std::optional<uint32_t> graphicsQueue;
             std::optional<uint32_t> presentQueue;
+            // a family without graphics, so uploads run on the copy engine. Falls back to the graphics family
+            std::optional<uint32_t> transferQueue;
 
             operator bool() const
             {
@@ -49,11 +49,22 @@ namespace engine
         vk::Device device;
         vk::Queue graphicsQueue;
         vk::Queue presentQueue;
+        vk::Queue transferQueue;
         vk::SurfaceKHR surface;
         QueueFamilyIndices queueFamilyIndices;
+        // ImGui's font texture, scene descriptors come from a DescriptorAllocator
         vk::DescriptorPool descriptorPool;
-        std::vector<vk::DescriptorSet> descriptorSets;
-        vk::DescriptorSetLayout descriptorSetLayout;
+        // shared by every pipeline the engine and ImGui create
+        std::unique_ptr<PipelineCache> pipelineCache;
+        // set and pipeline layouts reflected from shaders
+        std::unique_ptr<LayoutCache> layoutCache;
+        // descriptor indexing for the bindless texture table, bindlessCapacity is 0 without it
+        uint32_t bindlessCapacity = 0;
+        // GPU profiling: queries are reset from the host, statistics are also inherited by secondaries
+        bool hostQueryReset = false;
+        bool pipelineStatistics = false;
+        // Vulkan 1.3 or VK_EXT_pipeline_creation_feedback
+        bool pipelineCreationFeedback = false;
 
     public:
         void CreateInstance(const std::vector<const char *> &extensions);
@@ -61,7 +72,5 @@ namespace engine
         void createLogicalDevice();
         void queryQueueFamilyIndices();
         void createDescriptorPool();
-        void createDescriptorSetLayout();
-        void createDescriptorSets(std::vector<vk::Buffer>& uniformBuffers, uint32_t swapChainImagesCount, vk::ImageView textureImageView, vk::Sampler textureSampler);
     };
 }
\ No newline at end of file
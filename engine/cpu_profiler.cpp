@@ -0,0 +1,233 @@
+#include "cpu_profiler.hpp"
+#include "json_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace engine
+{
+    namespace
+    {
+        struct Event
+        {
+            const char *name;
+            uint64_t begin;
+            uint64_t end;
+        };
+
+        // single producer: only the owning thread writes events, written is published with release
+        struct ThreadRing
+        {
+            uint32_t id = 0;
+            std::string name;
+            std::array<Event, CpuProfiler::RingSize> events;
+            std::atomic<uint64_t> written{0};
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            // never freed, a finished thread's zones stay exportable
+            std::vector<std::unique_ptr<ThreadRing>> rings;
+
+            std::atomic<bool> capturing{false};
+            uint32_t captureFrames = 0;
+            uint64_t captureBegin = 0;
+            bool enabledBeforeCapture = false;
+            std::string capturePath;
+            uint64_t frameBegin = 0;
+        };
+
+        Registry &registry()
+        {
+            static Registry instance;
+            return instance;
+        }
+
+        const auto Epoch = std::chrono::steady_clock::now();
+
+        thread_local ThreadRing *threadRing = nullptr;
+
+        ThreadRing *getThreadRing()
+        {
+            if (!threadRing)
+            {
+                Registry &reg = registry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                reg.rings.push_back(std::make_unique<ThreadRing>());
+                threadRing = reg.rings.back().get();
+                threadRing->id = static_cast<uint32_t>(reg.rings.size());
+            }
+            return threadRing;
+        }
+
+        // a ring may keep being written during the export, whatever was overwritten meanwhile is dropped
+        std::vector<Event> readRing(const ThreadRing &ring)
+        {
+            uint64_t written = ring.written.load(std::memory_order_acquire);
+            uint64_t first = written > CpuProfiler::RingSize ? written - CpuProfiler::RingSize : 0;
+            std::vector<Event> events;
+            events.reserve(static_cast<size_t>(written - first));
+            for (uint64_t i = first; i < written; i++)
+            {
+                events.push_back(ring.events[i % CpuProfiler::RingSize]);
+            }
+
+            // the writer may already be filling index after, which reuses the slot of after - RingSize
+            uint64_t after = ring.written.load(std::memory_order_acquire);
+            uint64_t overwritten = after + 1 > CpuProfiler::RingSize ? after + 1 - CpuProfiler::RingSize : 0;
+            if (overwritten > first)
+            {
+                events.erase(events.begin(), events.begin() + static_cast<size_t>(std::min(overwritten - first, written - first)));
+            }
+            return events;
+        }
+
+        // zones overlapping [begin, end)
+        void writeTrace(const std::string &path, uint64_t begin, uint64_t end)
+        {
+            Registry &reg = registry();
+            std::vector<std::pair<ThreadRing *, std::string>> rings;
+            {
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                for (auto &ring : reg.rings)
+                {
+                    rings.emplace_back(ring.get(), ring->name);
+                }
+            }
+
+            std::ofstream file(path);
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            for (const auto &entry : rings)
+            {
+                const ThreadRing *ring = entry.first;
+                if (!entry.second.empty())
+                {
+                    file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << ring->id << ",\"args\":{\"name\":";
+                    WriteJsonString(file, entry.second);
+                    file << "}}";
+                    first = false;
+                }
+
+                // trace timestamps are microseconds
+                for (const Event &event : readRing(*ring))
+                {
+                    if (event.end < begin || event.begin >= end)
+                    {
+                        continue;
+                    }
+                    file << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":";
+                    WriteJsonString(file, event.name);
+                    file << ",\"pid\":1,\"tid\":" << ring->id << ",\"ts\":" << event.begin / 1000.0
+                         << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+                    first = false;
+                }
+            }
+            file << "\n]}\n";
+
+            if (!file)
+            {
+                throw std::runtime_error("Failed to write " + path);
+            }
+        }
+    }
+
+    void CpuProfiler::SetEnabled(bool value)
+    {
+        enabled.store(value, std::memory_order_relaxed);
+    }
+
+    void CpuProfiler::Capture(uint32_t frameCount, const std::string &path)
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (reg.capturing.load() || frameCount == 0)
+        {
+            return;
+        }
+        reg.captureFrames = frameCount;
+        reg.captureBegin = Now();
+        reg.capturePath = path;
+        reg.enabledBeforeCapture = IsEnabled();
+        SetEnabled(true);
+        reg.capturing.store(true);
+    }
+
+    bool CpuProfiler::IsCapturing()
+    {
+        return registry().capturing.load();
+    }
+
+    void CpuProfiler::EndFrame()
+    {
+        Registry &reg = registry();
+        uint64_t now = Now();
+        if (IsEnabled() && reg.frameBegin != 0)
+        {
+            Record("frame", reg.frameBegin, now);
+        }
+        reg.frameBegin = now;
+
+        if (!reg.capturing.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        std::string path;
+        uint64_t captureBegin;
+        {
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (--reg.captureFrames > 0)
+            {
+                return;
+            }
+            path = reg.capturePath;
+            captureBegin = reg.captureBegin;
+            SetEnabled(reg.enabledBeforeCapture);
+            reg.capturing.store(false);
+        }
+        // a failed export must not take the frame down with it
+        try
+        {
+            writeTrace(path, captureBegin, now);
+            std::cout << "CPU trace written to " << path << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Failed to export CPU trace: " << e.what() << std::endl;
+        }
+    }
+
+    void CpuProfiler::SetThreadName(const std::string &name)
+    {
+        ThreadRing *ring = getThreadRing();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        ring->name = name;
+    }
+
+    void CpuProfiler::WriteChromeTrace(const std::string &path)
+    {
+        writeTrace(path, 0, ~0ull);
+    }
+
+    uint64_t CpuProfiler::Now()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch).count());
+    }
+
+    void CpuProfiler::Record(const char *name, uint64_t begin, uint64_t end)
+    {
+        ThreadRing *ring = getThreadRing();
+        uint64_t index = ring->written.load(std::memory_order_relaxed);
+        ring->events[index % RingSize] = {name, begin, end};
+        ring->written.store(index + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace engine
+{
+    // Scoped CPU zones, recorded into a fixed ring per thread and exported as Chrome trace event JSON,
+    // which Perfetto and chrome://tracing open directly. Each thread only ever writes its own ring, so
+    // recording takes no lock. Zones are compiled in with ENGINE_PROFILE and cost a relaxed load while
+    // recording is off. Timestamps are steady_clock nanoseconds.
+    class CpuProfiler final
+    {
+    public:
+        // zones kept per thread, the oldest are overwritten
+        static constexpr uint32_t RingSize = 1u << 14;
+
+        static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+        static void SetEnabled(bool value);
+
+        // Records the next frameCount frames and writes them to path once the last one has ended
+        static void Capture(uint32_t frameCount, const std::string &path);
+        static bool IsCapturing();
+        // Call once per frame on the main thread, records the frame as a zone of its own.
+        // A finished capture that cannot be written is logged, not thrown
+        static void EndFrame();
+
+        // Shown instead of the thread id in the trace
+        static void SetThreadName(const std::string &name);
+        // Writes every zone still held by the rings. Throws when the file cannot be written
+        static void WriteChromeTrace(const std::string &path);
+
+        static uint64_t Now();
+        static void Record(const char *name, uint64_t begin, uint64_t end);
+
+    private:
+        static inline std::atomic<bool> enabled{false};
+    };
+
+    // Records its lifetime as one zone. name must outlive the export, string literals in practice
+    class ProfileZone final
+    {
+    public:
+        explicit ProfileZone(const char *name)
+            : name(name), active(CpuProfiler::IsEnabled())
+        {
+            if (active)
+            {
+                begin = CpuProfiler::Now();
+            }
+        }
+        ~ProfileZone()
+        {
+            if (active)
+            {
+                CpuProfiler::Record(name, begin, CpuProfiler::Now());
+            }
+        }
+
+        ProfileZone(const ProfileZone &) = delete;
+        ProfileZone &operator=(const ProfileZone &) = delete;
+
+    private:
+        const char *name;
+        bool active;
+        uint64_t begin = 0;
+    };
+}
+
+#ifdef ENGINE_PROFILE
+#define ENGINE_PROFILE_CONCAT_INNER(a, b) a##b
+#define ENGINE_PROFILE_CONCAT(a, b) ENGINE_PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ::engine::ProfileZone ENGINE_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_FRAME() ::engine::CpuProfiler::EndFrame()
+#define PROFILE_THREAD(name) ::engine::CpuProfiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME()
+#define PROFILE_THREAD(name)
+#endif
@@ -0,0 +1,254 @@
+#include "descriptor_allocator.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        // the smallest pool worth creating, an empty peak would otherwise make single-set pools
+        const uint32_t MinPoolSets = 16;
+    }
+
+    DescriptorInfo DescriptorInfo::Buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range)
+    {
+        DescriptorInfo info;
+        memset(&info, 0, sizeof(info));
+        info.buffer.buffer = buffer;
+        info.buffer.offset = offset;
+        info.buffer.range = range;
+        return info;
+    }
+
+    DescriptorInfo DescriptorInfo::Image(vk::Sampler sampler, vk::ImageView view, vk::ImageLayout layout)
+    {
+        DescriptorInfo info;
+        memset(&info, 0, sizeof(info));
+        info.image.sampler = sampler;
+        info.image.imageView = view;
+        info.image.imageLayout = static_cast<VkImageLayout>(layout);
+        return info;
+    }
+
+    DescriptorInfo DescriptorInfo::TexelBuffer(vk::BufferView view)
+    {
+        DescriptorInfo info;
+        memset(&info, 0, sizeof(info));
+        info.texelBuffer = view;
+        return info;
+    }
+
+    void DescriptorAllocator::Usage::Add(const Usage &other)
+    {
+        sets += other.sets;
+        for (uint32_t i = 0; i < DescriptorTypeCount; i++)
+        {
+            descriptors[i] += other.descriptors[i];
+        }
+    }
+
+    void DescriptorAllocator::Usage::Max(const Usage &other)
+    {
+        sets = std::max(sets, other.sets);
+        for (uint32_t i = 0; i < DescriptorTypeCount; i++)
+        {
+            descriptors[i] = std::max(descriptors[i], other.descriptors[i]);
+        }
+    }
+
+    DescriptorAllocator::DescriptorAllocator(vk::Device device, LayoutCache *layoutCache, uint32_t frameCount)
+        : device(device), layoutCache(layoutCache), frames(frameCount)
+    {
+    }
+
+    DescriptorAllocator::~DescriptorAllocator()
+    {
+        for (auto &frame : frames)
+        {
+            for (auto pool : frame.pools)
+            {
+                device.destroyDescriptorPool(pool);
+            }
+        }
+        for (auto &pair : templates)
+        {
+            device.destroyDescriptorUpdateTemplate(pair.second.handle);
+        }
+    }
+
+    void DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+    {
+        this->frameIndex = frameIndex;
+        Frame &frame = frames[frameIndex];
+        peak.Max(frame.used);
+        frame.used = Usage();
+        frame.sets.clear();
+        cacheHits = 0;
+
+        // a frame that outgrew its pool gets a single pool sized from the peak on its next allocation
+        if (frame.pools.size() > 1)
+        {
+            for (auto pool : frame.pools)
+            {
+                device.destroyDescriptorPool(pool);
+            }
+            frame.pools.clear();
+            frame.poolSizes.clear();
+            return;
+        }
+        for (auto pool : frame.pools)
+        {
+            device.resetDescriptorPool(pool);
+        }
+    }
+
+    vk::DescriptorSet DescriptorAllocator::Get(vk::DescriptorSetLayout layout, const std::vector<DescriptorInfo> &infos)
+    {
+        const Template &updateTemplate = getTemplate(layout);
+        if (infos.size() != updateTemplate.descriptorCount)
+        {
+            throw std::runtime_error("Descriptor count does not match the set layout");
+        }
+
+        uint64_t hash = HashCombine(HashValue(static_cast<VkDescriptorSetLayout>(layout)),
+                                    HashBytes(infos.data(), infos.size() * sizeof(DescriptorInfo)));
+        Frame &frame = frames[frameIndex];
+        auto it = frame.sets.find(hash);
+        if (it != frame.sets.end())
+        {
+            const CachedSet &cached = it->second;
+            if (cached.layout != layout || memcmp(cached.infos.data(), infos.data(), infos.size() * sizeof(DescriptorInfo)) != 0)
+            {
+                throw std::runtime_error("Descriptor set hash collision");
+            }
+            cacheHits++;
+            return cached.set;
+        }
+
+        vk::DescriptorSet set = allocate(layout, updateTemplate.usage);
+        if (updateTemplate.handle)
+        {
+            device.updateDescriptorSetWithTemplate(set, updateTemplate.handle, infos.data());
+        }
+        frame.sets[hash] = {layout, infos, set};
+        return set;
+    }
+
+    DescriptorStats DescriptorAllocator::GetStats() const
+    {
+        DescriptorStats stats = {};
+        for (const auto &frame : frames)
+        {
+            stats.pools += static_cast<uint32_t>(frame.pools.size());
+        }
+        stats.sets = static_cast<uint32_t>(frames[frameIndex].sets.size());
+        stats.cacheHits = cacheHits;
+        return stats;
+    }
+
+    const DescriptorAllocator::Template &DescriptorAllocator::getTemplate(vk::DescriptorSetLayout layout)
+    {
+        auto it = templates.find(layout);
+        if (it != templates.end())
+        {
+            return it->second;
+        }
+
+        Template updateTemplate;
+        updateTemplate.usage.sets = 1;
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+        for (const auto &binding : layoutCache->GetBindings(layout))
+        {
+            uint32_t type = static_cast<uint32_t>(binding.descriptorType);
+            if (type >= DescriptorTypeCount)
+            {
+                throw std::runtime_error("Unsupported descriptor type");
+            }
+
+            // every descriptor takes one DescriptorInfo, whatever its type
+            entries.emplace_back(binding.binding, 0, binding.descriptorCount, binding.descriptorType,
+                                 updateTemplate.descriptorCount * sizeof(DescriptorInfo), sizeof(DescriptorInfo));
+            updateTemplate.descriptorCount += binding.descriptorCount;
+            updateTemplate.usage.descriptors[type] += binding.descriptorCount;
+        }
+
+        if (!entries.empty())
+        {
+            vk::DescriptorUpdateTemplateCreateInfo createInfo;
+            createInfo.setDescriptorUpdateEntries(entries)
+                .setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+                .setDescriptorSetLayout(layout);
+            updateTemplate.handle = device.createDescriptorUpdateTemplate(createInfo);
+        }
+        return templates[layout] = updateTemplate;
+    }
+
+    vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout, const Usage &usage)
+    {
+        Frame &frame = frames[frameIndex];
+        VkDescriptorSetLayout setLayout = layout;
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        // only the newest pool can have room, the older ones filled up before it was created
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            if (!frame.pools.empty())
+            {
+                allocInfo.descriptorPool = frame.pools.back();
+                VkDescriptorSet set;
+                VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+                if (result == VK_SUCCESS)
+                {
+                    frame.used.Add(usage);
+                    return set;
+                }
+                if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+                {
+                    throw std::runtime_error("Failed to allocate descriptor set");
+                }
+            }
+            addPool(frame, usage);
+        }
+        throw std::runtime_error("Failed to allocate descriptor set from a new pool");
+    }
+
+    void DescriptorAllocator::addPool(Frame &frame, const Usage &request)
+    {
+        // a whole frame's worth as seen so far, doubling while a frame keeps outgrowing its pools
+        Usage size = peak;
+        if (!frame.poolSizes.empty())
+        {
+            Usage doubled = frame.poolSizes.back();
+            doubled.Add(frame.poolSizes.back());
+            size.Max(doubled);
+        }
+        size.Max(request);
+        size.sets = std::max(size.sets, MinPoolSets);
+
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        for (uint32_t i = 0; i < DescriptorTypeCount; i++)
+        {
+            if (size.descriptors[i] > 0)
+            {
+                poolSizes.emplace_back(static_cast<vk::DescriptorType>(i), size.descriptors[i]);
+            }
+        }
+        if (poolSizes.empty())
+        {
+            // sets without descriptors still need a valid pool
+            poolSizes.emplace_back(vk::DescriptorType::eSampler, 1);
+        }
+
+        vk::DescriptorPoolCreateInfo createInfo;
+        createInfo.setMaxSets(size.sets)
+            .setPoolSizes(poolSizes);
+        frame.pools.push_back(device.createDescriptorPool(createInfo));
+        frame.poolSizes.push_back(size);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "layout_cache.hpp"
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+namespace engine
+{
+    // One descriptor as laid out for vkUpdateDescriptorSetWithTemplate. Build it through the helpers,
+    // they zero the unused bytes so equal contents hash equally
+    union DescriptorInfo
+    {
+        VkDescriptorBufferInfo buffer;
+        VkDescriptorImageInfo image;
+        VkBufferView texelBuffer;
+
+        static DescriptorInfo Buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range);
+        static DescriptorInfo Image(vk::Sampler sampler, vk::ImageView view, vk::ImageLayout layout);
+        static DescriptorInfo TexelBuffer(vk::BufferView view);
+    };
+
+    struct DescriptorStats
+    {
+        uint32_t pools;
+        // sets allocated and reused in the current frame
+        uint32_t sets;
+        uint32_t cacheHits;
+    };
+
+    // Transient descriptor sets for the frames in flight. Each frame owns its pools and resets them
+    // wholesale once its fence has signaled. Sets are cached by content for the rest of the frame, and
+    // pools are sized from the peak usage seen so far, so a steady scene settles on one pool per frame.
+    // Not thread safe, one allocator per recording thread
+    class DescriptorAllocator final
+    {
+    public:
+        DescriptorAllocator(vk::Device device, LayoutCache *layoutCache, uint32_t frameCount);
+        ~DescriptorAllocator();
+
+        DescriptorAllocator(const DescriptorAllocator &) = delete;
+        DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+
+        // Recycles the sets of frameIndex, the caller must have waited for that frame's fence
+        void BeginFrame(uint32_t frameIndex);
+
+        // infos holds one entry per descriptor of layout, in binding order with arrays expanded.
+        // The set is valid until the frame comes around again
+        vk::DescriptorSet Get(vk::DescriptorSetLayout layout, const std::vector<DescriptorInfo> &infos);
+
+        DescriptorStats GetStats() const;
+
+    private:
+        // VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT is the last core type
+        static const uint32_t DescriptorTypeCount = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1;
+
+        struct Usage
+        {
+            uint32_t sets = 0;
+            std::array<uint32_t, DescriptorTypeCount> descriptors{};
+
+            void Add(const Usage &other);
+            void Max(const Usage &other);
+        };
+
+        struct Template
+        {
+            vk::DescriptorUpdateTemplate handle;
+            uint32_t descriptorCount = 0;
+            Usage usage;
+        };
+
+        struct CachedSet
+        {
+            vk::DescriptorSetLayout layout;
+            std::vector<DescriptorInfo> infos;
+            vk::DescriptorSet set;
+        };
+
+        struct Frame
+        {
+            std::vector<vk::DescriptorPool> pools;
+            std::vector<Usage> poolSizes;
+            Usage used;
+            std::unordered_map<uint64_t, CachedSet> sets;
+        };
+
+        vk::Device device;
+        LayoutCache *layoutCache;
+        std::vector<Frame> frames;
+        uint32_t frameIndex = 0;
+        Usage peak;
+        uint32_t cacheHits = 0;
+
+        std::unordered_map<VkDescriptorSetLayout, Template> templates;
+
+        const Template &getTemplate(vk::DescriptorSetLayout layout);
+        vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, const Usage &usage);
+        void addPool(Frame &frame, const Usage &request);
+    };
+}
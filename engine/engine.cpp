@@ -1,5 +1,7 @@
 #include "engine.hpp"
 #include <string>
+#include <algorithm>
+#include <cassert>
 
 #include "SDL.h"
 
@@ -32,13 +34,17 @@ namespace engine
         const VkColorSpaceKHR requestSurfaceColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
         wd->SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(context->phyDevice, wd->Surface, requestSurfaceImageFormat, (size_t)IM_ARRAYSIZE(requestSurfaceImageFormat), requestSurfaceColorSpace);
 
-        // Select Present Mode
-#ifdef IMGUI_UNLIMITED_FRAME_RATE
-        VkPresentModeKHR present_modes[] = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR};
-#else
-        VkPresentModeKHR present_modes[] = {VK_PRESENT_MODE_FIFO_KHR};
-#endif
-        wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(context->phyDevice, wd->Surface, &present_modes[0], IM_ARRAYSIZE(present_modes));
+        // Select Present Mode, FIFO is the only one guaranteed and the fallback without vsync
+        VkPresentModeKHR unlimited_modes[] = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+        VkPresentModeKHR vsync_modes[] = {VK_PRESENT_MODE_FIFO_KHR};
+        if (vsync)
+        {
+            wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(context->phyDevice, wd->Surface, &vsync_modes[0], IM_ARRAYSIZE(vsync_modes));
+        }
+        else
+        {
+            wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(context->phyDevice, wd->Surface, &unlimited_modes[0], IM_ARRAYSIZE(unlimited_modes));
+        }
         // printf("[vulkan] Selected PresentMode = %d\n", wd->PresentMode);
 
         // Create SwapChain, RenderPass, Framebuffer, etc.
@@ -55,38 +61,108 @@ namespace engine
         this->width = width;
         this->height = height;
 
-        staticMesh = std::make_unique<StaticMesh>("assets/models/viking_room/viking_room.obj");
-        image = std::make_unique<Image>("assets/models/viking_room/viking_room.png");
-
-        // Create context
-        context = std::make_unique<Context>(extensions, createSurface);
+        initDevice(extensions, createSurface);
         InitImGui(window, width, height);
-
-        CreateObjects();
-        CreateTextureImage();
-        CreateUniformBuffers();
-        CreateDepthResources();
+        initScene();
 
         swapchain = std::make_unique<Swapchain>(context.get(), width, height, depthImageView);
 
-        // Create shader
-        shader = std::make_unique<Shader>(context.get(), "assets/shaders/shader.vert.spv", "assets/shaders/shader.frag.spv");
+        // Create renderer
+        // renderer = std::make_unique<Renderer>(context.get(), renderProcess.get(), swapchain.get());
 
-        // Create render process
+        
+    }
+
+    void Engine::InitHeadless(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+
+        initDevice({}, nullptr);
+
+        // the pass leaves the color target ready to be copied out instead of presented
         renderProcess = std::make_unique<RenderProcess>(context.get());
-        renderProcess->InitRenderPass(swapchain.get(), findDepthFormat());
-        renderProcess->InitLayout();
+        depthFormat = findDepthFormat();
+        colorFormat = OffscreenTarget::ColorFormat;
+        targetExtent = vk::Extent2D(width, height);
+        renderProcess->InitRenderPass(colorFormat, depthFormat, vk::ImageLayout::eTransferSrcOptimal);
+
+        initScene();
+    }
 
-        // Create swapchain
-        // swapchain->createFramebuffers(renderProcess.get(), width, height, depthImageView);
+    void Engine::initDevice(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface)
+    {
+        PROFILE_FUNCTION();
+        threadPool = std::make_unique<ThreadPool>();
 
-        // Create pipeline
-        renderProcess->InitPipeline(shader.get(), width, height);
+        staticMesh = std::make_unique<StaticMesh>(modelPath, threadPool.get());
 
-        // Create renderer
-        // renderer = std::make_unique<Renderer>(context.get(), renderProcess.get(), swapchain.get());
+        // Create context
+        context = std::make_unique<Context>(extensions, createSurface);
+        allocator = std::make_unique<GpuAllocator>(context->phyDevice, context->device);
+        uploads = std::make_unique<UploadManager>(context.get(), allocator.get());
 
-        
+        // Create shader, GLSL is compiled at runtime when shaderc is available.
+        // Its descriptor and pipeline layouts are reflected from the SPIR-V
+#ifdef ENGINE_SHADER_SOURCE_DIR
+        std::string shaderSourceDir = ENGINE_SHADER_SOURCE_DIR;
+#else
+        std::string shaderSourceDir = "assets/shaders";
+#endif
+        shaderLibrary = std::make_unique<ShaderLibrary>(context.get(), shaderSourceDir, "assets/shaders");
+        shader = std::make_unique<Shader>(context.get(), shaderLibrary.get(), "shader.vert", "shader.frag");
+        if (BindlessTable::IsSupported(context.get()))
+        {
+            bindlessShader = std::make_unique<Shader>(context.get(), shaderLibrary.get(), "shader.vert", "bindless.frag");
+            useBindless = true;
+        }
+        lastShaderPoll = std::chrono::steady_clock::now();
+    }
+
+    void Engine::initScene()
+    {
+        PROFILE_FUNCTION();
+        frames = std::make_unique<FrameRing>(context.get(), framesInFlight);
+
+        // decodes on the workers while the mesh buffers are uploaded
+        textureLoader = std::make_unique<TextureLoader>(context.get(), allocator.get(), uploads.get(), threadPool.get());
+        texture = textureLoader->Load(texturePath);
+
+        if (!RenderProcess::IsVertexLayoutSupported(context.get(), vertexLayout) || !staticMesh->get_settings().quantize)
+        {
+            vertexLayout = VertexLayout::Float;
+        }
+        if (shader->get_vertex_input_mask() & ~RenderProcess::GetVertexAttributeMask(vertexLayout))
+        {
+            throw std::runtime_error("Vertex shader reads attributes the mesh does not provide");
+        }
+
+        CreateObjects();
+        textureLoader->Wait(texture);
+        CreateTextureSampler();
+        if (bindlessShader)
+        {
+            bindless = std::make_unique<BindlessTable>(context.get(), frames->get_frame_count());
+            textureIndex = bindless->Add(texture->view, textureSampler);
+        }
+        // the first frame waits for the mesh and texture copies on the GPU
+        uploadTicket = uploads->Submit();
+        CreateUniformBuffers();
+        CreateDepthResources();
+        // headless, otherwise the swapchain images are the color targets
+        if (!window)
+        {
+            offscreen = std::make_unique<OffscreenTarget>(context.get(), allocator.get(), targetExtent.width, targetExtent.height, frames->get_frame_count());
+        }
+        CreateFramebuffers();
+        recorder = std::make_unique<CommandRecorder>(context.get(), threadPool.get(), frames->get_frame_count());
+        gpuProfiler = std::make_unique<GpuProfiler>(context.get(), frames->get_frame_count());
+        recorder->set_pipeline_statistics(gpuProfiler->get_statistic_flags());
+
+        // Create pipeline, the render pass was created with the ImGui window and the layout with the shader.
+        // The default variant is compiled up front, other render states compile in the background
+        pipelines = std::make_unique<PipelineRegistry>(context.get(), threadPool.get(), frames->get_frame_count());
+        pipelines->SetDefault(GetPipelineKey());
     }
 
     void Engine::InitImGui(SDL_Window *window, int width, int height)
@@ -96,6 +172,13 @@ namespace engine
         // Init ImGui
         ImGui_ImplVulkanH_Window *wd = &g_MainWindowData;
         SetupVulkanWindow(wd, context->surface, width, height);
+        colorFormat = static_cast<vk::Format>(wd->SurfaceFormat.format);
+        targetExtent = vk::Extent2D(wd->Width, wd->Height);
+
+        // the scene and ImGui share one render pass with a depth attachment
+        renderProcess = std::make_unique<RenderProcess>(context.get());
+        depthFormat = findDepthFormat();
+        renderProcess->InitRenderPass(colorFormat, depthFormat);
 
         // Setup Dear ImGui context
         IMGUI_CHECKVERSION();
@@ -117,7 +200,7 @@ namespace engine
         init_info.Device = context->device;
         init_info.QueueFamily = context->queueFamilyIndices.graphicsQueue.value();
         init_info.Queue = context->graphicsQueue;
-        init_info.PipelineCache = VK_NULL_HANDLE;
+        init_info.PipelineCache = context->pipelineCache->get();
         init_info.DescriptorPool = context->descriptorPool;
         init_info.Subpass = 0;
         init_info.MinImageCount = 2;
@@ -125,7 +208,7 @@ namespace engine
         init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
         init_info.Allocator = nullptr;
         init_info.CheckVkResultFn = check_vk_result;
-        ImGui_ImplVulkan_Init(&init_info, wd->RenderPass);
+        ImGui_ImplVulkan_Init(&init_info, renderProcess->renderPass);
 
         {
             // Use any command queue
@@ -154,6 +237,7 @@ namespace engine
 
     void Engine::RenderGui(bool &shouldClose)
     {
+        PROFILE_FUNCTION();
         static bool show_demo_window = false;
         static bool show_another_window = false;
         static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
@@ -164,17 +248,19 @@ namespace engine
             SDL_GetWindowSize(window, &width, &height);
             if (width > 0 && height > 0)
             {
+                // only size dependent resources are rebuilt, viewport and scissor are dynamic pipeline state
+                context->device.waitIdle();
+                DestroyFramebuffers();
+                DestroyDepthResources();
+
                 ImGui_ImplVulkan_SetMinImageCount(2);
                 ImGui_ImplVulkanH_CreateOrResizeWindow(context->instance, context->phyDevice, context->device, &g_MainWindowData, context->queueFamilyIndices.graphicsQueue.value(), nullptr, width, height, 2);
                 g_MainWindowData.FrameIndex = 0;
                 g_SwapChainRebuild = false;
+                targetExtent = vk::Extent2D(g_MainWindowData.Width, g_MainWindowData.Height);
 
-                // reset view port
-                renderProcess.reset();
-                renderProcess = std::make_unique<RenderProcess>(context.get());
-                renderProcess->InitRenderPass(swapchain.get(), findDepthFormat());
-                renderProcess->InitLayout();
-                renderProcess->InitPipeline(shader.get(), width, height);
+                CreateDepthResources();
+                CreateFramebuffers();
             }
         }
 
@@ -211,6 +297,75 @@ namespace engine
 
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
 
+            auto lods = staticMesh->get_lods();
+            ImGui::SliderFloat3("camera", (float *)&cameraPosition, -20.0f, 20.0f);
+            ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.1f, 16.0f);
+            ImGui::SliderInt("force LOD", &forcedLod, -1, static_cast<int>(lods.size()) - 1);
+            ImGui::Text("LOD %u: %u triangles", currentLod, lods[currentLod].indexCount / 3);
+            ImGui::Checkbox("meshlet culling", &meshletCulling);
+            if (drawMeshlets)
+            {
+                ImGui::Text("meshlets %u / %u visible, %u draws", visibleMeshletCount,
+                            static_cast<uint32_t>(staticMesh->get_meshlets().size()), static_cast<uint32_t>(meshletDraws.size()));
+            }
+
+            GpuAllocatorStats memoryStats = allocator->GetStats();
+            ImGui::Text("GPU memory %.1f / %.1f MB, %u blocks, %u dedicated, %u allocations",
+                        memoryStats.usedBytes / (1024.0f * 1024.0f), memoryStats.reservedBytes / (1024.0f * 1024.0f),
+                        memoryStats.blockCount, memoryStats.dedicatedCount, memoryStats.allocationCount);
+            ImGui::Text("GPU memory fragmentation %.1f%%", memoryStats.fragmentation * 100.0f);
+            ImGui::Text("texture %ux%u, %u mips, %s", texture->width, texture->height,
+                        texture->mipLevels, vk::to_string(texture->format).c_str());
+            PipelineCacheStats cacheStats = context->pipelineCache->GetStats();
+            ImGui::Text("pipeline cache %s: %u hits, %u misses, %u unknown, %.1f ms creating", cacheStats.loaded ? "warm" : "cold",
+                        cacheStats.hits, cacheStats.misses, cacheStats.unknown, cacheStats.createMilliseconds);
+            bool backfaceCulling = renderState.cullMode == vk::CullModeFlagBits::eBack;
+            if (ImGui::Checkbox("backface culling", &backfaceCulling))
+            {
+                renderState.cullMode = backfaceCulling ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone;
+            }
+            ImGui::SameLine();
+            ImGui::Checkbox("alpha blend", &renderState.blend);
+            bool skipCompiling = pipelineFallback == PipelineFallback::Skip;
+            ImGui::SameLine();
+            if (ImGui::Checkbox("skip compiling variants", &skipCompiling))
+            {
+                pipelineFallback = skipCompiling ? PipelineFallback::Skip : PipelineFallback::Default;
+            }
+            if (bindless)
+            {
+                ImGui::Checkbox("bindless textures", &useBindless);
+                ImGui::SameLine();
+                ImGui::Text("%u / %u slots", bindless->get_count(), bindless->get_capacity());
+            }
+            ImGui::Text("%u frames in flight, waited %.2f ms for the GPU", frames->get_frame_count(), frames->get_wait_milliseconds());
+            ImGui::Text("scene recorded in %u secondaries on %u slots", recorder->get_last_chunk_count(), recorder->get_slot_count());
+#ifdef ENGINE_PROFILE
+            bool cpuZones = CpuProfiler::IsEnabled();
+            if (ImGui::Checkbox("CPU zones", &cpuZones))
+            {
+                CpuProfiler::SetEnabled(cpuZones);
+            }
+            ImGui::SameLine();
+            if (CpuProfiler::IsCapturing())
+            {
+                ImGui::Text("capturing CPU trace...");
+            }
+            else if (ImGui::Button("capture CPU trace"))
+            {
+                CpuProfiler::Capture(CpuTraceFrames, "cpu_trace.json");
+            }
+#endif
+            ImGui::Text("pipelines %u ready, %u compiling", pipelines->get_pipeline_count(), pipelines->get_compiling_count());
+            ImGui::Text("shaders %u compiled, %u from cache", shaderLibrary->get_compile_count(), shaderLibrary->get_cache_hits());
+            DescriptorStats descriptorStats = descriptors->GetStats();
+            ImGui::Text("descriptor sets %u this frame, %u reused, %u pools", descriptorStats.sets,
+                        descriptorStats.cacheHits, descriptorStats.pools);
+            ImGui::Text("layouts %u set, %u pipeline", context->layoutCache->get_set_layout_count(),
+                        context->layoutCache->get_pipeline_layout_count());
+            ImGui::Text("staging ring %.1f / %.1f MB in flight",
+                        uploads->get_staging_used() / (1024.0f * 1024.0f), uploads->get_staging_size() / (1024.0f * 1024.0f));
+
             if (ImGui::Button("Exit"))
                 shouldClose = true;
 
@@ -227,8 +382,13 @@ namespace engine
             ImGui::End();
         }
 
+        RenderProfiler();
+
         // Rendering
-        ImGui::Render();
+        {
+            PROFILE_ZONE("ImGui::Render");
+            ImGui::Render();
+        }
         ImDrawData *draw_data = ImGui::GetDrawData();
         const bool is_minimized = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
         if (!is_minimized)
@@ -242,117 +402,307 @@ namespace engine
         }
     }
 
+    void Engine::RenderProfiler()
+    {
+        ImGui::Begin("GPU profiler");
+        if (!gpuProfiler->is_supported())
+        {
+            ImGui::Text("timestamp queries are not supported on this device");
+            ImGui::End();
+            return;
+        }
+
+        ImGui::Checkbox("enabled", &gpuProfiler->enabled);
+        if (gpuProfiler->has_statistics())
+        {
+            ImGui::SameLine();
+            ImGui::Checkbox("pipeline statistics", &gpuProfiler->statistics);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("export CSV"))
+        {
+            try
+            {
+                gpuProfiler->WriteCsv("gpu_profile.csv");
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+        ImGui::Text("results are %u frames late, averaged over %u frames", frames->get_frame_count(), GpuProfiler::AverageFrames);
+
+        if (ImGui::BeginTable("scopes", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+        {
+            ImGui::TableSetupColumn("scope");
+            ImGui::TableSetupColumn("ms");
+            ImGui::TableSetupColumn("avg");
+            ImGui::TableSetupColumn("max");
+            ImGui::TableSetupColumn("vertices / clipped");
+            ImGui::TableSetupColumn("fragments");
+            ImGui::TableHeadersRow();
+            for (const auto &scope : gpuProfiler->get_scopes())
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::SetCursorPosX(ImGui::GetCursorPosX() + scope.depth * ImGui::GetStyle().IndentSpacing);
+                ImGui::TextUnformatted(scope.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.milliseconds);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.averageMilliseconds);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.maxMilliseconds);
+                ImGui::TableNextColumn();
+                if (scope.hasStatistics)
+                {
+                    ImGui::Text("%llu / %llu", (unsigned long long)scope.vertexInvocations, (unsigned long long)scope.clippingPrimitives);
+                }
+                ImGui::TableNextColumn();
+                if (scope.hasStatistics)
+                {
+                    ImGui::Text("%llu", (unsigned long long)scope.fragmentInvocations);
+                }
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+
     void Engine::FrameRender(ImGui_ImplVulkanH_Window *wd, ImDrawData *draw_data)
     {
+        PROFILE_FUNCTION();
         VkResult err;
 
-        VkSemaphore image_acquired_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
-        VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
+        // blocks until the GPU has finished the frame recorded frames-in-flight frames ago, and nowhere else
+        FrameContext &frame = frames->Begin();
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+        gpuProfiler->BeginFrame(frame.index);
+
+        // wd->FrameIndex is the swapchain image, it only selects the framebuffer and present semaphore
+        VkSemaphore image_acquired_semaphore = frame.imageAcquired;
         err = vkAcquireNextImageKHR(context->device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex);
-        if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR)
+        g_FrameAcquired = false;
+        if (err == VK_ERROR_OUT_OF_DATE_KHR)
         {
             g_SwapChainRebuild = true;
             return;
         }
-        check_vk_result(err);
-
-        UpdateUniformBuffer(wd->FrameIndex);
-
-        ImGui_ImplVulkanH_Frame *fd = &wd->Frames[wd->FrameIndex];
+        if (err == VK_SUBOPTIMAL_KHR)
+        {
+            // the image is still valid, it is rendered and presented and the swapchain rebuilt after that
+            g_SwapChainRebuild = true;
+        }
+        else
         {
-            err = vkWaitForFences(context->device, 1, &fd->Fence, VK_TRUE, UINT64_MAX); // wait indefinitely instead of periodically checking
             check_vk_result(err);
+        }
+        g_FrameAcquired = true;
+        VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->FrameIndex].RenderCompleteSemaphore;
 
-            err = vkResetFences(context->device, 1, &fd->Fence);
+        // the GPU is done with everything this frame slot owns
+        UpdateUniformBuffer(frame.index);
+        recorder->BeginFrame(frame.index);
+
+        {
+            VkCommandBufferBeginInfo info = {};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            err = vkBeginCommandBuffer(commandBuffer, &info);
             check_vk_result(err);
         }
+        // timestamps cannot go between the secondaries, so the pass scope wraps the whole render pass
+        uint32_t frameScope = gpuProfiler->BeginScope(commandBuffer, "frame");
+        uint32_t passScope = gpuProfiler->BeginScope(commandBuffer, "render pass", true);
+        BeginRenderPass(commandBuffer, framebuffers[wd->FrameIndex], wd->ClearValue.color);
+
+        std::vector<vk::CommandBuffer> secondaries = RecordScene(framebuffers[wd->FrameIndex]);
+
+        // Record dear imgui primitives into its own secondary, a subpass cannot mix inline and secondary contents
+        vk::CommandBuffer imguiCommandBuffer = recorder->BeginSecondary(renderProcess->renderPass, 0, framebuffers[wd->FrameIndex]);
+        uint32_t imguiScope = gpuProfiler->BeginScope(imguiCommandBuffer, "imgui");
+        ImGui_ImplVulkan_RenderDrawData(draw_data, imguiCommandBuffer);
+        gpuProfiler->EndScope(imguiCommandBuffer, imguiScope);
+        imguiCommandBuffer.end();
+        secondaries.push_back(imguiCommandBuffer);
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), (VkCommandBuffer *)secondaries.data());
+
+        // Submit command buffer
+        vkCmdEndRenderPass(commandBuffer);
+        gpuProfiler->EndScope(commandBuffer, passScope);
+        gpuProfiler->EndScope(commandBuffer, frameScope);
+
+        SubmitFrame(frame, image_acquired_semaphore, render_complete_semaphore);
+    }
+
+    void Engine::RenderOffscreen()
+    {
+        PROFILE_FUNCTION();
+        // the readback of the frame that last used this slot is complete once its fence has signaled
+        FrameContext &frame = frames->Begin();
+        offscreen->Collect(frame.index, onReadback);
+        gpuProfiler->BeginFrame(frame.index);
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+        UpdateUniformBuffer(frame.index);
+        recorder->BeginFrame(frame.index);
+
         {
-            err = vkResetCommandPool(context->device, fd->CommandPool, 0);
-            check_vk_result(err);
             VkCommandBufferBeginInfo info = {};
             info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
             info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
-            check_vk_result(err);
+            check_vk_result(vkBeginCommandBuffer(commandBuffer, &info));
         }
+        uint32_t frameScope = gpuProfiler->BeginScope(commandBuffer, "frame");
+        uint32_t passScope = gpuProfiler->BeginScope(commandBuffer, "render pass", true);
+        VkClearColorValue clearColor = {{0.45f, 0.55f, 0.60f, 1.00f}};
+        BeginRenderPass(commandBuffer, framebuffers[frame.index], clearColor);
+        std::vector<vk::CommandBuffer> secondaries = RecordScene(framebuffers[frame.index]);
+        if (!secondaries.empty())
         {
-            VkRenderPassBeginInfo info = {};
-            info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            info.renderPass = wd->RenderPass;
-            info.framebuffer = fd->Framebuffer;
-            info.renderArea.extent.width = wd->Width;
-            info.renderArea.extent.height = wd->Height;
-            info.clearValueCount = 1;
-            info.pClearValues = &wd->ClearValue;
-            vkCmdBeginRenderPass(fd->CommandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), (VkCommandBuffer *)secondaries.data());
         }
+        vkCmdEndRenderPass(commandBuffer);
+        gpuProfiler->EndScope(commandBuffer, passScope);
 
-        vkCmdBindPipeline(fd->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderProcess->pipeline);
-        vkCmdBindDescriptorSets(fd->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderProcess->layout, 0, 1, (VkDescriptorSet *)context->descriptorSets.data(), 0, nullptr);
-        VkBuffer vertexBuffers[] = {(VkBuffer)vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(fd->CommandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(fd->CommandBuffer, (VkBuffer)indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(fd->CommandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+        if (onReadback)
+        {
+            uint32_t readbackScope = gpuProfiler->BeginScope(commandBuffer, "readback");
+            offscreen->RecordReadback(commandBuffer, frame.index, frameNumber);
+            gpuProfiler->EndScope(commandBuffer, readbackScope);
+        }
+        gpuProfiler->EndScope(commandBuffer, frameScope);
+        frameNumber++;
 
-        // Record dear imgui primitives into command buffer
-        ImGui_ImplVulkan_RenderDrawData(draw_data, fd->CommandBuffer);
+        SubmitFrame(frame, VK_NULL_HANDLE, VK_NULL_HANDLE);
+    }
 
-        // Submit command buffer
-        vkCmdEndRenderPass(fd->CommandBuffer);
-
-
-        // {
-        //     VkRenderPassBeginInfo info = {};
-        //     info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        //     info.renderPass = renderProcess->renderPass;
-        //     info.framebuffer = fd->Framebuffer;
-        //     info.renderArea.extent.width = wd->Width;
-        //     info.renderArea.extent.height = wd->Height;
-        //     std::array<VkClearValue, 2> clearValues = {};
-        //     clearValues[0].color = wd->ClearValue.color;
-        //     clearValues[1].depthStencil = {1.0f, 0};
-        //     info.clearValueCount = 2;
-        //     info.pClearValues = clearValues.data();
-        //     vkCmdBeginRenderPass(fd->CommandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
-        // }
-
-        // vkCmdBindPipeline(fd->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderProcess->pipeline);
-        // vkCmdBindDescriptorSets(fd->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderProcess->layout, 0, 1, (VkDescriptorSet *)context->descriptorSets.data(), 0, nullptr);
-        // VkBuffer vertexBuffers[] = {(VkBuffer)vertexBuffer};
-        // VkDeviceSize offsets[] = {0};
-        // vkCmdBindVertexBuffers(fd->CommandBuffer, 0, 1, vertexBuffers, offsets);
-        // vkCmdBindIndexBuffer(fd->CommandBuffer, (VkBuffer)indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        // vkCmdDrawIndexed(fd->CommandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-        // // Submit command buffer
-        // vkCmdEndRenderPass(fd->CommandBuffer);
+    void Engine::BeginRenderPass(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, const VkClearColorValue &clearColor)
+    {
+        VkClearValue clearValues[2] = {};
+        clearValues[0].color = clearColor;
+        clearValues[1].depthStencil = {1.0f, 0};
+
+        VkRenderPassBeginInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass = renderProcess->renderPass;
+        info.framebuffer = framebuffer;
+        info.renderArea.extent = targetExtent;
+        info.clearValueCount = 2;
+        info.pClearValues = clearValues;
+        vkCmdBeginRenderPass(commandBuffer, &info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    }
 
-        
+    std::vector<vk::CommandBuffer> Engine::RecordScene(vk::Framebuffer framebuffer)
+    {
+        PROFILE_FUNCTION();
+        // a variant that is still compiling gets the fallback instead of stalling the frame
+        VkPipeline pipeline = pipelines->Request(GetPipelineKey(), pipelineFallback);
+        if (pipeline == VK_NULL_HANDLE)
         {
-            VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            VkSubmitInfo info = {};
-            info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            info.waitSemaphoreCount = 1;
-            info.pWaitSemaphores = &image_acquired_semaphore;
-            info.pWaitDstStageMask = &wait_stage;
-            info.commandBufferCount = 1;
-            info.pCommandBuffers = &fd->CommandBuffer;
-            info.signalSemaphoreCount = 1;
-            info.pSignalSemaphores = &render_complete_semaphore;
-
-            err = vkEndCommandBuffer(fd->CommandBuffer);
-            check_vk_result(err);
-            err = vkQueueSubmit(context->graphicsQueue, 1, &info, fd->Fence);
-            check_vk_result(err);
+            return {};
         }
+
+        // descriptor sets come from the main thread, workers only record
+        const Shader *activeShader = GetActiveShader();
+        VkPipelineLayout pipelineLayout = activeShader->get_pipeline_layout();
+        VkDescriptorSet descriptorSets[2] = {GetMaterialSet(), useBindless ? bindless->get_set() : VK_NULL_HANDLE};
+        uint32_t descriptorSetCount = useBindless ? 2 : 1;
+        VkShaderStageFlags pushStages = useBindless ? static_cast<VkShaderStageFlags>(activeShader->get_push_constants().front().stageFlags) : 0;
+        const MeshLod &lod = staticMesh->get_lods()[currentLod];
+        uint32_t drawCount = drawMeshlets ? static_cast<uint32_t>(meshletDraws.size()) : 1;
+        VkViewport viewport = {0.0f, 0.0f, (float)targetExtent.width, (float)targetExtent.height, 0.0f, 1.0f};
+        VkRect2D scissor = {{0, 0}, targetExtent};
+
+        // every secondary starts without state, so each chunk binds everything before its draws
+        return recorder->Record(drawCount, renderProcess->renderPass, 0, framebuffer,
+                                [&](vk::CommandBuffer secondary, uint32_t begin, uint32_t end)
+                                {
+                                    PROFILE_ZONE("record chunk");
+                                    VkCommandBuffer commandBuffer = secondary;
+                                    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                                    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                                    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+                                    // the bindless table is set 1 and stays bound, draws only push their texture index
+                                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, descriptorSetCount, descriptorSets, 1, &uniformOffset);
+                                    if (useBindless)
+                                    {
+                                        vkCmdPushConstants(commandBuffer, pipelineLayout, pushStages, 0, sizeof(textureIndex), &textureIndex);
+                                    }
+                                    VkBuffer vertexBuffers[] = {(VkBuffer)vertexBuffer};
+                                    VkDeviceSize offsets[] = {0};
+                                    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+                                    vkCmdBindIndexBuffer(commandBuffer, (VkBuffer)indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                                    if (!drawMeshlets)
+                                    {
+                                        vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.indexOffset, 0, 0);
+                                        return;
+                                    }
+                                    for (uint32_t i = begin; i < end; i++)
+                                    {
+                                        const auto &draw = meshletDraws[i];
+                                        vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+                                    }
+                                });
+    }
+
+    void Engine::SubmitFrame(FrameContext &frame, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore)
+    {
+        PROFILE_FUNCTION();
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+        // wait for pending uploads on the GPU, the timeline value is ignored for the binary acquire semaphore
+        VkSemaphore wait_semaphores[2];
+        VkPipelineStageFlags wait_stages[2];
+        uint64_t wait_values[2];
+        uint32_t wait_count = 0;
+        if (waitSemaphore != VK_NULL_HANDLE)
+        {
+            wait_semaphores[wait_count] = waitSemaphore;
+            wait_stages[wait_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            wait_values[wait_count++] = 0;
+        }
+        if (!uploads->IsComplete(uploadTicket))
+        {
+            wait_semaphores[wait_count] = uploads->get_semaphore();
+            wait_stages[wait_count] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+            wait_values[wait_count++] = uploadTicket;
+        }
+
+        VkTimelineSemaphoreSubmitInfo timeline_info = {};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = wait_count;
+        timeline_info.pWaitSemaphoreValues = wait_values;
+
+        VkSubmitInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        info.pNext = &timeline_info;
+        info.waitSemaphoreCount = wait_count;
+        info.pWaitSemaphores = wait_semaphores;
+        info.pWaitDstStageMask = wait_stages;
+        info.commandBufferCount = 1;
+        info.pCommandBuffers = &commandBuffer;
+        info.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+        info.pSignalSemaphores = &signalSemaphore;
+
+        VkResult err = vkEndCommandBuffer(commandBuffer);
+        check_vk_result(err);
+        // reset only now, a frame that bailed out on an out of date swapchain leaves its fence signaled
+        VkFence fence = frame.fence;
+        err = vkResetFences(context->device, 1, &fence);
+        check_vk_result(err);
+        err = vkQueueSubmit(context->graphicsQueue, 1, &info, fence);
+        check_vk_result(err);
     }
 
     void Engine::FramePresent(ImGui_ImplVulkanH_Window *wd)
     {
-        if (g_SwapChainRebuild)
+        PROFILE_FUNCTION();
+        if (!g_FrameAcquired)
             return;
-        VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
+        g_FrameAcquired = false;
+        // one per swapchain image, a frame slot's semaphore could still be waited on by an earlier present
+        VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->FrameIndex].RenderCompleteSemaphore;
         VkPresentInfoKHR info = {};
         info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         info.waitSemaphoreCount = 1;
@@ -367,32 +717,115 @@ namespace engine
             return;
         }
         check_vk_result(err);
-        wd->SemaphoreIndex = (wd->SemaphoreIndex + 1) % wd->ImageCount; // Now we can use the next set of semaphores
     }
 
     void Engine::Quit()
     {
         context->device.waitIdle();
 
-        DestroyTextureImage();
+        // the last frames in flight have not been handed out yet
+        if (offscreen)
+        {
+            offscreen->Flush(onReadback);
+        }
+
+        uploads.reset();
+        textureLoader.reset();
+        recorder.reset();
+        gpuProfiler.reset();
+        frames.reset();
+        bindless.reset();
+        DestroyTextureSampler();
         DestroyUniformBuffers();
         DestroyObjects();
-        DestroyDepthResources();
 
-        ImGui_ImplVulkan_Shutdown();
-        ImGui_ImplSDL2_Shutdown();
-        CleanupVulkanWindow();
+        DestroyFramebuffers();
+        if (window)
+        {
+            ImGui_ImplVulkan_Shutdown();
+            ImGui_ImplSDL2_Shutdown();
+            CleanupVulkanWindow();
+        }
+        offscreen.reset();
 
         renderer.reset();
+        pipelines.reset();
         renderProcess.reset();
         shader.reset();
+        bindlessShader.reset();
+        shaderLibrary.reset();
         swapchain.reset();
+        DestroyDepthResources();
+        allocator.reset();
         context.reset();
+        threadPool.reset();
     }
 
     void Engine::Tick(bool &shouldClose)
     {
-        RenderGui(shouldClose);
+        {
+            PROFILE_ZONE("Tick");
+            advanceAnimation();
+            // textures requested at runtime are queued here and become resident a few frames later
+            UploadTicket textureTicket = textureLoader->Update();
+            uploadTicket = std::max(uploadTicket, textureTicket);
+            if (uploads->has_gpu_timing())
+            {
+                gpuProfiler->Report("uploads", uploads->TakeGpuMilliseconds());
+            }
+            PollShaders();
+            RenderGui(shouldClose);
+        }
+        // after the zone above, so a capture ending here still holds the whole frame
+        PROFILE_FRAME();
+    }
+
+    void Engine::TickHeadless()
+    {
+        {
+            PROFILE_ZONE("TickHeadless");
+            advanceAnimation();
+            UploadTicket textureTicket = textureLoader->Update();
+            uploadTicket = std::max(uploadTicket, textureTicket);
+            if (uploads->has_gpu_timing())
+            {
+                gpuProfiler->Report("uploads", uploads->TakeGpuMilliseconds());
+            }
+            PollShaders();
+            RenderOffscreen();
+        }
+        PROFILE_FRAME();
+    }
+
+    void Engine::advanceAnimation()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (fixedTimestep > 0.0f)
+        {
+            animationTime += fixedTimestep;
+        }
+        else if (lastTick != std::chrono::steady_clock::time_point())
+        {
+            animationTime += std::chrono::duration<float>(now - lastTick).count();
+        }
+        lastTick = now;
+    }
+
+    void Engine::PollShaders()
+    {
+        PROFILE_FUNCTION();
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastShaderPoll < std::chrono::milliseconds(250))
+        {
+            return;
+        }
+        lastShaderPoll = now;
+
+        // the frame keeps drawing with the old pipelines until the rebuilt ones are ready
+        for (auto &replaced : shaderLibrary->Poll())
+        {
+            pipelines->ReplaceModule(replaced.first, replaced.second);
+        }
     }
 
     void Engine::CreateObjects()
@@ -414,32 +847,19 @@ namespace engine
         //     {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
         // };
 
-        vertices = staticMesh->get_one_vertices();
-
-        vk::DeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingBufferMemory;
-
-        createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
-                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                     stagingBuffer, stagingBufferMemory);
-
-        void *verticesData;
-        if (context->device.mapMemory(stagingBufferMemory, 0, bufferSize, vk::MemoryMapFlags(), &verticesData) != vk::Result::eSuccess)
+        const void *vertices = staticMesh->get_vertices().data();
+        vk::DeviceSize bufferSize = staticMesh->get_vertices().size_bytes();
+        if (vertexLayout == VertexLayout::Packed)
         {
-            throw std::runtime_error("Failed to map vertex buffer memory");
+            vertices = staticMesh->get_packed_vertices().data();
+            bufferSize = staticMesh->get_packed_vertices().size_bytes();
         }
-        memcpy(verticesData, vertices.data(), (size_t)bufferSize);
-        context->device.unmapMemory(stagingBufferMemory);
 
         createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
                      vk::MemoryPropertyFlagBits::eDeviceLocal, vertexBuffer, vertexBufferMemory);
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-        context->device.destroyBuffer(stagingBuffer);
-        context->device.freeMemory(stagingBufferMemory);
+        uploads->CopyToBuffer(vertices, bufferSize, vertexBuffer, 0,
+                              vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead);
 
         CreateIndexBuffer();
     }
@@ -447,8 +867,7 @@ namespace engine
     void Engine::DestroyObjects()
     {
         DestroyIndexBuffer();
-        context->device.destroyBuffer(vertexBuffer);
-        context->device.freeMemory(vertexBufferMemory);
+        destroyBuffer(vertexBuffer, vertexBufferMemory);
     }
 
     void Engine::CreateIndexBuffer()
@@ -471,165 +890,241 @@ namespace engine
         //     3, 6, 2,
         // };
 
-        indices = staticMesh->get_one_indices();
-
-        vk::DeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingBufferMemory;
+        auto indices = staticMesh->get_indices();
 
-        createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
-                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                     stagingBuffer, stagingBufferMemory);
-
-        void *indexData;
-        if (context->device.mapMemory(stagingBufferMemory, 0, bufferSize, vk::MemoryMapFlags(), &indexData) != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("Failed to map index buffer memory");
-        }
-        memcpy(indexData, indices.data(), (size_t)bufferSize);
-        context->device.unmapMemory(stagingBufferMemory);
+        vk::DeviceSize bufferSize = indices.size_bytes();
 
         createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
                      vk::MemoryPropertyFlagBits::eDeviceLocal,
                      indexBuffer, indexBufferMemory);
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-        context->device.destroyBuffer(stagingBuffer);
-        context->device.freeMemory(stagingBufferMemory);
+        uploads->CopyToBuffer(indices.data(), bufferSize, indexBuffer, 0,
+                              vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead);
     }
 
     void Engine::DestroyIndexBuffer()
     {
-        context->device.destroyBuffer(indexBuffer);
-        context->device.freeMemory(indexBufferMemory);
+        destroyBuffer(indexBuffer, indexBufferMemory);
     }
 
     void Engine::CreateUniformBuffers()
     {
-        vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
+        uniformRing = std::make_unique<UniformRing>(context->phyDevice, context->device, allocator.get(), frames->get_frame_count());
+
+        descriptors = std::make_unique<DescriptorAllocator>(context->device, context->layoutCache.get(), frames->get_frame_count());
+    }
+
+    void Engine::DestroyUniformBuffers()
+    {
+        descriptors.reset();
+        uniformRing.reset();
+    }
 
-        auto *wd = &g_MainWindowData;
+    void Engine::UpdateUniformBuffer(uint32_t frameIndex)
+    {
+        PROFILE_FUNCTION();
+        UniformBufferObject ubo = {};
+        modelMatrix = glm::rotate(glm::mat4(1.0f), animationTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        currentLod = SelectLod();
 
-        uniformBuffers.resize(wd->ImageCount);
-        uniformBuffersMemory.resize(wd->ImageCount);
+        ubo.model = modelMatrix;
+        if (vertexLayout == VertexLayout::Packed)
+        {
+            // dequantize unorm positions back to model space
+            assert(staticMesh->get_settings().quantize);
+            const QuantizationInfo &quantization = staticMesh->get_quantization();
+            ubo.model = glm::scale(glm::translate(ubo.model, quantization.offset), quantization.scale);
+        }
+        // ubo.model = glm::mat4(1.0f);
+        // ubo.view = glm::lookAt(glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        ubo.view = glm::lookAt(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        ubo.proj = glm::perspective(cameraFov, width / (float)height, 0.1f, 1000.0f);
+        CullMeshlets(ubo.proj * ubo.view);
+
+        uniformRing->BeginFrame(frameIndex);
+        uniformOffset = uniformRing->Push(ubo);
+        descriptors->BeginFrame(frameIndex);
+        if (bindless)
+        {
+            bindless->BeginFrame();
+        }
+        pipelines->BeginFrame();
+        // modules are only read while compiling, pipelines already created do not need them
+        if (pipelines->get_compiling_count() == 0)
+        {
+            shaderLibrary->ReleaseRetired();
+        }
+    }
 
-        for (size_t i = 0; i < wd->ImageCount; i++)
+    const Shader *Engine::GetActiveShader() const
+    {
+        return useBindless ? bindlessShader.get() : shader.get();
+    }
+
+    vk::DescriptorSet Engine::GetMaterialSet()
+    {
+        // the uniform ring is bound once as a whole, frames only differ in their dynamic offset
+        if (useBindless)
         {
-            vk::BufferCreateInfo bufferInfo;
-            bufferInfo.size = bufferSize;
-            bufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
-            bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+            return descriptors->Get(bindlessShader->get_set_layout(0),
+                                    {DescriptorInfo::Buffer(uniformRing->get_buffer(), 0, sizeof(UniformBufferObject))});
+        }
+        return descriptors->Get(shader->get_set_layout(0),
+                                {DescriptorInfo::Buffer(uniformRing->get_buffer(), 0, sizeof(UniformBufferObject)),
+                                 DescriptorInfo::Image(textureSampler, texture->view, vk::ImageLayout::eShaderReadOnlyOptimal)});
+    }
 
-            if (context->device.createBuffer(&bufferInfo, nullptr, &uniformBuffers[i]) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to create uniform buffer");
-            }
+    uint32_t Engine::SelectLod() const
+    {
+        auto lods = staticMesh->get_lods();
+        uint32_t lastLod = static_cast<uint32_t>(lods.size()) - 1;
+        if (forcedLod >= 0)
+        {
+            return std::min(static_cast<uint32_t>(forcedLod), lastLod);
+        }
+
+        const MeshBounds &bounds = staticMesh->get_bounds();
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(bounds.center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                               std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
 
-            vk::MemoryRequirements memRequirements;
-            context->device.getBufferMemoryRequirements(uniformBuffers[i], &memRequirements);
+        float distance = glm::length(center - cameraPosition) - bounds.radius * scale;
+        if (distance <= 0.0f)
+        {
+            return 0;
+        }
 
-            vk::MemoryAllocateInfo allocInfo;
-            allocInfo.allocationSize = memRequirements.size;
-            allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        // pixels covered by one model unit at that distance
+        float pixelsPerUnit = height / (2.0f * std::tan(cameraFov * 0.5f) * distance);
 
-            if (context->device.allocateMemory(&allocInfo, nullptr, &uniformBuffersMemory[i]) != vk::Result::eSuccess)
+        uint32_t lod = 0;
+        for (uint32_t i = 1; i <= lastLod; i++)
+        {
+            if (lods[i].error * scale * pixelsPerUnit <= lodPixelError)
             {
-                throw std::runtime_error("Failed to allocate uniform buffer memory");
+                lod = i;
             }
-
-            context->device.bindBufferMemory(uniformBuffers[i], uniformBuffersMemory[i], 0);
         }
-
-        context->createDescriptorSets(uniformBuffers, wd->ImageCount, textureImageView, textureSampler);
+        return lod;
     }
 
-    void Engine::DestroyUniformBuffers()
+    void Engine::CullMeshlets(const glm::mat4 &viewProj)
     {
-        auto *wd = &g_MainWindowData;
-
-        for (size_t i = 0; i < wd->ImageCount; i++)
+        PROFILE_FUNCTION();
+        meshletDraws.clear();
+        visibleMeshletCount = 0;
+
+        auto meshlets = staticMesh->get_meshlets();
+        auto bounds = staticMesh->get_meshlet_bounds();
+        drawMeshlets = meshletCulling && currentLod == 0 && !meshlets.empty();
+        if (!drawMeshlets)
         {
-            context->device.destroyBuffer(uniformBuffers[i]);
-            context->device.freeMemory(uniformBuffersMemory[i]);
+            return;
         }
-    }
 
-    void Engine::UpdateUniformBuffer(uint32_t currentImage)
-    {
-        static auto startTime = std::chrono::high_resolution_clock::now();
+        // frustum planes and eye in model space, so the cooked bounds are tested untransformed
+        glm::mat4 clip = viewProj * modelMatrix;
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+        {
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        }
+        glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]};
+        for (auto &plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        glm::vec3 eye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        for (size_t i = 0; i < meshlets.size(); i++)
+        {
+            const MeshletBounds &meshletBounds = bounds[i];
 
-        UniformBufferObject ubo = {};
-        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        // ubo.model = glm::mat4(1.0f);
-        // ubo.view = glm::lookAt(glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ubo.view = glm::lookAt(glm::vec3(0.0f, 1.8f, 1.8f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ubo.proj = glm::perspective(glm::radians(60.0f), width / (float)height, 0.1f, 1000.0f);
-        
+            bool visible = !IsMeshletBackfacing(meshletBounds, eye);
+            for (int p = 0; p < 6 && visible; p++)
+            {
+                visible = glm::dot(glm::vec3(planes[p]), meshletBounds.center) + planes[p].w >= -meshletBounds.radius;
+            }
+            if (!visible)
+            {
+                continue;
+            }
 
-        void *uboData;
-        if (context->device.mapMemory(uniformBuffersMemory[currentImage], 0, sizeof(ubo), vk::MemoryMapFlags(), &uboData) != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("Failed to map uniform buffer memory");
+            visibleMeshletCount++;
+            uint32_t firstIndex = meshlets[i].triangleOffset * 3;
+            uint32_t indexCount = meshlets[i].triangleCount * 3;
+            if (!meshletDraws.empty() && meshletDraws.back().firstIndex + meshletDraws.back().indexCount == firstIndex)
+            {
+                meshletDraws.back().indexCount += indexCount;
+                continue;
+            }
+            meshletDraws.push_back(vk::DrawIndexedIndirectCommand(indexCount, 1, firstIndex, 0, 0));
         }
-        memcpy(uboData, &ubo, sizeof(ubo));
-        context->device.unmapMemory(uniformBuffersMemory[currentImage]);
     }
 
     void Engine::CreateDepthResources()
     {
-        vk::Format depthFormat = findDepthFormat();
-        createImage(width, height, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, depthImage, depthImageMemory);
+        // sized like the swapchain, which the surface may have clamped away from width / height
+        createImage(targetExtent.width, targetExtent.height, 1, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, depthImage, depthImageMemory);
+        // no explicit transition, the render pass starts the depth attachment from an undefined layout
         depthImageView = createImageView(depthImage, depthFormat, vk::ImageAspectFlagBits::eDepth);
-        transitionImageLayout(depthImage, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
     }
 
 
     void Engine::DestroyDepthResources()
     {
-
+        context->device.destroyImageView(depthImageView);
+        context->device.destroyImage(depthImage);
+        allocator->Free(depthImageMemory);
     }
 
-    void Engine::CreateTextureImage()
+    PipelineKey Engine::GetPipelineKey() const
     {
-        vk::Buffer stagingBuffer;
-        vk::DeviceMemory stagingBufferMemory;
-
-        vk::DeviceSize textureSize = image->get_device_size();
+        const Shader *activeShader = GetActiveShader();
+        PipelineKey key;
+        key.vertexShader = activeShader->getVertexModule();
+        key.fragmentShader = activeShader->getFragmentModule();
+        key.vertexLayout = vertexLayout;
+        key.state = renderState;
+        key.vertexInputMask = activeShader->get_vertex_input_mask();
+        key.layout = activeShader->get_pipeline_layout();
+        key.renderPass = renderProcess->renderPass;
+        key.colorFormat = colorFormat;
+        key.depthFormat = depthFormat;
+        return key;
+    }
 
-        createBuffer(textureSize, vk::BufferUsageFlagBits::eTransferSrc,
-                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                     stagingBuffer, stagingBufferMemory);
+    void Engine::CreateFramebuffers()
+    {
+        ImGui_ImplVulkanH_Window *wd = &g_MainWindowData;
 
-        void *textureData;
-        if (context->device.mapMemory(stagingBufferMemory, 0, textureSize, vk::MemoryMapFlags(), &textureData) != vk::Result::eSuccess)
+        uint32_t count = offscreen ? frames->get_frame_count() : wd->ImageCount;
+        framebuffers.resize(count);
+        for (uint32_t i = 0; i < count; i++)
         {
-            throw std::runtime_error("Failed to map texture buffer memory");
+            vk::ImageView colorView = offscreen ? offscreen->get_view(i) : vk::ImageView(wd->Frames[i].BackbufferView);
+            std::array<vk::ImageView, 2> attachments = {colorView, depthImageView};
+            vk::FramebufferCreateInfo framebufferInfo;
+            framebufferInfo.setRenderPass(renderProcess->renderPass)
+                .setAttachments(attachments)
+                .setWidth(targetExtent.width)
+                .setHeight(targetExtent.height)
+                .setLayers(1);
+
+            framebuffers[i] = context->device.createFramebuffer(framebufferInfo);
         }
-        memcpy(textureData, image->get_pixels(), (size_t)textureSize);
-        context->device.unmapMemory(stagingBufferMemory);
-
-        createImage(image->get_width(), image->get_height(), vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal,
-                    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                    vk::MemoryPropertyFlagBits::eDeviceLocal, textureImage, textureImageMemory);
-
-        transitionImageLayout(textureImage,
-                              vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined,
-                              vk::ImageLayout::eTransferDstOptimal);
-        copyBufferToImage(stagingBuffer, textureImage, image->get_width(), image->get_height());
-        transitionImageLayout(textureImage,
-                              vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferDstOptimal,
-                              vk::ImageLayout::eShaderReadOnlyOptimal);
-
-        context->device.destroyBuffer(stagingBuffer);
-        context->device.freeMemory(stagingBufferMemory);
+    }
 
-        // create image view
-        textureImageView = createImageView(textureImage, vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor);
+    void Engine::DestroyFramebuffers()
+    {
+        for (auto &framebuffer : framebuffers)
+        {
+            context->device.destroyFramebuffer(framebuffer);
+        }
+        framebuffers.clear();
+    }
 
+    void Engine::CreateTextureSampler()
+    {
         // create sampler
         vk::SamplerCreateInfo samplerInfo;
         samplerInfo.magFilter = vk::Filter::eLinear;
@@ -646,7 +1141,7 @@ namespace engine
         samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
         samplerInfo.mipLodBias = 0.0f;
         samplerInfo.minLod = 0.0f;
-        samplerInfo.maxLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(texture->mipLevels);
 
         if (context->device.createSampler(&samplerInfo, nullptr, &textureSampler) != vk::Result::eSuccess)
         {
@@ -654,11 +1149,8 @@ namespace engine
         }
     }
 
-    void Engine::DestroyTextureImage()
+    void Engine::DestroyTextureSampler()
     {
         context->device.destroySampler(textureSampler);
-        context->device.destroyImageView(textureImageView);
-        context->device.destroyImage(textureImage);
-        context->device.freeMemory(textureImageMemory);
     }
 }
@@ -20,21 +20,79 @@
 
 #include "StaticMesh.hpp"
 #include "Image.hpp"
+#include "gpu_allocator.hpp"
+#include "uniform_ring.hpp"
+#include "descriptor_allocator.hpp"
+#include "bindless_table.hpp"
+#include "command_recorder.hpp"
+#include "frame_ring.hpp"
+#include "offscreen_target.hpp"
+#include "gpu_profiler.hpp"
+#include "cpu_profiler.hpp"
+#include "upload_manager.hpp"
+#include "texture_loader.hpp"
 
 namespace engine
 {
     class Engine final
     {
     public:
+        std::unique_ptr<ThreadPool> threadPool;
         std::unique_ptr<Context> context;
+        std::unique_ptr<GpuAllocator> allocator;
+        std::unique_ptr<UploadManager> uploads;
+        // the frame submit waits for this on the GPU until it has completed
+        UploadTicket uploadTicket = 0;
+        std::unique_ptr<ShaderLibrary> shaderLibrary;
         std::unique_ptr<Shader> shader;
+        // textures are indexed from one descriptor array when the device supports descriptor indexing
+        std::unique_ptr<Shader> bindlessShader;
+        std::unique_ptr<BindlessTable> bindless;
+        bool useBindless = false;
+        uint32_t textureIndex = 0;
+        const Shader *GetActiveShader() const;
+        // shader sources are checked for changes at this interval
+        std::chrono::steady_clock::time_point lastShaderPoll;
+        void PollShaders();
         std::unique_ptr<Swapchain> swapchain;
         std::unique_ptr<RenderProcess> renderProcess;
+        std::unique_ptr<PipelineRegistry> pipelines;
+        // the material state of the scene draw, changing it requests another pipeline variant
+        RenderState renderState;
+        PipelineFallback pipelineFallback = PipelineFallback::Default;
+        PipelineKey GetPipelineKey() const;
         std::unique_ptr<Renderer> renderer;
-
-        SDL_Window *window;
+        // per-frame resources are indexed by the frame slot, not the swapchain image
+        std::unique_ptr<FrameRing> frames;
+        uint32_t framesInFlight = FrameRing::DefaultFrameCount;
+        // scene draws are recorded into secondaries on the thread pool
+        std::unique_ptr<CommandRecorder> recorder;
+        // what the scene renders into, the swapchain images or the offscreen target
+        vk::Format colorFormat;
+        vk::Extent2D targetExtent;
+        std::vector<vk::CommandBuffer> RecordScene(vk::Framebuffer framebuffer);
+        // frames written to cpu_trace.json by the capture button
+        static constexpr uint32_t CpuTraceFrames = 120;
+        // timestamp scopes of the frame and the upload time of the copy queue, frames-in-flight frames late
+        std::unique_ptr<GpuProfiler> gpuProfiler;
+        void RenderProfiler();
+        void BeginRenderPass(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, const VkClearColorValue &clearColor);
+        // waits for the pending uploads, and for waitSemaphore before the color writes when it is not null
+        void SubmitFrame(FrameContext &frame, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore);
+
+        // headless only: no surface, swapchain or ImGui. Frames are read back while onReadback is set,
+        // it receives each one once the frame slot comes around again, in frame order
+        std::unique_ptr<OffscreenTarget> offscreen;
+        ReadbackFunction onReadback;
+        uint64_t frameNumber = 0;
+        void RenderOffscreen();
+
+        // null when headless
+        SDL_Window *window = nullptr;
         ImGui_ImplVulkanH_Window g_MainWindowData;
         bool g_SwapChainRebuild = false;
+        // set by FrameRender when it submitted to an acquired image, a suboptimal one is still presented before the rebuild
+        bool g_FrameAcquired = false;
 
         void SetupVulkanWindow(ImGui_ImplVulkanH_Window *wd, VkSurfaceKHR surface, int width, int height);
         void CleanupVulkanWindow();
@@ -46,21 +104,10 @@ namespace engine
         // find memory type
         auto findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
         {
-            vk::PhysicalDeviceMemoryProperties memProperties;
-            context->phyDevice.getMemoryProperties(&memProperties);
-
-            for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-            {
-                if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-                {
-                    return i;
-                }
-            }
-
-            throw std::runtime_error("Failed to find suitable memory type");
+            return allocator->FindMemoryType(typeFilter, properties);
         };
 
-        void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer &buffer, vk::DeviceMemory &bufferMemory)
+        void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer &buffer, GpuAllocation &bufferMemory)
         {
             vk::BufferCreateInfo bufferInfo = {};
             bufferInfo.size = size;
@@ -72,89 +119,28 @@ namespace engine
                 throw std::runtime_error("Failed to create buffer");
             }
 
-            vk::MemoryRequirements memRequirements;
-            context->device.getBufferMemoryRequirements(buffer, &memRequirements);
-
-            vk::MemoryAllocateInfo allocInfo = {};
-            allocInfo.allocationSize = memRequirements.size;
-            allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-            if (context->device.allocateMemory(&allocInfo, nullptr, &bufferMemory) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to allocate buffer memory");
-            }
-
-            context->device.bindBufferMemory(buffer, bufferMemory, 0);
+            bufferMemory = allocator->AllocateBuffer(buffer, properties);
         }
 
-        vk::CommandBuffer beginSingleTimeCommands(vk::CommandPool commandPool)
+        void destroyBuffer(vk::Buffer &buffer, GpuAllocation &bufferMemory)
         {
-            vk::CommandBufferAllocateInfo allocInfo = {};
-            allocInfo.level = vk::CommandBufferLevel::ePrimary;
-            allocInfo.commandPool = commandPool;
-            allocInfo.commandBufferCount = 1;
-
-            vk::CommandBuffer commandBuffer;
-            if (context->device.allocateCommandBuffers(&allocInfo, &commandBuffer) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to allocate command buffer");
-            }
-
-            vk::CommandBufferBeginInfo beginInfo = {};
-            beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-            if (commandBuffer.begin(&beginInfo) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to begin recording command buffer");
-            }
-
-            return commandBuffer;
-        }
-
-        void endSingleTimeCommands(vk::CommandBuffer commandBuffer, vk::CommandPool commandPool)
-        {
-            commandBuffer.end();
-
-            vk::SubmitInfo submitInfo = {};
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
-
-            if (context->graphicsQueue.submit(1, &submitInfo, nullptr) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to submit copy buffer command");
-            }
-            context->graphicsQueue.waitIdle();
-
-            context->device.freeCommandBuffers(commandPool, 1, &commandBuffer);
-        }
-
-        void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
-        {
-            vk::CommandPool commandPool;
-            vk::CommandPoolCreateInfo poolInfo = {};
-            poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
-
-            if (context->device.createCommandPool(&poolInfo, nullptr, &commandPool) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to create command pool");
-            }
-
-            vk::CommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-
-            vk::BufferCopy copyRegion = {};
-            copyRegion.size = size;
-            commandBuffer.copyBuffer(srcBuffer, dstBuffer, 1, &copyRegion);
-
-            endSingleTimeCommands(commandBuffer, commandPool);
-
-            context->device.destroyCommandPool(commandPool, nullptr);
+            context->device.destroyBuffer(buffer);
+            allocator->Free(bufferMemory);
+            buffer = nullptr;
         }
 
+        vk::Format depthFormat;
         vk::Image depthImage;
-        vk::DeviceMemory depthImageMemory;
+        GpuAllocation depthImageMemory;
         vk::ImageView depthImageView;
         void CreateDepthResources();
         void DestroyDepthResources();
+
+        // swapchain image + depth, in the render pass shared with ImGui. Rebuilt on resize.
+        // Headless, one per frame in flight over the offscreen target
+        std::vector<vk::Framebuffer> framebuffers;
+        void CreateFramebuffers();
+        void DestroyFramebuffers();
         vk::Format findSupportedFormat(const std::vector<vk::Format> &candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features)
         {
             for (vk::Format format : candidates)
@@ -186,42 +172,74 @@ namespace engine
             return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
         }
 
-        std::vector<Vertex> vertices;
+        // Packed halves the vertex stream, Float is the fallback when the formats lack vertex buffer support
+        VertexLayout vertexLayout = VertexLayout::Packed;
         vk::Buffer vertexBuffer;
-        vk::DeviceMemory vertexBufferMemory;
+        GpuAllocation vertexBufferMemory;
         void CreateObjects();
         void DestroyObjects();
 
-        std::vector<uint32_t> indices;
         vk::Buffer indexBuffer;
-        vk::DeviceMemory indexBufferMemory;
+        GpuAllocation indexBufferMemory;
         void CreateIndexBuffer();
         void DestroyIndexBuffer();
 
-        std::vector<vk::Buffer> uniformBuffers;
-        std::vector<vk::DeviceMemory> uniformBuffersMemory;
+        // per-frame constants live in one persistently mapped ring, uniformOffset is this frame's dynamic offset
+        std::unique_ptr<UniformRing> uniformRing;
+        uint32_t uniformOffset = 0;
+        // descriptor sets are rebuilt per frame in flight from content hashed infos
+        std::unique_ptr<DescriptorAllocator> descriptors;
+        vk::DescriptorSet GetMaterialSet();
         void CreateUniformBuffers();
         void DestroyUniformBuffers();
-        void UpdateUniformBuffer(uint32_t currentImage);
-
-        vk::Image textureImage;
-        vk::ImageView textureImageView;
+        void UpdateUniformBuffer(uint32_t frameIndex);
+
+        // set before Init
+        std::string modelPath = "assets/models/viking_room/viking_room.obj";
+        std::string texturePath = "assets/models/viking_room/viking_room.png";
+        // FIFO when set, otherwise the swapchain presents immediately where the surface allows it
+        bool vsync = true;
+
+        // the model spins with animationTime, which advances by fixedTimestep per tick,
+        // or by the wall clock time between ticks when it is 0
+        float animationTime = 0.0f;
+        float fixedTimestep = 0.0f;
+
+        glm::vec3 cameraPosition = glm::vec3(0.0f, 1.8f, 1.8f);
+        float cameraFov = glm::radians(60.0f);
+        glm::mat4 modelMatrix = glm::mat4(1.0f);
+
+        // picks the coarsest LOD whose projected error stays below lodPixelError
+        float lodPixelError = 1.0f;
+        int forcedLod = -1;
+        uint32_t currentLod = 0;
+        uint32_t SelectLod() const;
+
+        // lod 0 only: meshlets failing the frustum or normal cone test are skipped,
+        // the survivors are merged into contiguous index ranges and drawn one call per range
+        bool meshletCulling = true;
+        bool drawMeshlets = false;
+        uint32_t visibleMeshletCount = 0;
+        std::vector<vk::DrawIndexedIndirectCommand> meshletDraws;
+        void CullMeshlets(const glm::mat4 &viewProj);
+
+        std::unique_ptr<TextureLoader> textureLoader;
+        TextureHandle texture;
         vk::Sampler textureSampler;
-        vk::DeviceMemory textureImageMemory;
-        void CreateTextureImage();
-        void DestroyTextureImage();
-        void createImage(uint32_t width, uint32_t height,
+        void CreateTextureSampler();
+        void DestroyTextureSampler();
+        void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
                          vk::Format format, vk::ImageTiling tiling,
                          vk::ImageUsageFlags usage,
                          vk::MemoryPropertyFlags properties,
-                         vk::Image &image, vk::DeviceMemory &imageMemory)
+                         vk::Image &image, GpuAllocation &imageMemory)
         {
             vk::ImageCreateInfo imageInfo = {};
             imageInfo.imageType = vk::ImageType::e2D;
             imageInfo.extent.width = width;
             imageInfo.extent.height = height;
             imageInfo.extent.depth = 1;
-            imageInfo.mipLevels = 1;
+            imageInfo.mipLevels = mipLevels;
             imageInfo.arrayLayers = 1;
             imageInfo.format = format;
             imageInfo.tiling = tiling;
@@ -235,133 +253,9 @@ namespace engine
                 throw std::runtime_error("Failed to create image");
             }
 
-            vk::MemoryRequirements memRequirements;
-            context->device.getImageMemoryRequirements(image, &memRequirements);
-
-            vk::MemoryAllocateInfo allocInfo = {};
-            allocInfo.allocationSize = memRequirements.size;
-            allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-            if (context->device.allocateMemory(&allocInfo, nullptr, &imageMemory) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to allocate image memory");
-            }
-
-            context->device.bindImageMemory(image, imageMemory, 0);
+            imageMemory = allocator->AllocateImage(image, tiling, properties);
         }
-        void transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
-        {
-            vk::CommandPool commandPool;
-            vk::CommandPoolCreateInfo poolInfo = {};
-            poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
-
-            if (context->device.createCommandPool(&poolInfo, nullptr, &commandPool) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to create command pool");
-            }
-
-            vk::CommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-
-            vk::ImageMemoryBarrier barrier = {};
-            barrier.oldLayout = oldLayout;
-            barrier.newLayout = newLayout;
-            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.image = image;
-            if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-            {
-                barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-
-                if (hasStencilComponent(format))
-                {
-                    barrier.subresourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
-                }
-            }
-            else
-            {
-                barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-            }
-            barrier.subresourceRange.baseMipLevel = 0;
-            barrier.subresourceRange.levelCount = 1;
-            barrier.subresourceRange.baseArrayLayer = 0;
-            barrier.subresourceRange.layerCount = 1;
-
-            vk::PipelineStageFlags sourceStage;
-            vk::PipelineStageFlags destinationStage;
-
-            if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal)
-            {
-                barrier.srcAccessMask = vk::AccessFlags();
-                barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-                sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-                destinationStage = vk::PipelineStageFlagBits::eTransfer;
-            }
-            else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal)
-            {
-                barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-                barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-                sourceStage = vk::PipelineStageFlagBits::eTransfer;
-                destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-            }
-            else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-            {
-                barrier.srcAccessMask = vk::AccessFlags();
-                barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-                sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-                destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-            }
-            else
-            {
-                throw std::invalid_argument("Unsupported layout transition");
-            }
-
-            commandBuffer.pipelineBarrier(
-                sourceStage, destinationStage,
-                vk::DependencyFlags(),
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
-
-            endSingleTimeCommands(commandBuffer, commandPool);
-
-            context->device.destroyCommandPool(commandPool, nullptr);
-        }
-        void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
-        {
-            vk::CommandPool commandPool;
-            vk::CommandPoolCreateInfo poolInfo = {};
-            poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
-
-            if (context->device.createCommandPool(&poolInfo, nullptr, &commandPool) != vk::Result::eSuccess)
-            {
-                throw std::runtime_error("Failed to create command pool");
-            }
-
-            vk::CommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-
-            vk::BufferImageCopy region = {};
-            region.bufferOffset = 0;
-            region.bufferRowLength = 0;
-            region.bufferImageHeight = 0;
-
-            region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-            region.imageSubresource.mipLevel = 0;
-            region.imageSubresource.baseArrayLayer = 0;
-            region.imageSubresource.layerCount = 1;
-
-            region.imageOffset = vk::Offset3D{0, 0, 0};
-            region.imageExtent = vk::Extent3D{width, height, 1};
-
-            commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-
-            endSingleTimeCommands(commandBuffer, commandPool);
-
-            context->device.destroyCommandPool(commandPool, nullptr);
-        }
-        vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags)
+        vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels = 1)
         {
             vk::ImageViewCreateInfo viewInfo = {};
             viewInfo.image = image;
@@ -369,7 +263,7 @@ namespace engine
             viewInfo.format = format;
             viewInfo.subresourceRange.aspectMask = aspectFlags;
             viewInfo.subresourceRange.baseMipLevel = 0;
-            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.levelCount = mipLevels;
             viewInfo.subresourceRange.baseArrayLayer = 0;
             viewInfo.subresourceRange.layerCount = 1;
 
@@ -387,13 +281,22 @@ namespace engine
         ~Engine() = default;
 
         void Init(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface, int width, int height, SDL_Window *window);
+        // Renders width x height offscreen on any device, software ones included
+        void InitHeadless(int width, int height);
         void Quit();
         void Tick(bool &shouldClose);
+        void TickHeadless();
 
     private:
         int width;
         int height;
         std::unique_ptr<StaticMesh> staticMesh;
-        std::unique_ptr<Image> image;
+
+        // shared by both modes, before and after the render pass exists
+        void initDevice(const std::vector<const char *> &extensions, CreateSurfaceFunction createSurface);
+        void initScene();
+
+        std::chrono::steady_clock::time_point lastTick;
+        void advanceAnimation();
     };
 }
\ No newline at end of file
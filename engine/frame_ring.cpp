@@ -0,0 +1,69 @@
+#include "frame_ring.hpp"
+#include "cpu_profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace engine
+{
+    FrameRing::FrameRing(const Context *context, uint32_t frameCount)
+        : context(context)
+    {
+        frames.resize(std::clamp(frameCount, 1u, MaxFrameCount));
+        for (uint32_t i = 0; i < frames.size(); i++)
+        {
+            FrameContext &frame = frames[i];
+            frame.index = i;
+
+            vk::CommandPoolCreateInfo poolInfo;
+            poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+                .setQueueFamilyIndex(context->queueFamilyIndices.graphicsQueue.value());
+            frame.commandPool = context->device.createCommandPool(poolInfo);
+
+            vk::CommandBufferAllocateInfo allocInfo;
+            allocInfo.setCommandPool(frame.commandPool)
+                .setLevel(vk::CommandBufferLevel::ePrimary)
+                .setCommandBufferCount(1);
+            frame.commandBuffer = context->device.allocateCommandBuffers(allocInfo).front();
+
+            // signaled, so the first Begin() of every frame does not wait
+            vk::FenceCreateInfo fenceInfo;
+            fenceInfo.setFlags(vk::FenceCreateFlagBits::eSignaled);
+            frame.fence = context->device.createFence(fenceInfo);
+            frame.imageAcquired = context->device.createSemaphore(vk::SemaphoreCreateInfo());
+        }
+
+        // the first Begin() lands on frame 0
+        current = static_cast<uint32_t>(frames.size()) - 1;
+    }
+
+    FrameRing::~FrameRing()
+    {
+        for (auto &frame : frames)
+        {
+            context->device.destroySemaphore(frame.imageAcquired);
+            context->device.destroyFence(frame.fence);
+            context->device.destroyCommandPool(frame.commandPool);
+        }
+    }
+
+    FrameContext &FrameRing::Begin()
+    {
+        current = (current + 1) % frames.size();
+        FrameContext &frame = frames[current];
+
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            PROFILE_ZONE("wait for frame fence");
+            if (context->device.waitForFences(frame.fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed to wait for frame fence");
+            }
+        }
+        waitMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        context->device.resetCommandPool(frame.commandPool);
+        return frame;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "context.hpp"
+
+#include <vector>
+
+namespace engine
+{
+    // What the CPU needs to record one frame while up to frameCount - 1 earlier frames are still on the GPU.
+    // index also selects this frame's slice of the uniform ring, descriptor pools and recording pools
+    struct FrameContext
+    {
+        uint32_t index = 0;
+        vk::CommandPool commandPool;
+        vk::CommandBuffer commandBuffer;
+        // signaled by the frame's submit, reset only right before the next submit
+        vk::Fence fence;
+        vk::Semaphore imageAcquired;
+    };
+
+    // The frames in flight, independent of how many images the swapchain has. Begin() waits for the
+    // frame recorded frameCount frames ago, which is the only point the CPU blocks on the GPU.
+    class FrameRing final
+    {
+    public:
+        static constexpr uint32_t DefaultFrameCount = 2;
+        static constexpr uint32_t MaxFrameCount = 3;
+
+        FrameRing(const Context *context, uint32_t frameCount = DefaultFrameCount);
+        ~FrameRing();
+
+        FrameRing(const FrameRing &) = delete;
+        FrameRing &operator=(const FrameRing &) = delete;
+
+        // Advances to the next frame, waits until the GPU is done with it and resets its command pool
+        FrameContext &Begin();
+
+        uint32_t get_frame_count() const { return static_cast<uint32_t>(frames.size()); }
+        // how long the last Begin() blocked, non zero means the GPU is the bottleneck
+        float get_wait_milliseconds() const { return waitMilliseconds; }
+
+    private:
+        const Context *context;
+        std::vector<FrameContext> frames;
+        uint32_t current = 0;
+        float waitMilliseconds = 0.0f;
+    };
+}
@@ -0,0 +1,332 @@
+#include "gpu_allocator.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+        {
+            return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+        }
+
+        // heaps up to this size get blocks of an eighth of the heap
+        constexpr vk::DeviceSize SmallHeapSize = 1ull << 30;
+    }
+
+    GpuAllocator::GpuAllocator(vk::PhysicalDevice phyDevice, vk::Device device, vk::DeviceSize blockSize)
+        : device(device), blockSize(blockSize)
+    {
+        memoryProperties = phyDevice.getMemoryProperties();
+
+        auto limits = phyDevice.getProperties().limits;
+        bufferImageGranularity = limits.bufferImageGranularity;
+        maxAllocationCount = limits.maxMemoryAllocationCount;
+
+        pools.resize(memoryProperties.memoryTypeCount * 2);
+    }
+
+    GpuAllocator::~GpuAllocator()
+    {
+        for (auto &pool : pools)
+        {
+            for (auto &block : pool.blocks)
+            {
+                if (block.mapped)
+                {
+                    device.unmapMemory(block.memory);
+                }
+                device.freeMemory(block.memory);
+            }
+        }
+
+        if (dedicatedCount > 0)
+        {
+            std::cerr << "GpuAllocator: " << dedicatedCount << " dedicated allocations leaked" << std::endl;
+        }
+    }
+
+    uint32_t GpuAllocator::FindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const
+    {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+
+    GpuAllocation GpuAllocator::AllocateBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags properties)
+    {
+        vk::BufferMemoryRequirementsInfo2 info;
+        info.setBuffer(buffer);
+        auto chain = device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(info);
+        const auto &requirements = chain.get<vk::MemoryRequirements2>().memoryRequirements;
+        const auto &dedicated = chain.get<vk::MemoryDedicatedRequirements>();
+
+        vk::MemoryDedicatedAllocateInfo dedicatedInfo;
+        dedicatedInfo.setBuffer(buffer);
+
+        GpuAllocation allocation = allocate(requirements, properties, false,
+                                            dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation, dedicatedInfo);
+        device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+        return allocation;
+    }
+
+    GpuAllocation GpuAllocator::AllocateImage(vk::Image image, vk::ImageTiling tiling, vk::MemoryPropertyFlags properties)
+    {
+        vk::ImageMemoryRequirementsInfo2 info;
+        info.setImage(image);
+        auto chain = device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(info);
+        const auto &requirements = chain.get<vk::MemoryRequirements2>().memoryRequirements;
+        const auto &dedicated = chain.get<vk::MemoryDedicatedRequirements>();
+
+        vk::MemoryDedicatedAllocateInfo dedicatedInfo;
+        dedicatedInfo.setImage(image);
+
+        GpuAllocation allocation = allocate(requirements, properties, tiling == vk::ImageTiling::eOptimal,
+                                            dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation, dedicatedInfo);
+        device.bindImageMemory(image, allocation.memory, allocation.offset);
+        return allocation;
+    }
+
+    GpuAllocation GpuAllocator::allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties,
+                                         bool optimal, bool preferDedicated, const vk::MemoryDedicatedAllocateInfo &dedicatedInfo)
+    {
+        uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        vk::DeviceSize poolBlockSize = blockSizeFor(memoryType);
+        if (preferDedicated || requirements.size > poolBlockSize / 2)
+        {
+            return allocateDedicated(requirements, memoryType, dedicatedInfo);
+        }
+
+        // linear and optimal resources may only share a block when the granularity cannot make them alias
+        uint32_t poolIndex = memoryType * 2 + (optimal && bufferImageGranularity > 1 ? 1 : 0);
+        Pool &pool = pools[poolIndex];
+
+        GpuAllocation allocation;
+        allocation.memoryType = memoryType;
+        allocation.pool = poolIndex;
+
+        for (auto &block : pool.blocks)
+        {
+            if (allocateFromBlock(block, requirements, allocation))
+            {
+                return allocation;
+            }
+        }
+
+        Block block;
+        void *mapped = nullptr;
+        block.size = poolBlockSize;
+        block.memory = allocateMemory(block.size, memoryType, nullptr, &mapped);
+        block.mapped = static_cast<uint8_t *>(mapped);
+        block.freeRanges.push_back({0, block.size});
+        pool.blocks.push_back(std::move(block));
+
+        if (!allocateFromBlock(pool.blocks.back(), requirements, allocation))
+        {
+            throw std::runtime_error("Failed to sub-allocate from a fresh memory block");
+        }
+        return allocation;
+    }
+
+    GpuAllocation GpuAllocator::allocateDedicated(const vk::MemoryRequirements &requirements, uint32_t memoryType,
+                                                  const vk::MemoryDedicatedAllocateInfo &dedicatedInfo)
+    {
+        GpuAllocation allocation;
+        allocation.memory = allocateMemory(requirements.size, memoryType, &dedicatedInfo, &allocation.mapped);
+        allocation.size = requirements.size;
+        allocation.memoryType = memoryType;
+        allocation.dedicated = true;
+
+        dedicatedCount++;
+        dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    bool GpuAllocator::allocateFromBlock(Block &block, const vk::MemoryRequirements &requirements, GpuAllocation &allocation)
+    {
+        for (size_t i = 0; i < block.freeRanges.size(); i++)
+        {
+            FreeRange range = block.freeRanges[i];
+            vk::DeviceSize offset = alignUp(range.offset, requirements.alignment);
+            if (offset + requirements.size > range.offset + range.size)
+            {
+                continue;
+            }
+
+            // keep the alignment padding and the tail as free ranges
+            vk::DeviceSize end = offset + requirements.size;
+            block.freeRanges.erase(block.freeRanges.begin() + i);
+            if (end < range.offset + range.size)
+            {
+                block.freeRanges.insert(block.freeRanges.begin() + i, {end, range.offset + range.size - end});
+            }
+            if (offset > range.offset)
+            {
+                block.freeRanges.insert(block.freeRanges.begin() + i, {range.offset, offset - range.offset});
+            }
+
+            block.used += requirements.size;
+            block.allocationCount++;
+
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.size = requirements.size;
+            allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+            return true;
+        }
+
+        return false;
+    }
+
+    void GpuAllocator::Free(GpuAllocation &allocation)
+    {
+        if (!allocation)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (allocation.dedicated)
+        {
+            if (allocation.mapped)
+            {
+                device.unmapMemory(allocation.memory);
+            }
+            device.freeMemory(allocation.memory);
+            dedicatedCount--;
+            dedicatedBytes -= allocation.size;
+            deviceMemoryCount--;
+            allocation = {};
+            return;
+        }
+
+        Pool &pool = pools[allocation.pool];
+        auto blockIt = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&](const Block &block)
+                                    { return block.memory == allocation.memory; });
+        if (blockIt == pool.blocks.end())
+        {
+            throw std::runtime_error("Freeing an allocation that does not belong to this allocator");
+        }
+
+        Block &block = *blockIt;
+        auto &ranges = block.freeRanges;
+        auto next = std::lower_bound(ranges.begin(), ranges.end(), allocation.offset, [](const FreeRange &range, vk::DeviceSize offset)
+                                     { return range.offset < offset; });
+        next = ranges.insert(next, {allocation.offset, allocation.size});
+
+        // merge with the following and the preceding range
+        if (next + 1 != ranges.end() && next->offset + next->size == (next + 1)->offset)
+        {
+            next->size += (next + 1)->size;
+            ranges.erase(next + 1);
+        }
+        if (next != ranges.begin() && (next - 1)->offset + (next - 1)->size == next->offset)
+        {
+            (next - 1)->size += next->size;
+            ranges.erase(next);
+        }
+
+        block.used -= allocation.size;
+        block.allocationCount--;
+        allocation = {};
+
+        // keep one empty block per pool around so that alternating create/destroy does not thrash the driver
+        if (block.allocationCount == 0)
+        {
+            size_t emptyBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const Block &other)
+                                               { return other.allocationCount == 0; });
+            if (emptyBlocks > 1)
+            {
+                if (block.mapped)
+                {
+                    device.unmapMemory(block.memory);
+                }
+                device.freeMemory(block.memory);
+                deviceMemoryCount--;
+                pool.blocks.erase(blockIt);
+            }
+        }
+    }
+
+    vk::DeviceMemory GpuAllocator::allocateMemory(vk::DeviceSize size, uint32_t memoryType, const void *next, void **mapped)
+    {
+        if (deviceMemoryCount >= maxAllocationCount)
+        {
+            throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+        }
+
+        vk::MemoryAllocateInfo allocInfo = {};
+        allocInfo.pNext = next;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        vk::DeviceMemory memory;
+        if (device.allocateMemory(&allocInfo, nullptr, &memory) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to allocate device memory");
+        }
+        deviceMemoryCount++;
+
+        *mapped = nullptr;
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        {
+            if (device.mapMemory(memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), mapped) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed to map device memory");
+            }
+        }
+
+        return memory;
+    }
+
+    vk::DeviceSize GpuAllocator::blockSizeFor(uint32_t memoryType) const
+    {
+        // small heaps (e.g. the 256MB host visible device local window) get smaller blocks
+        vk::DeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        return heapSize <= SmallHeapSize ? std::min(blockSize, heapSize / 8) : blockSize;
+    }
+
+    GpuAllocatorStats GpuAllocator::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        GpuAllocatorStats stats;
+        vk::DeviceSize freeBytes = 0;
+        for (auto &pool : pools)
+        {
+            for (auto &block : pool.blocks)
+            {
+                stats.blockCount++;
+                stats.allocationCount += block.allocationCount;
+                stats.reservedBytes += block.size;
+                stats.usedBytes += block.used;
+                for (auto &range : block.freeRanges)
+                {
+                    freeBytes += range.size;
+                    stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+                }
+            }
+        }
+
+        stats.dedicatedCount = dedicatedCount;
+        stats.allocationCount += dedicatedCount;
+        stats.reservedBytes += dedicatedBytes;
+        stats.usedBytes += dedicatedBytes;
+        stats.deviceMemoryCount = deviceMemoryCount;
+        stats.fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes) : 0.0f;
+        return stats;
+    }
+}
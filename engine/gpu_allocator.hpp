@@ -0,0 +1,102 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace engine
+{
+    // A range of device memory, either carved out of a shared block or owning a dedicated VkDeviceMemory
+    struct GpuAllocation
+    {
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        void *mapped = nullptr; // host visible memory stays mapped for its whole lifetime
+        uint32_t memoryType = 0;
+        uint32_t pool = 0;
+        bool dedicated = false;
+
+        explicit operator bool() const { return static_cast<bool>(memory); }
+    };
+
+    struct GpuAllocatorStats
+    {
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0;
+        uint32_t deviceMemoryCount = 0; // live vkAllocateMemory objects, bounded by maxMemoryAllocationCount
+        vk::DeviceSize reservedBytes = 0;
+        vk::DeviceSize usedBytes = 0;
+        vk::DeviceSize largestFreeRange = 0;
+        float fragmentation = 0.0f; // 1 - largest free range / total free bytes inside blocks
+    };
+
+    // Sub-allocates buffers and images from large per-memory-type blocks.
+    // Linear and optimal resources get separate blocks when bufferImageGranularity requires it,
+    // large or driver-preferred resources get a dedicated allocation.
+    class GpuAllocator final
+    {
+    public:
+        GpuAllocator(vk::PhysicalDevice phyDevice, vk::Device device, vk::DeviceSize blockSize = 64ull << 20);
+        ~GpuAllocator();
+
+        GpuAllocator(const GpuAllocator &) = delete;
+        GpuAllocator &operator=(const GpuAllocator &) = delete;
+
+        // Allocates memory for the resource and binds it
+        GpuAllocation AllocateBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags properties);
+        GpuAllocation AllocateImage(vk::Image image, vk::ImageTiling tiling, vk::MemoryPropertyFlags properties);
+        void Free(GpuAllocation &allocation);
+
+        // Uses the memory properties cached at construction
+        uint32_t FindMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const;
+
+        GpuAllocatorStats GetStats() const;
+        const vk::PhysicalDeviceMemoryProperties &get_memory_properties() const { return memoryProperties; }
+
+    private:
+        struct FreeRange
+        {
+            vk::DeviceSize offset;
+            vk::DeviceSize size;
+        };
+
+        struct Block
+        {
+            vk::DeviceMemory memory;
+            vk::DeviceSize size = 0;
+            vk::DeviceSize used = 0;
+            uint8_t *mapped = nullptr;
+            std::vector<FreeRange> freeRanges; // sorted by offset, neighbours always merged
+            uint32_t allocationCount = 0;
+        };
+
+        // one pool per memory type and resource kind
+        struct Pool
+        {
+            std::vector<Block> blocks;
+        };
+
+        vk::Device device;
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
+        vk::DeviceSize blockSize;
+        vk::DeviceSize bufferImageGranularity;
+        uint32_t maxAllocationCount;
+
+        mutable std::mutex mutex;
+        std::vector<Pool> pools;
+        uint32_t dedicatedCount = 0;
+        vk::DeviceSize dedicatedBytes = 0;
+        uint32_t deviceMemoryCount = 0;
+
+        GpuAllocation allocate(const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties,
+                               bool optimal, bool preferDedicated, const vk::MemoryDedicatedAllocateInfo &dedicatedInfo);
+        GpuAllocation allocateDedicated(const vk::MemoryRequirements &requirements, uint32_t memoryType,
+                                        const vk::MemoryDedicatedAllocateInfo &dedicatedInfo);
+        bool allocateFromBlock(Block &block, const vk::MemoryRequirements &requirements, GpuAllocation &allocation);
+        vk::DeviceMemory allocateMemory(vk::DeviceSize size, uint32_t memoryType, const void *next, void **mapped);
+        vk::DeviceSize blockSizeFor(uint32_t memoryType) const;
+    };
+}
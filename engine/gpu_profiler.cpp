@@ -0,0 +1,292 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        // results come back ordered by bit: vertex invocations, clipping primitives, fragment invocations
+        const vk::QueryPipelineStatisticFlags StatisticFlags = vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                                                               vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+                                                               vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+        const uint32_t StatisticCount = 3;
+    }
+
+    GpuProfiler::GpuProfiler(const Context *context, uint32_t frameCount)
+        : context(context), frames(frameCount)
+    {
+        uint32_t graphicsFamily = context->queueFamilyIndices.graphicsQueue.value();
+        uint32_t validBits = context->phyDevice.getQueueFamilyProperties()[graphicsFamily].timestampValidBits;
+        supported = validBits > 0 && context->hostQueryReset;
+        if (!supported)
+        {
+            return;
+        }
+        statisticsSupported = context->pipelineStatistics;
+        timestampPeriod = context->phyDevice.getProperties().limits.timestampPeriod;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        for (auto &frame : frames)
+        {
+            vk::QueryPoolCreateInfo poolInfo;
+            poolInfo.setQueryType(vk::QueryType::eTimestamp)
+                .setQueryCount(MaxScopes * 2);
+            frame.timestamps = context->device.createQueryPool(poolInfo);
+            context->device.resetQueryPool(frame.timestamps, 0, MaxScopes * 2);
+
+            if (statisticsSupported)
+            {
+                poolInfo.setQueryType(vk::QueryType::ePipelineStatistics)
+                    .setQueryCount(MaxScopes)
+                    .setPipelineStatistics(StatisticFlags);
+                frame.statistics = context->device.createQueryPool(poolInfo);
+                context->device.resetQueryPool(frame.statistics, 0, MaxScopes);
+            }
+        }
+    }
+
+    GpuProfiler::~GpuProfiler()
+    {
+        for (auto &frame : frames)
+        {
+            context->device.destroyQueryPool(frame.timestamps);
+            context->device.destroyQueryPool(frame.statistics);
+        }
+    }
+
+    void GpuProfiler::BeginFrame(uint32_t frameIndex)
+    {
+        this->frameIndex = frameIndex;
+        openScopes.clear();
+        statisticsOpen = false;
+        resolvedMilliseconds.clear();
+
+        Frame &frame = frames[frameIndex];
+        resolvedFrame = frame.number;
+        frame.number = ++frameNumber;
+        if (frame.records.empty())
+        {
+            return;
+        }
+
+        // the fence has signaled, so everything is available and the calls below never block
+        uint32_t count = static_cast<uint32_t>(frame.records.size());
+        std::vector<uint64_t> timestamps(count * 2 * 2);
+        vk::QueryResultFlags flags = vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability;
+        vk::Result result = context->device.getQueryPoolResults(frame.timestamps, 0, count * 2, timestamps.size() * sizeof(uint64_t),
+                                                                timestamps.data(), 2 * sizeof(uint64_t), flags);
+        if (result != vk::Result::eSuccess && result != vk::Result::eNotReady)
+        {
+            throw std::runtime_error("Failed to read timestamp queries");
+        }
+
+        std::vector<uint64_t> statistics(frame.statisticsCount * (StatisticCount + 1));
+        if (frame.statisticsCount > 0)
+        {
+            result = context->device.getQueryPoolResults(frame.statistics, 0, frame.statisticsCount, statistics.size() * sizeof(uint64_t),
+                                                         statistics.data(), (StatisticCount + 1) * sizeof(uint64_t), flags);
+            if (result != vk::Result::eSuccess && result != vk::Result::eNotReady)
+            {
+                throw std::runtime_error("Failed to read pipeline statistics queries");
+            }
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const Record &record = frame.records[i];
+            const uint64_t *begin = &timestamps[i * 4];
+            const uint64_t *end = &timestamps[i * 4 + 2];
+            if (!begin[1] || !end[1])
+            {
+                continue;
+            }
+            float milliseconds = static_cast<float>(((end[0] - begin[0]) & timestampMask) * timestampPeriod / 1e6);
+
+            const uint64_t *values = nullptr;
+            if (record.statisticsQuery != NoScope && statistics[record.statisticsQuery * (StatisticCount + 1) + StatisticCount])
+            {
+                values = &statistics[record.statisticsQuery * (StatisticCount + 1)];
+            }
+            resolve(record.path, record.depth, milliseconds, values);
+            resolvedMilliseconds[record.path] = milliseconds;
+        }
+
+        context->device.resetQueryPool(frame.timestamps, 0, count * 2);
+        if (frame.statisticsCount > 0)
+        {
+            context->device.resetQueryPool(frame.statistics, 0, frame.statisticsCount);
+        }
+        frame.records.clear();
+        frame.statisticsCount = 0;
+    }
+
+    uint32_t GpuProfiler::BeginScope(vk::CommandBuffer commandBuffer, const char *name, bool statistics)
+    {
+        Frame &frame = frames[frameIndex];
+        if (!supported || !enabled || frame.records.size() == MaxScopes)
+        {
+            return NoScope;
+        }
+
+        Record record;
+        record.path = openScopes.empty() ? std::string(name) : frame.records[openScopes.back()].path + "/" + name;
+        record.depth = static_cast<uint32_t>(openScopes.size());
+        record.statisticsQuery = NoScope;
+
+        uint32_t scope = static_cast<uint32_t>(frame.records.size());
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.timestamps, scope * 2);
+        if (statistics && this->statistics && statisticsSupported && !statisticsOpen)
+        {
+            record.statisticsQuery = frame.statisticsCount++;
+            commandBuffer.beginQuery(frame.statistics, record.statisticsQuery, {});
+            statisticsOpen = true;
+        }
+
+        frame.records.push_back(std::move(record));
+        openScopes.push_back(scope);
+        return scope;
+    }
+
+    void GpuProfiler::EndScope(vk::CommandBuffer commandBuffer, uint32_t scope)
+    {
+        if (scope == NoScope)
+        {
+            return;
+        }
+        if (openScopes.empty() || openScopes.back() != scope)
+        {
+            throw std::runtime_error("GPU scopes must end in reverse order");
+        }
+        openScopes.pop_back();
+
+        Frame &frame = frames[frameIndex];
+        const Record &record = frame.records[scope];
+        if (record.statisticsQuery != NoScope)
+        {
+            commandBuffer.endQuery(frame.statistics, record.statisticsQuery);
+            statisticsOpen = false;
+        }
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.timestamps, scope * 2 + 1);
+    }
+
+    void GpuProfiler::Report(const char *name, float milliseconds)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        resolve(name, 0, milliseconds, nullptr);
+    }
+
+    void GpuProfiler::WriteCsv(const std::string &path) const
+    {
+        std::ofstream file(path);
+        file << "scope,depth,last_ms,average_ms,min_ms,max_ms,vertex_invocations,fragment_invocations,clipping_primitives\n";
+        for (const auto &scope : scopes)
+        {
+            file << scope.path << ',' << scope.depth << ',' << scope.milliseconds << ',' << scope.averageMilliseconds << ','
+                 << scope.minMilliseconds << ',' << scope.maxMilliseconds << ',';
+            if (scope.hasStatistics)
+            {
+                file << scope.vertexInvocations << ',' << scope.fragmentInvocations << ',' << scope.clippingPrimitives;
+            }
+            else
+            {
+                file << ",,";
+            }
+            file << '\n';
+        }
+
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write " + path);
+        }
+    }
+
+    const GpuScopeStats *GpuProfiler::Find(const std::string &path) const
+    {
+        auto it = scopeIndices.find(path);
+        return it != scopeIndices.end() ? &scopes[it->second] : nullptr;
+    }
+
+    bool GpuProfiler::GetResolved(const std::string &path, float &milliseconds) const
+    {
+        auto it = resolvedMilliseconds.find(path);
+        if (it == resolvedMilliseconds.end())
+        {
+            return false;
+        }
+        milliseconds = it->second;
+        return true;
+    }
+
+    vk::QueryPipelineStatisticFlags GpuProfiler::get_statistic_flags() const
+    {
+        return statisticsSupported ? StatisticFlags : vk::QueryPipelineStatisticFlags();
+    }
+
+    void GpuProfiler::resolve(const std::string &path, uint32_t depth, float milliseconds, const uint64_t *statistics)
+    {
+        auto it = scopeIndices.find(path);
+        if (it == scopeIndices.end())
+        {
+            // kept in tree order, a new scope goes after its parent's last descendant
+            size_t position = scopes.size();
+            size_t slash = path.rfind('/');
+            if (slash != std::string::npos)
+            {
+                std::string prefix = path.substr(0, slash + 1);
+                auto parent = scopeIndices.find(path.substr(0, slash));
+                if (parent != scopeIndices.end())
+                {
+                    position = parent->second + 1;
+                    while (position < scopes.size() && scopes[position].path.compare(0, prefix.size(), prefix) == 0)
+                    {
+                        position++;
+                    }
+                }
+            }
+
+            GpuScopeStats scope;
+            scope.path = path;
+            scope.name = slash == std::string::npos ? path : path.substr(slash + 1);
+            scope.depth = depth;
+            scopes.insert(scopes.begin() + position, scope);
+            histories.insert(histories.begin() + position, History());
+            for (size_t i = position; i < scopes.size(); i++)
+            {
+                scopeIndices[scopes[i].path] = static_cast<uint32_t>(i);
+            }
+            it = scopeIndices.find(path);
+        }
+
+        GpuScopeStats &scope = scopes[it->second];
+        History &history = histories[it->second];
+        history.samples[history.next] = milliseconds;
+        history.next = (history.next + 1) % AverageFrames;
+        history.count = std::min<uint32_t>(history.count + 1, AverageFrames);
+
+        scope.milliseconds = milliseconds;
+        scope.minMilliseconds = history.samples[0];
+        scope.maxMilliseconds = history.samples[0];
+        float total = 0.0f;
+        for (uint32_t i = 0; i < history.count; i++)
+        {
+            total += history.samples[i];
+            scope.minMilliseconds = std::min(scope.minMilliseconds, history.samples[i]);
+            scope.maxMilliseconds = std::max(scope.maxMilliseconds, history.samples[i]);
+        }
+        scope.averageMilliseconds = total / history.count;
+
+        scope.hasStatistics = statistics != nullptr;
+        if (statistics)
+        {
+            scope.vertexInvocations = statistics[0];
+            scope.clippingPrimitives = statistics[1];
+            scope.fragmentInvocations = statistics[2];
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "context.hpp"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace engine
+{
+    // The resolved timings of one scope, averaged over the last GpuProfiler::AverageFrames frames it ran in
+    struct GpuScopeStats
+    {
+        // parent names joined by '/', unique per scope
+        std::string path;
+        std::string name;
+        uint32_t depth = 0;
+        float milliseconds = 0.0f;
+        float averageMilliseconds = 0.0f;
+        float minMilliseconds = 0.0f;
+        float maxMilliseconds = 0.0f;
+        bool hasStatistics = false;
+        uint64_t vertexInvocations = 0;
+        uint64_t fragmentInvocations = 0;
+        uint64_t clippingPrimitives = 0;
+    };
+
+    // Timestamp scopes from one query pool per frame in flight. Queries are reset from the host and read back
+    // when their frame slot comes around again, so results are frameCount frames old and the CPU never waits
+    // for them. A scope may also collect pipeline statistics, at most one such scope is open at a time.
+    // Recording does nothing on devices without timestamp support on the graphics queue or host query reset
+    class GpuProfiler final
+    {
+    public:
+        static constexpr uint32_t MaxScopes = 64;
+        static constexpr uint32_t AverageFrames = 64;
+        static constexpr uint32_t NoScope = ~0u;
+
+        GpuProfiler(const Context *context, uint32_t frameCount);
+        ~GpuProfiler();
+
+        GpuProfiler(const GpuProfiler &) = delete;
+        GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+        // Resolves the scopes last recorded for frameIndex and resets its queries, the caller must have waited for that frame's fence
+        void BeginFrame(uint32_t frameIndex);
+
+        // Scopes nest in the order they are begun on the CPU, whichever command buffer they are recorded into.
+        // Returns NoScope when disabled or out of queries, EndScope ignores it
+        uint32_t BeginScope(vk::CommandBuffer commandBuffer, const char *name, bool statistics = false);
+        void EndScope(vk::CommandBuffer commandBuffer, uint32_t scope);
+
+        // Adds a timing measured elsewhere, e.g. on another queue, as a top level scope of the current frame
+        void Report(const char *name, float milliseconds);
+
+        // One row per scope with its averages, throws when the file cannot be written
+        void WriteCsv(const std::string &path) const;
+
+        // Secondaries executed inside a statistics scope must be begun with these inherited
+        vk::QueryPipelineStatisticFlags get_statistic_flags() const;
+
+        // null until the scope has been resolved once
+        const GpuScopeStats *Find(const std::string &path) const;
+
+        // The time path took in the frame resolved by the last BeginFrame, false when it was not recorded
+        // there or its timestamps were unavailable
+        bool GetResolved(const std::string &path, float &milliseconds) const;
+
+        const std::vector<GpuScopeStats> &get_scopes() const { return scopes; }
+        // counts BeginFrame calls, starting at 1
+        uint64_t get_frame_number() const { return frameNumber; }
+        // the frame number the last BeginFrame read back, which may have recorded no scopes. 0 before the slot was first used
+        uint64_t get_resolved_frame() const { return resolvedFrame; }
+        bool is_supported() const { return supported; }
+        bool has_statistics() const { return statisticsSupported; }
+        bool enabled = true;
+        bool statistics = true;
+
+    private:
+        struct Record
+        {
+            std::string path;
+            uint32_t depth;
+            // NoScope without statistics
+            uint32_t statisticsQuery;
+        };
+
+        struct Frame
+        {
+            vk::QueryPool timestamps;
+            vk::QueryPool statistics;
+            std::vector<Record> records;
+            uint32_t statisticsCount = 0;
+            uint64_t number = 0;
+        };
+
+        struct History
+        {
+            std::array<float, AverageFrames> samples{};
+            uint32_t count = 0;
+            uint32_t next = 0;
+        };
+
+        const Context *context;
+        bool supported = false;
+        bool statisticsSupported = false;
+        // nanoseconds per tick, and the bits the graphics queue actually writes
+        float timestampPeriod = 1.0f;
+        uint64_t timestampMask = ~0ull;
+        std::vector<Frame> frames;
+        uint32_t frameIndex = 0;
+        std::vector<uint32_t> openScopes;
+        bool statisticsOpen = false;
+
+        std::vector<GpuScopeStats> scopes;
+        std::vector<History> histories;
+        std::unordered_map<std::string, uint32_t> scopeIndices;
+        uint64_t frameNumber = 0;
+        uint64_t resolvedFrame = 0;
+        std::unordered_map<std::string, float> resolvedMilliseconds;
+
+        // statistics is null for a scope without them
+        void resolve(const std::string &path, uint32_t depth, float milliseconds, const uint64_t *statistics);
+    };
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace engine
+{
+    constexpr uint64_t HashSeed = 0xcbf29ce484222325ull;
+
+    // 64-bit FNV-1a
+    inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = HashSeed)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    inline uint64_t HashValue(const T &value, uint64_t seed = HashSeed)
+    {
+        return HashBytes(&value, sizeof(T), seed);
+    }
+
+    inline uint64_t HashCombine(uint64_t seed, uint64_t value)
+    {
+        return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+namespace engine
+{
+    // Writes value as a quoted JSON string, bytes are passed through so UTF-8 stays intact
+    inline void WriteJsonString(std::ostream &out, const std::string &value)
+    {
+        out << '"';
+        for (char c : value)
+        {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            }
+            else if (byte < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+                out << escaped;
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+}
@@ -0,0 +1,168 @@
+#include "layout_cache.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine
+{
+    namespace
+    {
+        bool sameBindings(const std::vector<vk::DescriptorSetLayoutBinding> &a, const std::vector<vk::DescriptorSetLayoutBinding> &b)
+        {
+            // immutable samplers are not supported, so comparing the pointers is not needed
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                              [](const vk::DescriptorSetLayoutBinding &x, const vk::DescriptorSetLayoutBinding &y)
+                              { return x.binding == y.binding && x.descriptorType == y.descriptorType &&
+                                       x.descriptorCount == y.descriptorCount && x.stageFlags == y.stageFlags; });
+        }
+    }
+
+    LayoutCache::LayoutCache(vk::Device device, uint32_t bindlessCapacity)
+        : device(device), bindlessCapacity(bindlessCapacity)
+    {
+    }
+
+    LayoutCache::~LayoutCache()
+    {
+        for (auto &pair : pipelineLayouts)
+        {
+            device.destroyPipelineLayout(pair.second.layout);
+        }
+        for (auto &pair : setLayouts)
+        {
+            device.destroyDescriptorSetLayout(pair.second.layout);
+        }
+    }
+
+    vk::DescriptorSetLayout LayoutCache::GetSetLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings)
+    {
+        std::sort(bindings.begin(), bindings.end(),
+                  [](const vk::DescriptorSetLayoutBinding &a, const vk::DescriptorSetLayoutBinding &b)
+                  { return a.binding < b.binding; });
+
+        std::vector<vk::DescriptorBindingFlags> flags(bindings.size());
+        bool bindless = false;
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            if (bindings[i].descriptorCount != 0)
+            {
+                continue;
+            }
+            if (bindlessCapacity == 0)
+            {
+                throw std::runtime_error("Runtime sized descriptor arrays need descriptor indexing");
+            }
+            bindings[i].descriptorCount = bindlessCapacity;
+            bindings[i].stageFlags = vk::ShaderStageFlagBits::eAll;
+            flags[i] = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+            bindless = true;
+        }
+
+        // field by field, so padding never reaches the hash
+        uint64_t hash = HashValue(bindings.size());
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            const auto &binding = bindings[i];
+            if (binding.pImmutableSamplers)
+            {
+                throw std::runtime_error("Immutable samplers are not supported by the layout cache");
+            }
+            hash = HashCombine(hash, HashValue(static_cast<VkDescriptorBindingFlags>(flags[i])));
+            hash = HashCombine(hash, HashValue(binding.binding));
+            hash = HashCombine(hash, HashValue(binding.descriptorType));
+            hash = HashCombine(hash, HashValue(binding.descriptorCount));
+            hash = HashCombine(hash, HashValue(static_cast<VkShaderStageFlags>(binding.stageFlags)));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = setLayouts.find(hash);
+        if (it != setLayouts.end())
+        {
+            if (!sameBindings(it->second.bindings, bindings) || it->second.flags != flags)
+            {
+                throw std::runtime_error("Descriptor set layout hash collision");
+            }
+            return it->second.layout;
+        }
+
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo flagsInfo;
+        flagsInfo.setBindingFlags(flags);
+
+        vk::DescriptorSetLayoutCreateInfo layoutInfo;
+        layoutInfo.setBindings(bindings);
+        if (bindless)
+        {
+            layoutInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+                .setPNext(&flagsInfo);
+        }
+
+        SetLayoutEntry &entry = setLayouts[hash];
+        entry.layout = device.createDescriptorSetLayout(layoutInfo);
+        entry.bindings = std::move(bindings);
+        entry.flags = std::move(flags);
+        setLayoutHashes[entry.layout] = hash;
+        return entry.layout;
+    }
+
+    const std::vector<vk::DescriptorSetLayoutBinding> &LayoutCache::GetBindings(vk::DescriptorSetLayout setLayout) const
+    {
+        // entries are never erased, so the reference stays valid after the lock is released
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = setLayoutHashes.find(setLayout);
+        if (it == setLayoutHashes.end())
+        {
+            throw std::runtime_error("Descriptor set layout was not created by the layout cache");
+        }
+        return setLayouts.at(it->second).bindings;
+    }
+
+    vk::PipelineLayout LayoutCache::GetPipelineLayout(const std::vector<vk::DescriptorSetLayout> &setLayouts,
+                                                      const std::vector<vk::PushConstantRange> &pushConstants)
+    {
+        uint64_t hash = HashValue(setLayouts.size());
+        for (auto setLayout : setLayouts)
+        {
+            hash = HashCombine(hash, HashValue(static_cast<VkDescriptorSetLayout>(setLayout)));
+        }
+        for (const auto &range : pushConstants)
+        {
+            hash = HashCombine(hash, HashValue(static_cast<VkShaderStageFlags>(range.stageFlags)));
+            hash = HashCombine(hash, HashValue(range.offset));
+            hash = HashCombine(hash, HashValue(range.size));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pipelineLayouts.find(hash);
+        if (it != pipelineLayouts.end())
+        {
+            if (it->second.setLayouts != setLayouts || it->second.pushConstants != pushConstants)
+            {
+                throw std::runtime_error("Pipeline layout hash collision");
+            }
+            return it->second.layout;
+        }
+
+        vk::PipelineLayoutCreateInfo layoutInfo;
+        layoutInfo.setSetLayouts(setLayouts)
+            .setPushConstantRanges(pushConstants);
+
+        PipelineLayoutEntry &entry = pipelineLayouts[hash];
+        entry.setLayouts = setLayouts;
+        entry.pushConstants = pushConstants;
+        entry.layout = device.createPipelineLayout(layoutInfo);
+        return entry.layout;
+    }
+
+    uint32_t LayoutCache::get_set_layout_count() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<uint32_t>(setLayouts.size());
+    }
+
+    uint32_t LayoutCache::get_pipeline_layout_count() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<uint32_t>(pipelineLayouts.size());
+    }
+}
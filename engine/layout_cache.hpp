@@ -0,0 +1,59 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace engine
+{
+    // Descriptor set layouts and pipeline layouts deduplicated by their contents, so shaders with the
+    // same interface share one layout and their descriptor sets stay compatible. Thread safe
+    //
+    // A binding with descriptorCount 0 is a runtime sized array. It becomes a bindless binding of
+    // bindlessCapacity descriptors, partially bound, update after bind and visible to every stage, so
+    // all shaders declaring it share the layout of the BindlessTable
+    class LayoutCache final
+    {
+    public:
+        LayoutCache(vk::Device device, uint32_t bindlessCapacity);
+        ~LayoutCache();
+
+        LayoutCache(const LayoutCache &) = delete;
+        LayoutCache &operator=(const LayoutCache &) = delete;
+
+        // bindings may come in any order
+        vk::DescriptorSetLayout GetSetLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings);
+        // the bindings setLayout was created from, sorted by binding and with bindless counts resolved. Throws for layouts from elsewhere
+        const std::vector<vk::DescriptorSetLayoutBinding> &GetBindings(vk::DescriptorSetLayout setLayout) const;
+        vk::PipelineLayout GetPipelineLayout(const std::vector<vk::DescriptorSetLayout> &setLayouts,
+                                             const std::vector<vk::PushConstantRange> &pushConstants);
+
+        uint32_t get_set_layout_count() const;
+        uint32_t get_pipeline_layout_count() const;
+        uint32_t get_bindless_capacity() const { return bindlessCapacity; }
+
+    private:
+        struct SetLayoutEntry
+        {
+            std::vector<vk::DescriptorSetLayoutBinding> bindings;
+            std::vector<vk::DescriptorBindingFlags> flags;
+            vk::DescriptorSetLayout layout;
+        };
+
+        struct PipelineLayoutEntry
+        {
+            std::vector<vk::DescriptorSetLayout> setLayouts;
+            std::vector<vk::PushConstantRange> pushConstants;
+            vk::PipelineLayout layout;
+        };
+
+        vk::Device device;
+        uint32_t bindlessCapacity;
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, SetLayoutEntry> setLayouts;
+        std::unordered_map<VkDescriptorSetLayout, uint64_t> setLayoutHashes;
+        std::unordered_map<uint64_t, PipelineLayoutEntry> pipelineLayouts;
+    };
+}
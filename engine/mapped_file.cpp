@@ -0,0 +1,119 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace engine
+{
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::Open(const std::string &path)
+    {
+        Close();
+
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            file = nullptr;
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            Close();
+            return false;
+        }
+
+        data_ = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data_)
+        {
+            Close();
+            return false;
+        }
+        size_ = static_cast<size_t>(fileSize.QuadPart);
+
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (data_)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        if (file)
+        {
+            CloseHandle(file);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        mapping = nullptr;
+        file = nullptr;
+    }
+#else
+    bool MappedFile::Open(const std::string &path)
+    {
+        Close();
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        close(fd);
+        if (ptr == MAP_FAILED)
+        {
+            return false;
+        }
+
+        data_ = static_cast<const uint8_t *>(ptr);
+        size_ = static_cast<size_t>(st.st_size);
+
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (data_)
+        {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace engine
+{
+    // Read-only memory mapping of a whole file
+    class MappedFile final
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool Open(const std::string &path);
+        void Close();
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+        bool is_open() const { return data_ != nullptr; }
+
+    private:
+        const uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+
+#ifdef _WIN32
+        void *file = nullptr;
+        void *mapping = nullptr;
+#endif
+    };
+}
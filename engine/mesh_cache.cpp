@@ -0,0 +1,142 @@
+#include "mesh_cache.hpp"
+#include "hash.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace engine
+{
+    static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool MeshCache::Open(const std::string &path, const MeshCacheKey &key)
+    {
+        Close();
+
+        if (!file.Open(path) || file.size() < sizeof(MeshCacheHeader))
+        {
+            file.Close();
+            return false;
+        }
+
+        auto header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+        if (header->magic != MeshCacheMagic ||
+            header->version != MeshCacheVersion ||
+            header->sourceHash != key.sourceHash ||
+            header->importFlags != key.importFlags ||
+            header->processFlags != key.processFlags ||
+            header->vertexStride != key.vertexStride ||
+            header->settingsHash != key.settingsHash)
+        {
+            file.Close();
+            return false;
+        }
+
+        uint64_t tableEnd = sizeof(MeshCacheHeader) + uint64_t(header->sectionCount) * sizeof(MeshCacheSection);
+        if (tableEnd > file.size())
+        {
+            file.Close();
+            return false;
+        }
+
+        auto table = reinterpret_cast<const MeshCacheSection *>(file.data() + sizeof(MeshCacheHeader));
+        for (uint32_t i = 0; i < header->sectionCount; i++)
+        {
+            if (table[i].offset % MeshCacheAlignment != 0 || table[i].offset + table[i].size > file.size())
+            {
+                file.Close();
+                return false;
+            }
+        }
+
+        sections = table;
+        sectionCount = header->sectionCount;
+
+        return true;
+    }
+
+    void MeshCache::Close()
+    {
+        file.Close();
+        sections = nullptr;
+        sectionCount = 0;
+    }
+
+    bool MeshCache::Write(const std::string &path, const MeshCacheKey &key, const std::vector<MeshCacheSectionData> &sectionData)
+    {
+        MeshCacheHeader header = {};
+        header.magic = MeshCacheMagic;
+        header.version = MeshCacheVersion;
+        header.sourceHash = key.sourceHash;
+        header.importFlags = key.importFlags;
+        header.processFlags = key.processFlags;
+        header.vertexStride = key.vertexStride;
+        header.settingsHash = key.settingsHash;
+        header.sectionCount = static_cast<uint32_t>(sectionData.size());
+
+        std::vector<MeshCacheSection> table(sectionData.size());
+        uint64_t offset = AlignUp(sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCacheSection), MeshCacheAlignment);
+        for (size_t i = 0; i < sectionData.size(); i++)
+        {
+            table[i].type = sectionData[i].type;
+            table[i].reserved = 0;
+            table[i].offset = offset;
+            table[i].size = sectionData[i].size;
+            offset = AlignUp(offset + sectionData[i].size, MeshCacheAlignment);
+        }
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                return false;
+            }
+
+            const char padding[MeshCacheAlignment] = {};
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(MeshCacheSection));
+            uint64_t written = sizeof(header) + table.size() * sizeof(MeshCacheSection);
+
+            for (size_t i = 0; i < sectionData.size(); i++)
+            {
+                out.write(padding, static_cast<std::streamsize>(table[i].offset - written));
+                out.write(static_cast<const char *>(sectionData[i].data), static_cast<std::streamsize>(sectionData[i].size));
+                written = table[i].offset + sectionData[i].size;
+            }
+
+            if (!out.good())
+            {
+                out.close();
+                std::remove(tmpPath.c_str());
+                return false;
+            }
+        }
+
+        // rename replaces the old file atomically on POSIX, Windows needs it gone first
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    uint64_t MeshCache::HashFile(const std::string &path)
+    {
+        MappedFile source;
+        if (!source.Open(path))
+        {
+            throw std::runtime_error("Failed to open mesh source: " + path);
+        }
+
+        return HashBytes(source.data(), source.size());
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "span.hpp"
+
+namespace engine
+{
+    // Cooked mesh file layout:
+    //   MeshCacheHeader
+    //   MeshCacheSection[sectionCount]
+    //   section payloads, each aligned to MeshCacheAlignment
+    constexpr uint32_t MeshCacheMagic = 0x434d564c; // "LVMC"
+    constexpr uint32_t MeshCacheVersion = 5;
+    constexpr uint64_t MeshCacheAlignment = 16;
+
+    enum class MeshCacheSectionType : uint32_t
+    {
+        Vertices = 1,
+        Indices = 2,
+        SubMeshes = 3,
+        PackedVertices = 4,
+        Quantization = 5,
+        Lods = 6,
+        Bounds = 7,
+        Meshlets = 8,
+        MeshletBounds = 9,
+        MeshletVertices = 10,
+        MeshletTriangles = 11,
+    };
+
+    // Everything the cooked data depends on, a mismatch on any field forces a re-import
+    struct MeshCacheKey
+    {
+        uint64_t sourceHash;
+        uint32_t importFlags;
+        uint32_t processFlags;
+        uint32_t vertexStride;
+        uint64_t settingsHash;
+    };
+
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t importFlags;
+        uint32_t processFlags;
+        uint32_t vertexStride;
+        uint32_t sectionCount;
+        uint64_t settingsHash;
+    };
+
+    struct MeshCacheSection
+    {
+        MeshCacheSectionType type;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct MeshCacheSectionData
+    {
+        MeshCacheSectionType type;
+        const void *data;
+        size_t size;
+    };
+
+    class MeshCache final
+    {
+    public:
+        // Maps the cache file, returns false if it is missing or was cooked from different inputs
+        bool Open(const std::string &path, const MeshCacheKey &key);
+        void Close();
+
+        template <typename T>
+        Span<const T> GetSection(MeshCacheSectionType type) const
+        {
+            for (uint32_t i = 0; i < sectionCount; i++)
+            {
+                if (sections[i].type == type)
+                {
+                    return Span<const T>(reinterpret_cast<const T *>(file.data() + sections[i].offset),
+                                         static_cast<size_t>(sections[i].size / sizeof(T)));
+                }
+            }
+            return {};
+        }
+
+        // Writes to a temporary file and renames it over the target, so readers never see a partial cache
+        static bool Write(const std::string &path, const MeshCacheKey &key, const std::vector<MeshCacheSectionData> &sections);
+
+        static uint64_t HashFile(const std::string &path);
+
+    private:
+        MappedFile file;
+        const MeshCacheSection *sections = nullptr;
+        uint32_t sectionCount = 0;
+    };
+}
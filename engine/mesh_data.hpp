@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+namespace engine
+{
+    struct Vertex
+    {
+        glm::vec3 position;
+        glm::vec4 color;
+        glm::vec2 texCoord;
+    };
+
+    // 16 byte compact layout: RGBA16 unorm position (w unused), RGBA8 unorm color, RG16 half float texCoord.
+    // position dequantizes as QuantizationInfo::offset + unorm * QuantizationInfo::scale
+    struct PackedVertex
+    {
+        uint16_t position[4];
+        uint32_t color;
+        uint16_t texCoord[2];
+    };
+
+    struct QuantizationInfo
+    {
+        glm::vec3 offset;
+        float reserved0;
+        glm::vec3 scale;
+        float reserved1;
+    };
+
+    enum class VertexLayout : uint32_t
+    {
+        Float,
+        Packed,
+    };
+
+    // Level of detail over the shared vertex buffer, error is the simplification error in model units
+    struct MeshLod
+    {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float error;
+        uint32_t reserved;
+    };
+
+    struct MeshBounds
+    {
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Range of a source aiMesh inside the flattened vertex/index streams
+    struct SubMesh
+    {
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+    };
+}
@@ -0,0 +1,333 @@
+#include "mesh_optimizer.hpp"
+#include "hash.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace engine
+{
+    namespace
+    {
+        struct VertexHasher
+        {
+            size_t operator()(const Vertex &vertex) const
+            {
+                return static_cast<size_t>(HashValue(vertex));
+            }
+        };
+
+        struct VertexEqual
+        {
+            bool operator()(const Vertex &a, const Vertex &b) const
+            {
+                return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+            }
+        };
+
+        struct LocalMesh
+        {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+        };
+
+        // Collapses bitwise-identical vertices, indices become local to the submesh
+        void weldVertices(const Vertex *vertices, uint32_t vertexCount, uint32_t vertexOffset,
+                          const uint32_t *indices, uint32_t indexCount, LocalMesh &result)
+        {
+            std::unordered_map<Vertex, uint32_t, VertexHasher, VertexEqual> lookup;
+            lookup.reserve(vertexCount);
+
+            std::vector<uint32_t> remap(vertexCount);
+            result.vertices.reserve(vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                auto inserted = lookup.emplace(vertices[i], static_cast<uint32_t>(result.vertices.size()));
+                if (inserted.second)
+                {
+                    result.vertices.push_back(vertices[i]);
+                }
+                remap[i] = inserted.first->second;
+            }
+
+            result.indices.resize(indexCount);
+            for (uint32_t i = 0; i < indexCount; i++)
+            {
+                result.indices[i] = remap[indices[i] - vertexOffset];
+            }
+        }
+
+        // Tipsify, Sander et al. 2007 "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+        void reorderTriangles(std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize)
+        {
+            uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+            // vertex -> triangle adjacency
+            std::vector<uint32_t> liveCount(vertexCount, 0);
+            for (uint32_t index : indices)
+            {
+                liveCount[index]++;
+            }
+
+            std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+            for (uint32_t v = 0; v < vertexCount; v++)
+            {
+                adjacencyOffset[v + 1] = adjacencyOffset[v] + liveCount[v];
+            }
+
+            std::vector<uint32_t> adjacency(indices.size());
+            {
+                std::vector<uint32_t> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+                for (uint32_t t = 0; t < triangleCount; t++)
+                {
+                    for (uint32_t k = 0; k < 3; k++)
+                    {
+                        adjacency[cursor[indices[t * 3 + k]]++] = t;
+                    }
+                }
+            }
+
+            std::vector<uint32_t> timestamp(vertexCount, 0);
+            std::vector<uint32_t> deadEnd;
+            deadEnd.reserve(indices.size());
+            std::vector<bool> emitted(triangleCount, false);
+            std::vector<uint32_t> candidates;
+            candidates.reserve(64);
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+
+            uint32_t time = cacheSize + 1;
+            uint32_t scan = 0;
+            int64_t fanning = vertexCount > 0 ? 0 : -1;
+
+            while (fanning >= 0)
+            {
+                candidates.clear();
+
+                uint32_t vertex = static_cast<uint32_t>(fanning);
+                for (uint32_t a = adjacencyOffset[vertex]; a < adjacencyOffset[vertex + 1]; a++)
+                {
+                    uint32_t t = adjacency[a];
+                    if (emitted[t])
+                    {
+                        continue;
+                    }
+
+                    for (uint32_t k = 0; k < 3; k++)
+                    {
+                        uint32_t v = indices[t * 3 + k];
+                        result.push_back(v);
+                        deadEnd.push_back(v);
+                        candidates.push_back(v);
+                        liveCount[v]--;
+
+                        if (time - timestamp[v] > cacheSize)
+                        {
+                            timestamp[v] = time++;
+                        }
+                    }
+                    emitted[t] = true;
+                }
+
+                // pick the candidate that is still in cache and has the most live triangles left
+                fanning = -1;
+                int64_t best = -1;
+                for (uint32_t v : candidates)
+                {
+                    if (liveCount[v] == 0)
+                    {
+                        continue;
+                    }
+
+                    int64_t priority = 0;
+                    if (time - timestamp[v] + 2 * liveCount[v] <= cacheSize)
+                    {
+                        priority = time - timestamp[v];
+                    }
+                    if (priority > best)
+                    {
+                        best = priority;
+                        fanning = v;
+                    }
+                }
+
+                if (fanning >= 0)
+                {
+                    continue;
+                }
+
+                // dead end: recently used vertices first, then scan forward
+                while (!deadEnd.empty())
+                {
+                    uint32_t v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveCount[v] > 0)
+                    {
+                        fanning = v;
+                        break;
+                    }
+                }
+                while (fanning < 0 && scan < vertexCount)
+                {
+                    if (liveCount[scan] > 0)
+                    {
+                        fanning = scan;
+                    }
+                    scan++;
+                }
+            }
+
+            indices = std::move(result);
+        }
+
+        // Renumbers vertices in order of first use so fetches walk the vertex buffer linearly
+        void reorderVertices(LocalMesh &mesh)
+        {
+            constexpr uint32_t Unused = ~0u;
+            std::vector<uint32_t> remap(mesh.vertices.size(), Unused);
+            std::vector<Vertex> ordered;
+            ordered.reserve(mesh.vertices.size());
+
+            for (uint32_t &index : mesh.indices)
+            {
+                if (remap[index] == Unused)
+                {
+                    remap[index] = static_cast<uint32_t>(ordered.size());
+                    ordered.push_back(mesh.vertices[index]);
+                }
+                index = remap[index];
+            }
+
+            mesh.vertices = std::move(ordered);
+        }
+    }
+
+    float ComputeACMR(const uint32_t *indices, size_t indexCount, uint32_t cacheSize)
+    {
+        if (indexCount < 3)
+        {
+            return 0.0f;
+        }
+
+        std::vector<uint32_t> fifo(cacheSize, ~0u);
+        uint32_t head = 0;
+        size_t misses = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            bool hit = false;
+            for (uint32_t entry : fifo)
+            {
+                if (entry == indices[i])
+                {
+                    hit = true;
+                    break;
+                }
+            }
+            if (!hit)
+            {
+                fifo[head] = indices[i];
+                head = (head + 1) % cacheSize;
+                misses++;
+            }
+        }
+
+        return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+    }
+
+    void OptimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t cacheSize)
+    {
+        if (indexCount % 3 != 0)
+        {
+            return;
+        }
+
+        // compact the referenced vertices so the adjacency stays proportional to the range
+        std::unordered_map<uint32_t, uint32_t> lookup;
+        std::vector<uint32_t> globalIndex;
+        std::vector<uint32_t> local(indexCount);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            auto inserted = lookup.emplace(indices[i], static_cast<uint32_t>(globalIndex.size()));
+            if (inserted.second)
+            {
+                globalIndex.push_back(indices[i]);
+            }
+            local[i] = inserted.first->second;
+        }
+
+        reorderTriangles(local, static_cast<uint32_t>(globalIndex.size()), cacheSize);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            indices[i] = globalIndex[local[i]];
+        }
+    }
+
+    MeshOptimizeStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<SubMesh> &submeshes, ThreadPool *pool)
+    {
+        MeshOptimizeStats stats;
+        stats.vertexCountBefore = static_cast<uint32_t>(vertices.size());
+        stats.acmrBefore = ComputeACMR(indices.data(), indices.size());
+
+        uint32_t submeshCount = static_cast<uint32_t>(submeshes.size());
+        std::vector<LocalMesh> locals(submeshCount);
+
+        auto optimize = [&](uint32_t i)
+        {
+            const SubMesh &submesh = submeshes[i];
+            LocalMesh &local = locals[i];
+            weldVertices(vertices.data() + submesh.vertexOffset, submesh.vertexCount, submesh.vertexOffset,
+                         indices.data() + submesh.indexOffset, submesh.indexCount, local);
+
+            // points and lines left over by aiProcess_Triangulate keep their order
+            if (local.indices.size() % 3 == 0)
+            {
+                reorderTriangles(local.indices, static_cast<uint32_t>(local.vertices.size()), VertexCacheSize);
+                reorderVertices(local);
+            }
+        };
+
+        if (pool)
+        {
+            pool->ParallelFor(submeshCount, optimize);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < submeshCount; i++)
+            {
+                optimize(i);
+            }
+        }
+
+        size_t vertexCount = 0;
+        for (auto &local : locals)
+        {
+            vertexCount += local.vertices.size();
+        }
+
+        std::vector<Vertex> optimizedVertices;
+        optimizedVertices.reserve(vertexCount);
+        indices.clear();
+
+        for (uint32_t i = 0; i < submeshCount; i++)
+        {
+            SubMesh &submesh = submeshes[i];
+            submesh.vertexOffset = static_cast<uint32_t>(optimizedVertices.size());
+            submesh.vertexCount = static_cast<uint32_t>(locals[i].vertices.size());
+            submesh.indexOffset = static_cast<uint32_t>(indices.size());
+            submesh.indexCount = static_cast<uint32_t>(locals[i].indices.size());
+
+            optimizedVertices.insert(optimizedVertices.end(), locals[i].vertices.begin(), locals[i].vertices.end());
+            for (uint32_t index : locals[i].indices)
+            {
+                indices.push_back(index + submesh.vertexOffset);
+            }
+        }
+
+        vertices = std::move(optimizedVertices);
+
+        stats.vertexCountAfter = static_cast<uint32_t>(vertices.size());
+        stats.acmrAfter = ComputeACMR(indices.data(), indices.size());
+
+        return stats;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+namespace engine
+{
+    // FIFO size used both for the triangle reorder and for the ACMR report
+    constexpr uint32_t VertexCacheSize = 16;
+
+    struct MeshOptimizeStats
+    {
+        uint32_t vertexCountBefore = 0;
+        uint32_t vertexCountAfter = 0;
+        float acmrBefore = 0.0f;
+        float acmrAfter = 0.0f;
+    };
+
+    // Average cache miss ratio: transformed vertices per triangle for a FIFO post-transform cache
+    float ComputeACMR(const uint32_t *indices, size_t indexCount, uint32_t cacheSize = VertexCacheSize);
+
+    // Tipsify on one triangle list range in place, e.g. a meshlet. Vertex indices are kept as they are
+    void OptimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t cacheSize = VertexCacheSize);
+
+    // Per submesh: welds bitwise-identical vertices, reorders triangles for the post-transform cache (Tipsify)
+    // and reorders vertices by first use for fetch locality. Submesh ranges are rewritten in place.
+    MeshOptimizeStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<SubMesh> &submeshes, ThreadPool *pool = nullptr);
+}
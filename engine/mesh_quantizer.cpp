@@ -0,0 +1,74 @@
+#include "mesh_quantizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "glm/gtc/packing.hpp"
+
+namespace engine
+{
+    static uint16_t quantizeUnorm16(float value)
+    {
+        return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+    }
+
+    QuantizationReport QuantizeVertices(Span<const Vertex> vertices, std::vector<PackedVertex> &packed, QuantizationInfo &info)
+    {
+        QuantizationReport report;
+        packed.resize(vertices.size());
+
+        glm::vec3 minPosition(0.0f);
+        glm::vec3 maxPosition(0.0f);
+        if (!vertices.empty())
+        {
+            minPosition = maxPosition = vertices[0].position;
+        }
+        for (auto &vertex : vertices)
+        {
+            minPosition = glm::min(minPosition, vertex.position);
+            maxPosition = glm::max(maxPosition, vertex.position);
+        }
+
+        glm::vec3 extent = maxPosition - minPosition;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // flat axis: any scale works, keep it non-zero so the inverse is defined
+            if (extent[axis] <= 0.0f)
+            {
+                extent[axis] = 1.0f;
+            }
+        }
+
+        info = {};
+        info.offset = minPosition;
+        info.scale = extent;
+        report.extent = maxPosition - minPosition;
+
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &vertex = vertices[i];
+            PackedVertex &result = packed[i];
+
+            glm::vec3 normalized = (vertex.position - info.offset) / info.scale;
+            glm::vec3 decoded;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                result.position[axis] = quantizeUnorm16(normalized[axis]);
+                decoded[axis] = info.offset[axis] + (result.position[axis] / 65535.0f) * info.scale[axis];
+            }
+            result.position[3] = 0;
+            report.maxPositionError = std::max(report.maxPositionError, glm::length(decoded - vertex.position));
+
+            result.color = glm::packUnorm4x8(vertex.color);
+
+            for (int axis = 0; axis < 2; axis++)
+            {
+                result.texCoord[axis] = glm::packHalf1x16(vertex.texCoord[axis]);
+                float error = std::fabs(glm::unpackHalf1x16(result.texCoord[axis]) - vertex.texCoord[axis]);
+                report.maxTexCoordError = std::max(report.maxTexCoordError, error);
+            }
+        }
+
+        return report;
+    }
+}
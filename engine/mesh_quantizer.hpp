@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_data.hpp"
+#include "span.hpp"
+
+namespace engine
+{
+    struct QuantizationReport
+    {
+        float maxPositionError = 0.0f;  // model units, euclidean
+        float maxTexCoordError = 0.0f;  // uv units, per component
+        glm::vec3 extent = glm::vec3(0.0f);
+    };
+
+    // Packs the float stream into PackedVertex using one dequantization transform for the whole mesh
+    QuantizationReport QuantizeVertices(Span<const Vertex> vertices, std::vector<PackedVertex> &packed, QuantizationInfo &info);
+}
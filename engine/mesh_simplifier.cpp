@@ -0,0 +1,530 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace engine
+{
+    namespace
+    {
+        // Symmetric 4x4 quadric, Garland & Heckbert 1997. The plane weights are summed as well,
+        // so Evaluate returns a weighted mean squared distance in model units whatever the mesh scale
+        struct Quadric
+        {
+            double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+            double b0 = 0, b1 = 0, b2 = 0;
+            double c = 0;
+            double weight = 0;
+
+            void AddPlane(const glm::vec3 &n, double d, double weight)
+            {
+                a00 += weight * n.x * n.x;
+                a11 += weight * n.y * n.y;
+                a22 += weight * n.z * n.z;
+                a01 += weight * n.x * n.y;
+                a02 += weight * n.x * n.z;
+                a12 += weight * n.y * n.z;
+                b0 += weight * n.x * d;
+                b1 += weight * n.y * d;
+                b2 += weight * n.z * d;
+                c += weight * d * d;
+                this->weight += weight;
+            }
+
+            void Add(const Quadric &q)
+            {
+                a00 += q.a00;
+                a11 += q.a11;
+                a22 += q.a22;
+                a01 += q.a01;
+                a02 += q.a02;
+                a12 += q.a12;
+                b0 += q.b0;
+                b1 += q.b1;
+                b2 += q.b2;
+                c += q.c;
+                weight += q.weight;
+            }
+
+            double Evaluate(const glm::vec3 &p) const
+            {
+                double x = p.x, y = p.y, z = p.z;
+                double result = a00 * x * x + a11 * y * y + a22 * z * z +
+                                2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                                2 * (b0 * x + b1 * y + b2 * z) + c;
+                return weight > 0 ? std::max(result, 0.0) / weight : 0.0;
+            }
+        };
+
+        enum class VertexKind : uint8_t
+        {
+            Manifold, // interior vertex with a single attribute set, collapses along any edge
+            Border,   // on one open boundary loop, collapses along the border only
+            Seam,     // two attribute sets along one seam line, collapses along the seam only
+            Locked,   // corners and non-manifold vertices, only used as a collapse target
+        };
+
+        struct Collapse
+        {
+            uint32_t from; // canonical vertex indices
+            uint32_t to;
+            double error;
+        };
+
+        // Border edges keep their shape through a plane perpendicular to the face
+        constexpr double BorderWeight = 10.0;
+
+        struct PositionHasher
+        {
+            size_t operator()(const glm::vec3 &p) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (size_t(bits[0]) * 73856093u) ^ (size_t(bits[1]) * 19349663u) ^ (size_t(bits[2]) * 83492791u);
+            }
+        };
+
+        struct PositionEqual
+        {
+            bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+            {
+                return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+            }
+        };
+
+        uint64_t edgeKey(uint32_t a, uint32_t b)
+        {
+            return (uint64_t(a) << 32) | b;
+        }
+    }
+
+    float ComputeMeshScale(const Vertex *vertices, size_t vertexCount)
+    {
+        if (vertexCount == 0)
+        {
+            return 0.0f;
+        }
+
+        glm::vec3 minPosition = vertices[0].position;
+        glm::vec3 maxPosition = vertices[0].position;
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            minPosition = glm::min(minPosition, vertices[i].position);
+            maxPosition = glm::max(maxPosition, vertices[i].position);
+        }
+
+        glm::vec3 extent = maxPosition - minPosition;
+        return std::max(extent.x, std::max(extent.y, extent.z));
+    }
+
+    void SimplifyMesh(const uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                      size_t targetIndexCount, float targetError, std::vector<uint32_t> &result, float *resultError)
+    {
+        result.assign(indices, indices + indexCount);
+        if (resultError)
+        {
+            *resultError = 0.0f;
+        }
+        if (indexCount % 3 != 0 || vertexCount == 0)
+        {
+            return;
+        }
+
+        // 1. vertices sharing a position form one topological vertex
+        std::vector<uint32_t> canonical(vertexCount);
+        std::vector<uint32_t> wedgeCount(vertexCount, 0);
+        {
+            std::unordered_map<glm::vec3, uint32_t, PositionHasher, PositionEqual> lookup;
+            lookup.reserve(vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                canonical[i] = lookup.emplace(vertices[i].position, i).first->second;
+            }
+        }
+
+        std::vector<uint8_t> referenced(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            if (!referenced[indices[i]])
+            {
+                referenced[indices[i]] = 1;
+                wedgeCount[canonical[indices[i]]]++;
+            }
+        }
+
+        // 2. classify by the edges that are open at wedge level: a border edge has no opposite at all,
+        //    a seam edge has an opposite position-wise but with different wedges
+        std::unordered_map<uint64_t, uint32_t> wedgeEdges;
+        std::unordered_map<uint64_t, uint32_t> canonicalEdges;
+        wedgeEdges.reserve(indexCount);
+        canonicalEdges.reserve(indexCount);
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t a = indices[i + k];
+                uint32_t b = indices[i + (k + 1) % 3];
+                if (canonical[a] != canonical[b])
+                {
+                    wedgeEdges[edgeKey(a, b)]++;
+                    canonicalEdges[edgeKey(canonical[a], canonical[b])]++;
+                }
+            }
+        }
+
+        // canonical edges that are open at wedge level, value tells whether it is a border (true) or a seam
+        std::unordered_map<uint64_t, bool> openEdges;
+        std::vector<uint32_t> openOut(vertexCount, 0);
+        std::vector<uint32_t> openIn(vertexCount, 0);
+        std::vector<uint8_t> complex(vertexCount, 0);
+        for (auto &edge : wedgeEdges)
+        {
+            uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+            uint32_t b = static_cast<uint32_t>(edge.first & 0xffffffffu);
+            uint32_t ca = canonical[a];
+            uint32_t cb = canonical[b];
+
+            auto canonicalOpposite = canonicalEdges.find(edgeKey(cb, ca));
+            if (edge.second != 1 || canonicalEdges[edgeKey(ca, cb)] != 1 ||
+                (canonicalOpposite != canonicalEdges.end() && canonicalOpposite->second != 1))
+            {
+                complex[ca] = 1;
+                complex[cb] = 1;
+                continue;
+            }
+
+            if (wedgeEdges.find(edgeKey(b, a)) == wedgeEdges.end())
+            {
+                openEdges[edgeKey(ca, cb)] = canonicalOpposite == canonicalEdges.end();
+                openOut[ca]++;
+                openIn[cb]++;
+            }
+        }
+
+        std::vector<VertexKind> kind(vertexCount, VertexKind::Locked);
+        for (auto &edge : openEdges)
+        {
+            // a seam vertex must only touch seam edges and a border vertex only border edges
+            uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+            uint32_t b = static_cast<uint32_t>(edge.first & 0xffffffffu);
+            if (edge.second)
+            {
+                complex[a] |= wedgeCount[a] != 1;
+                complex[b] |= wedgeCount[b] != 1;
+            }
+            else
+            {
+                complex[a] |= wedgeCount[a] != 2;
+                complex[b] |= wedgeCount[b] != 2;
+            }
+        }
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            if (canonical[i] != i || wedgeCount[i] == 0 || complex[i])
+            {
+                continue;
+            }
+            if (wedgeCount[i] == 1 && openOut[i] == 0 && openIn[i] == 0)
+            {
+                kind[i] = VertexKind::Manifold;
+            }
+            else if (wedgeCount[i] == 1 && openOut[i] == 1 && openIn[i] == 1)
+            {
+                kind[i] = VertexKind::Border;
+            }
+            else if (wedgeCount[i] == 2 && openOut[i] == 2 && openIn[i] == 2)
+            {
+                kind[i] = VertexKind::Seam;
+            }
+        }
+
+        // 3. area weighted plane quadrics, plus perpendicular planes along borders
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            glm::vec3 p0 = vertices[indices[i + 0]].position;
+            glm::vec3 p1 = vertices[indices[i + 1]].position;
+            glm::vec3 p2 = vertices[indices[i + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            if (area <= 0.0f)
+            {
+                continue;
+            }
+            normal = normal / area;
+            double d = -glm::dot(normal, p0);
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                quadrics[canonical[indices[i + k]]].AddPlane(normal, d, area * 0.5);
+            }
+
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t a = canonical[indices[i + k]];
+                uint32_t b = canonical[indices[i + (k + 1) % 3]];
+                auto open = openEdges.find(edgeKey(a, b));
+                if (open == openEdges.end() || !open->second)
+                {
+                    continue;
+                }
+
+                glm::vec3 edge = vertices[b].position - vertices[a].position;
+                float length = glm::length(edge);
+                if (length <= 0.0f)
+                {
+                    continue;
+                }
+                glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                double edgeD = -glm::dot(edgeNormal, vertices[a].position);
+                quadrics[a].AddPlane(edgeNormal, edgeD, length * length * BorderWeight);
+                quadrics[b].AddPlane(edgeNormal, edgeD, length * length * BorderWeight);
+            }
+        }
+
+        float scale = ComputeMeshScale(vertices, vertexCount);
+        double errorLimit = double(targetError) * scale * double(targetError) * scale;
+        double maxError = 0.0;
+
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> wedgeTarget(vertexCount);
+        std::vector<uint8_t> touched(vertexCount);
+
+        auto position = [&](uint32_t c)
+        {
+            return vertices[c].position;
+        };
+
+        // would moving canonical vertex c0 onto c1 flip or degenerate any remaining triangle around it
+        auto flips = [&](uint32_t c0, uint32_t c1)
+        {
+            glm::vec3 target = position(c1);
+            for (uint32_t a = adjacencyOffset[c0]; a < adjacencyOffset[c0 + 1]; a++)
+            {
+                uint32_t t = adjacency[a];
+                uint32_t c[3] = {canonical[result[t * 3 + 0]], canonical[result[t * 3 + 1]], canonical[result[t * 3 + 2]]};
+                if (c[0] == c1 || c[1] == c1 || c[2] == c1)
+                {
+                    continue;
+                }
+
+                glm::vec3 p[3] = {position(c[0]), position(c[1]), position(c[2])};
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    if (c[k] == c0)
+                    {
+                        p[k] = target;
+                    }
+                }
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+                if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // borders and seams may only slide along themselves
+        auto canCollapse = [&](uint32_t c0, uint32_t c1)
+        {
+            switch (kind[c0])
+            {
+            case VertexKind::Manifold:
+                return true;
+            case VertexKind::Border:
+            case VertexKind::Seam:
+                return openEdges.count(edgeKey(c0, c1)) != 0 || openEdges.count(edgeKey(c1, c0)) != 0;
+            default:
+                return false;
+            }
+        };
+
+        // maps every wedge of c0 to the wedge of c1 it shares a triangle with, fails if that is ambiguous
+        auto mapWedges = [&](uint32_t c0, uint32_t c1, uint32_t (&from)[2], uint32_t (&to)[2])
+        {
+            uint32_t count = 0;
+            for (uint32_t a = adjacencyOffset[c0]; a < adjacencyOffset[c0 + 1]; a++)
+            {
+                uint32_t t = adjacency[a];
+                uint32_t w0 = ~0u;
+                uint32_t w1 = ~0u;
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t w = result[t * 3 + k];
+                    if (canonical[w] == c0)
+                    {
+                        w0 = w;
+                    }
+                    else if (canonical[w] == c1)
+                    {
+                        w1 = w;
+                    }
+                }
+                if (w1 == ~0u)
+                {
+                    continue;
+                }
+
+                bool known = false;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    if (from[i] == w0)
+                    {
+                        if (to[i] != w1)
+                        {
+                            return false;
+                        }
+                        known = true;
+                    }
+                }
+                if (!known)
+                {
+                    if (count == 2)
+                    {
+                        return false;
+                    }
+                    from[count] = w0;
+                    to[count] = w1;
+                    count++;
+                }
+            }
+            return count == wedgeCount[c0];
+        };
+
+        while (result.size() > targetIndexCount)
+        {
+            uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+            // canonical vertex -> triangle adjacency
+            std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+            for (uint32_t index : result)
+            {
+                adjacencyOffset[canonical[index] + 1]++;
+            }
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                adjacencyOffset[i + 1] += adjacencyOffset[i];
+            }
+            adjacency.resize(result.size());
+            {
+                std::vector<uint32_t> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+                for (uint32_t t = 0; t < triangleCount; t++)
+                {
+                    for (uint32_t k = 0; k < 3; k++)
+                    {
+                        adjacency[cursor[canonical[result[t * 3 + k]]]++] = t;
+                    }
+                }
+            }
+
+            collapses.clear();
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t c0 = canonical[result[t * 3 + k]];
+                    uint32_t c1 = canonical[result[t * 3 + (k + 1) % 3]];
+                    if (c0 == c1)
+                    {
+                        continue;
+                    }
+
+                    Quadric q = quadrics[c0];
+                    q.Add(quadrics[c1]);
+                    if (canCollapse(c0, c1))
+                    {
+                        collapses.push_back({c0, c1, q.Evaluate(position(c1))});
+                    }
+                    if (canCollapse(c1, c0))
+                    {
+                        collapses.push_back({c1, c0, q.Evaluate(position(c0))});
+                    }
+                }
+            }
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+                      { return a.error < b.error; });
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                wedgeTarget[i] = i;
+            }
+            std::fill(touched.begin(), touched.end(), 0);
+
+            size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            size_t applied = 0;
+
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.error > errorLimit || removed >= trianglesToRemove)
+                {
+                    break;
+                }
+
+                uint32_t c0 = collapse.from;
+                uint32_t c1 = collapse.to;
+                uint32_t fromWedges[2];
+                uint32_t toWedges[2];
+                if (touched[c0] || touched[c1] || !mapWedges(c0, c1, fromWedges, toWedges) || flips(c0, c1))
+                {
+                    continue;
+                }
+
+                // the fan around c0 is frozen for the rest of the pass so flip checks stay valid
+                for (uint32_t a = adjacencyOffset[c0]; a < adjacencyOffset[c0 + 1]; a++)
+                {
+                    uint32_t t = adjacency[a];
+                    bool shared = false;
+                    for (uint32_t k = 0; k < 3; k++)
+                    {
+                        uint32_t c = canonical[result[t * 3 + k]];
+                        touched[c] = 1;
+                        shared |= (c == c1);
+                    }
+                    removed += shared ? 1 : 0;
+                }
+
+                for (uint32_t i = 0; i < wedgeCount[c0]; i++)
+                {
+                    wedgeTarget[fromWedges[i]] = toWedges[i];
+                }
+                quadrics[c1].Add(quadrics[c0]);
+                maxError = std::max(maxError, collapse.error);
+                applied++;
+            }
+
+            if (applied == 0)
+            {
+                break;
+            }
+
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                uint32_t a = wedgeTarget[result[i + 0]];
+                uint32_t b = wedgeTarget[result[i + 1]];
+                uint32_t c = wedgeTarget[result[i + 2]];
+                if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+                {
+                    continue;
+                }
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError && scale > 0.0f)
+        {
+            *resultError = static_cast<float>(std::sqrt(maxError) / scale);
+        }
+    }
+}
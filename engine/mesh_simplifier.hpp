@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_data.hpp"
+
+namespace engine
+{
+    // Quadric error edge-collapse simplifier. Vertices only ever collapse onto existing vertices,
+    // so the result indexes the same vertex buffer. Borders and attribute seams are kept intact.
+    // targetError is relative to the mesh extent; the achieved relative error is written to resultError.
+    void SimplifyMesh(const uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                      size_t targetIndexCount, float targetError, std::vector<uint32_t> &result, float *resultError);
+
+    // Scale used to turn relative simplification errors into model units
+    float ComputeMeshScale(const Vertex *vertices, size_t vertexCount);
+}
@@ -0,0 +1,318 @@
+#include "meshlet_builder.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace engine
+{
+    namespace
+    {
+        // how much a triangle facing away from the meshlet normal costs, relative to one extra vertex
+        constexpr float ConeWeight = 0.5f;
+
+        MeshletBounds computeBounds(const MeshletData &data, const Meshlet &meshlet, const Vertex *vertices)
+        {
+            MeshletBounds bounds = {};
+
+            const uint32_t *meshletVertices = data.vertices.data() + meshlet.vertexOffset;
+            glm::vec3 minPosition = vertices[meshletVertices[0]].position;
+            glm::vec3 maxPosition = minPosition;
+            for (uint32_t i = 1; i < meshlet.vertexCount; i++)
+            {
+                minPosition = glm::min(minPosition, vertices[meshletVertices[i]].position);
+                maxPosition = glm::max(maxPosition, vertices[meshletVertices[i]].position);
+            }
+
+            bounds.center = (minPosition + maxPosition) * 0.5f;
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            {
+                bounds.radius = std::max(bounds.radius, glm::length(vertices[meshletVertices[i]].position - bounds.center));
+            }
+
+            // normal cone around the average face normal
+            std::vector<glm::vec3> normals;
+            normals.reserve(meshlet.triangleCount);
+            glm::vec3 axis(0.0f);
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+            {
+                uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+                glm::vec3 p0 = vertices[meshletVertices[packed & 0xff]].position;
+                glm::vec3 p1 = vertices[meshletVertices[(packed >> 8) & 0xff]].position;
+                glm::vec3 p2 = vertices[meshletVertices[(packed >> 16) & 0xff]].position;
+
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                if (area <= 0.0f)
+                {
+                    continue;
+                }
+                normals.push_back(normal / area);
+                axis += normal / area;
+            }
+
+            bounds.coneCutoff = 1.0f;
+            float axisLength = glm::length(axis);
+            if (normals.empty() || axisLength <= 0.0f)
+            {
+                return bounds;
+            }
+            axis = axis / axisLength;
+
+            float minDot = 1.0f;
+            for (auto &normal : normals)
+            {
+                minDot = std::min(minDot, glm::dot(normal, axis));
+            }
+
+            bounds.coneAxis = axis;
+            // a cone wider than ~85 degrees never culls anything useful
+            if (minDot > 0.1f)
+            {
+                bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+            }
+
+            return bounds;
+        }
+
+        glm::vec3 triangleNormal(const uint32_t *triangle, const Vertex *vertices)
+        {
+            glm::vec3 p0 = vertices[triangle[0]].position;
+            glm::vec3 normal = glm::cross(vertices[triangle[1]].position - p0, vertices[triangle[2]].position - p0);
+            float area = glm::length(normal);
+            return area > 0.0f ? normal / area : glm::vec3(0.0f);
+        }
+    }
+
+    void BuildMeshlets(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                       const std::vector<uint32_t> &breaks, uint32_t maxVertices, uint32_t maxTriangles, MeshletData &result)
+    {
+        result = {};
+        maxVertices = std::min(std::max(maxVertices, 3u), 256u);
+        maxTriangles = std::max(maxTriangles, 1u);
+
+        size_t triangleCount = indexCount / 3;
+
+        // vertices split by uv or color seams still count as neighbours
+        std::vector<uint32_t> positionRemap(vertexCount);
+        std::unordered_map<uint64_t, uint32_t> positionLookup;
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &vertices[v].position, sizeof(bits));
+            uint64_t key = (static_cast<uint64_t>(bits[0]) * 73856093u) ^ (static_cast<uint64_t>(bits[1]) * 19349663u << 16) ^
+                           (static_cast<uint64_t>(bits[2]) * 83492791u << 32);
+            auto it = positionLookup.find(key);
+            if (it != positionLookup.end() && vertices[it->second].position == vertices[v].position)
+            {
+                positionRemap[v] = it->second;
+            }
+            else
+            {
+                positionLookup.emplace(key, static_cast<uint32_t>(v));
+                positionRemap[v] = static_cast<uint32_t>(v);
+            }
+        }
+
+        // position -> triangle adjacency
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            adjacencyOffsets[positionRemap[indices[i]] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            adjacency[fill[positionRemap[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        std::vector<glm::vec3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            normals[t] = triangleNormal(indices + t * 3, vertices);
+        }
+
+        constexpr uint32_t Unused = ~0u;
+        std::vector<uint32_t> localIndex(vertexCount, Unused);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> order;
+        order.reserve(triangleCount);
+
+        Meshlet current = {0, 0, 0, 0};
+        glm::vec3 normalSum(0.0f);
+
+        auto flush = [&]()
+        {
+            if (current.triangleCount == 0)
+            {
+                return;
+            }
+
+            for (uint32_t i = 0; i < current.vertexCount; i++)
+            {
+                localIndex[result.vertices[current.vertexOffset + i]] = Unused;
+            }
+
+            result.meshlets.push_back(current);
+            result.bounds.push_back(computeBounds(result, current, vertices));
+
+            current.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+            current.triangleOffset = static_cast<uint32_t>(result.triangles.size());
+            current.vertexCount = 0;
+            current.triangleCount = 0;
+            normalSum = glm::vec3(0.0f);
+        };
+
+        auto newVertexCount = [&](uint32_t triangle)
+        {
+            const uint32_t *corners = indices + triangle * 3;
+            return static_cast<uint32_t>(localIndex[corners[0]] == Unused) + (localIndex[corners[1]] == Unused) +
+                   (localIndex[corners[2]] == Unused);
+        };
+
+        auto emit = [&](uint32_t triangle)
+        {
+            uint32_t local[3];
+            const uint32_t *corners = indices + triangle * 3;
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t &slot = localIndex[corners[k]];
+                if (slot == Unused)
+                {
+                    slot = current.vertexCount++;
+                    result.vertices.push_back(corners[k]);
+                }
+                local[k] = slot;
+            }
+
+            result.triangles.push_back(local[0] | (local[1] << 8) | (local[2] << 16));
+            current.triangleCount++;
+            normalSum += normals[triangle];
+            emitted[triangle] = true;
+            order.push_back(triangle);
+        };
+
+        // every range between two breaks is partitioned on its own
+        std::vector<size_t> rangeStarts;
+        for (uint32_t start : breaks)
+        {
+            if (start % 3 == 0 && start / 3 < triangleCount)
+            {
+                rangeStarts.push_back(start / 3);
+            }
+        }
+        rangeStarts.push_back(0);
+        rangeStarts.push_back(triangleCount);
+        std::sort(rangeStarts.begin(), rangeStarts.end());
+        rangeStarts.erase(std::unique(rangeStarts.begin(), rangeStarts.end()), rangeStarts.end());
+
+        for (size_t r = 0; r + 1 < rangeStarts.size(); r++)
+        {
+            size_t rangeBegin = rangeStarts[r];
+            size_t rangeEnd = rangeStarts[r + 1];
+            size_t cursor = rangeBegin;
+
+            while (true)
+            {
+                // grow over triangles touching the current meshlet, preferring few new vertices and a tight normal cone
+                uint32_t best = Unused;
+                float bestCost = 0.0f;
+                glm::vec3 axis = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : glm::vec3(0.0f);
+                for (uint32_t i = 0; i < current.vertexCount; i++)
+                {
+                    uint32_t vertex = positionRemap[result.vertices[current.vertexOffset + i]];
+                    for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+                    {
+                        uint32_t triangle = adjacency[a];
+                        if (emitted[triangle] || triangle < rangeBegin || triangle >= rangeEnd)
+                        {
+                            continue;
+                        }
+
+                        uint32_t extra = newVertexCount(triangle);
+                        if (current.vertexCount + extra > maxVertices)
+                        {
+                            continue;
+                        }
+
+                        float cost = static_cast<float>(extra) + ConeWeight * (1.0f - glm::dot(normals[triangle], axis));
+                        if (best == Unused || cost < bestCost)
+                        {
+                            best = triangle;
+                            bestCost = cost;
+                        }
+                    }
+                }
+
+                if (best == Unused || current.triangleCount >= maxTriangles)
+                {
+                    // continue with the first triangle not emitted yet, which keeps input locality
+                    while (cursor < rangeEnd && emitted[cursor])
+                    {
+                        cursor++;
+                    }
+
+                    bool fits = cursor < rangeEnd && current.triangleCount < maxTriangles &&
+                                current.vertexCount + newVertexCount(static_cast<uint32_t>(cursor)) <= maxVertices;
+                    if (!fits)
+                    {
+                        flush();
+                    }
+                    if (cursor == rangeEnd)
+                    {
+                        break;
+                    }
+                    best = static_cast<uint32_t>(cursor);
+                }
+
+                emit(best);
+            }
+        }
+
+        flush();
+
+        // rewrite the triangles in meshlet order so every meshlet is a contiguous index range
+        std::vector<uint32_t> reordered(triangleCount * 3);
+        for (size_t t = 0; t < order.size(); t++)
+        {
+            std::copy(indices + order[t] * 3, indices + order[t] * 3 + 3, reordered.begin() + t * 3);
+        }
+        std::copy(reordered.begin(), reordered.end(), indices);
+
+        // the meshlet order breaks up the vertex cache order of the optimizer, so it is redone within each meshlet
+        // and the local triangles are repacked to match
+        for (const Meshlet &meshlet : result.meshlets)
+        {
+            uint32_t *meshletIndices = indices + static_cast<size_t>(meshlet.triangleOffset) * 3;
+            OptimizeVertexCache(meshletIndices, static_cast<size_t>(meshlet.triangleCount) * 3);
+
+            const uint32_t *meshletVertices = result.vertices.data() + meshlet.vertexOffset;
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            {
+                localIndex[meshletVertices[i]] = i;
+            }
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+            {
+                const uint32_t *corners = meshletIndices + t * 3;
+                result.triangles[meshlet.triangleOffset + t] = localIndex[corners[0]] | (localIndex[corners[1]] << 8) | (localIndex[corners[2]] << 16);
+            }
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            {
+                localIndex[meshletVertices[i]] = Unused;
+            }
+        }
+    }
+
+    bool IsMeshletBackfacing(const MeshletBounds &bounds, const glm::vec3 &eye)
+    {
+        glm::vec3 toCenter = bounds.center - eye;
+        return glm::dot(toCenter, bounds.coneAxis) >= bounds.coneCutoff * glm::length(toCenter) + bounds.radius;
+    }
+}
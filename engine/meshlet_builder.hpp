@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_data.hpp"
+
+namespace engine
+{
+    constexpr uint32_t MeshletMaxVertices = 64;
+    constexpr uint32_t MeshletMaxTriangles = 124;
+
+    // BuildMeshlets reorders the triangles of the index buffer to meshlet order, so meshlet i covers triangles
+    // [triangleOffset, triangleOffset + triangleCount) and can be drawn straight from that index buffer.
+    // Within a meshlet the triangles are reordered for the vertex cache again.
+    struct Meshlet
+    {
+        uint32_t vertexOffset;   // into MeshletData::vertices
+        uint32_t triangleOffset; // into MeshletData::triangles
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    // Two vec4s so the array can be bound as a std430 storage buffer as is.
+    // Backface cluster test: dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+    struct MeshletBounds
+    {
+        glm::vec3 center;
+        float radius;
+        glm::vec3 coneAxis;
+        float coneCutoff; // 1 disables the cone test
+    };
+
+    struct MeshletData
+    {
+        std::vector<Meshlet> meshlets;
+        std::vector<MeshletBounds> bounds;
+        std::vector<uint32_t> vertices;  // global vertex index per meshlet-local vertex
+        std::vector<uint32_t> triangles; // three 8 bit meshlet-local indices per triangle
+    };
+
+    // Greedily grows meshlets over shared vertices, favouring triangles that keep the normal cone tight.
+    // Triangles never move across breaks, index positions (e.g. submesh starts) where a new meshlet has to begin.
+    void BuildMeshlets(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                       const std::vector<uint32_t> &breaks, uint32_t maxVertices, uint32_t maxTriangles, MeshletData &result);
+
+    bool IsMeshletBackfacing(const MeshletBounds &bounds, const glm::vec3 &eye);
+}
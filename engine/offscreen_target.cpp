@@ -0,0 +1,132 @@
+#include "offscreen_target.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine
+{
+    OffscreenTarget::OffscreenTarget(const Context *context, GpuAllocator *allocator, uint32_t width, uint32_t height, uint32_t frameCount)
+        : context(context), allocator(allocator), width(width), height(height), targets(frameCount)
+    {
+        for (auto &target : targets)
+        {
+            vk::ImageCreateInfo imageInfo;
+            imageInfo.setImageType(vk::ImageType::e2D)
+                .setFormat(ColorFormat)
+                .setExtent(vk::Extent3D(width, height, 1))
+                .setMipLevels(1)
+                .setArrayLayers(1)
+                .setSamples(vk::SampleCountFlagBits::e1)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setInitialLayout(vk::ImageLayout::eUndefined);
+            target.image = context->device.createImage(imageInfo);
+            target.imageMemory = allocator->AllocateImage(target.image, vk::ImageTiling::eOptimal, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+            vk::ImageViewCreateInfo viewInfo;
+            viewInfo.setImage(target.image)
+                .setViewType(vk::ImageViewType::e2D)
+                .setFormat(ColorFormat)
+                .setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+            target.view = context->device.createImageView(viewInfo);
+
+            // coherent, so the mapped pixels need no invalidate after the fence
+            vk::BufferCreateInfo bufferInfo;
+            bufferInfo.setSize(static_cast<vk::DeviceSize>(width) * height * 4)
+                .setUsage(vk::BufferUsageFlagBits::eTransferDst)
+                .setSharingMode(vk::SharingMode::eExclusive);
+            target.buffer = context->device.createBuffer(bufferInfo);
+            target.bufferMemory = allocator->AllocateBuffer(target.buffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        }
+    }
+
+    OffscreenTarget::~OffscreenTarget()
+    {
+        for (auto &target : targets)
+        {
+            context->device.destroyBuffer(target.buffer);
+            allocator->Free(target.bufferMemory);
+            context->device.destroyImageView(target.view);
+            context->device.destroyImage(target.image);
+            allocator->Free(target.imageMemory);
+        }
+    }
+
+    void OffscreenTarget::RecordReadback(vk::CommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameNumber)
+    {
+        Target &target = targets[frameIndex];
+
+        vk::BufferImageCopy region;
+        region.setBufferOffset(0)
+            .setBufferRowLength(0)
+            .setBufferImageHeight(0)
+            .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+            .setImageExtent(vk::Extent3D(width, height, 1));
+        commandBuffer.copyImageToBuffer(target.image, vk::ImageLayout::eTransferSrcOptimal, target.buffer, region);
+
+        // the fence wait alone does not make transfer writes visible to the host
+        vk::BufferMemoryBarrier barrier;
+        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eHostRead)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setBuffer(target.buffer)
+            .setOffset(0)
+            .setSize(VK_WHOLE_SIZE);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, barrier, nullptr);
+
+        target.pending = true;
+        target.frameNumber = frameNumber;
+    }
+
+    void OffscreenTarget::Collect(uint32_t frameIndex, const ReadbackFunction &onReadback)
+    {
+        Target &target = targets[frameIndex];
+        if (!target.pending)
+        {
+            return;
+        }
+        target.pending = false;
+
+        if (onReadback)
+        {
+            ReadbackImage image;
+            image.frame = target.frameNumber;
+            image.width = width;
+            image.height = height;
+            image.pixels = static_cast<const uint8_t *>(target.bufferMemory.mapped);
+            onReadback(image);
+        }
+    }
+
+    void OffscreenTarget::Flush(const ReadbackFunction &onReadback)
+    {
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < targets.size(); i++)
+        {
+            if (targets[i].pending)
+            {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                  { return targets[a].frameNumber < targets[b].frameNumber; });
+
+        for (uint32_t frameIndex : order)
+        {
+            Collect(frameIndex, onReadback);
+        }
+    }
+
+    void OffscreenTarget::WritePng(const std::string &path, const ReadbackImage &image)
+    {
+        if (!stbi_write_png(path.c_str(), image.width, image.height, 4, image.pixels, image.width * 4))
+        {
+            throw std::runtime_error("Failed to write " + path);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "context.hpp"
+#include "gpu_allocator.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace engine
+{
+    // One frame copied back to host memory, tightly packed RGBA8 rows. pixels is only valid inside the callback
+    struct ReadbackImage
+    {
+        uint64_t frame = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        const uint8_t *pixels = nullptr;
+    };
+
+    using ReadbackFunction = std::function<void(const ReadbackImage &)>;
+
+    // The color targets of headless rendering, one per frame in flight so a frame never overwrites an image
+    // the previous one is still copying out. Each target has a host visible buffer it is read back into,
+    // which is handed out once the frame's fence has signaled, so readback never stalls the GPU.
+    class OffscreenTarget final
+    {
+    public:
+        static constexpr vk::Format ColorFormat = vk::Format::eR8G8B8A8Unorm;
+
+        OffscreenTarget(const Context *context, GpuAllocator *allocator, uint32_t width, uint32_t height, uint32_t frameCount);
+        ~OffscreenTarget();
+
+        OffscreenTarget(const OffscreenTarget &) = delete;
+        OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+        // Copies the target of frameIndex into its readback buffer. Record after the render pass,
+        // which must leave the image in eTransferSrcOptimal
+        void RecordReadback(vk::CommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameNumber);
+
+        // Hands the readback of frameIndex to onReadback if one is pending. The caller must have waited for that frame's fence
+        void Collect(uint32_t frameIndex, const ReadbackFunction &onReadback);
+        // Collects every pending readback in frame order, the caller must have waited for the device to idle
+        void Flush(const ReadbackFunction &onReadback);
+
+        // Throws when the file cannot be written
+        static void WritePng(const std::string &path, const ReadbackImage &image);
+
+        vk::ImageView get_view(uint32_t frameIndex) const { return targets[frameIndex].view; }
+        uint32_t get_width() const { return width; }
+        uint32_t get_height() const { return height; }
+
+    private:
+        struct Target
+        {
+            vk::Image image;
+            GpuAllocation imageMemory;
+            vk::ImageView view;
+            vk::Buffer buffer;
+            GpuAllocation bufferMemory;
+            bool pending = false;
+            uint64_t frameNumber = 0;
+        };
+
+        const Context *context;
+        GpuAllocator *allocator;
+        uint32_t width;
+        uint32_t height;
+        std::vector<Target> targets;
+    };
+}
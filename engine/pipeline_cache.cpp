@@ -0,0 +1,150 @@
+#include "pipeline_cache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace engine
+{
+    PipelineCache::PipelineCache(vk::PhysicalDevice phyDevice, vk::Device device, const std::string &path, bool creationFeedback)
+        : phyDevice(phyDevice), device(device), path(path), creationFeedback(creationFeedback)
+    {
+        std::vector<char> data;
+        std::ifstream in(path, std::ios::binary);
+        if (in.is_open())
+        {
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        loaded = isCompatible(data);
+        if (!loaded && !data.empty())
+        {
+            std::cout << "Discarding pipeline cache " << path << ": created by another device or driver" << std::endl;
+        }
+
+        vk::PipelineCacheCreateInfo createInfo;
+        if (loaded)
+        {
+            createInfo.setInitialDataSize(data.size())
+                .setPInitialData(data.data());
+        }
+        cache = device.createPipelineCache(createInfo);
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        if (!Save())
+        {
+            std::cout << "Failed to write pipeline cache: " << path << std::endl;
+        }
+        device.destroyPipelineCache(cache);
+    }
+
+    bool PipelineCache::isCompatible(const std::vector<char> &data) const
+    {
+        VkPipelineCacheHeaderVersionOne header;
+        if (data.size() < sizeof(header))
+        {
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+
+        vk::PhysicalDeviceProperties properties = phyDevice.getProperties();
+        return header.headerSize >= sizeof(header) &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID &&
+               header.deviceID == properties.deviceID &&
+               memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+    }
+
+    vk::Pipeline PipelineCache::CreateGraphicsPipeline(vk::GraphicsPipelineCreateInfo createInfo)
+    {
+        vk::PipelineCreationFeedback feedback;
+        std::vector<vk::PipelineCreationFeedback> stageFeedbacks(createInfo.stageCount);
+        vk::PipelineCreationFeedbackCreateInfo feedbackInfo;
+        if (creationFeedback)
+        {
+            feedbackInfo.setPPipelineCreationFeedback(&feedback)
+                .setPipelineStageCreationFeedbacks(stageFeedbacks)
+                .setPNext(createInfo.pNext);
+            createInfo.setPNext(&feedbackInfo);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        auto result = device.createGraphicsPipeline(cache, createInfo);
+        auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        if (result.result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        createMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid))
+        {
+            unknown++;
+        }
+        else if (feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit)
+        {
+            hits++;
+        }
+        else
+        {
+            misses++;
+        }
+
+        return result.value;
+    }
+
+    bool PipelineCache::Save()
+    {
+        std::vector<uint8_t> data = device.getPipelineCacheData(cache);
+        if (data.empty())
+        {
+            return true;
+        }
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                return false;
+            }
+
+            out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!out.good())
+            {
+                out.close();
+                std::remove(tmpPath.c_str());
+                return false;
+            }
+        }
+
+        // rename replaces the old file atomically on POSIX, Windows needs it gone first
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    PipelineCacheStats PipelineCache::GetStats() const
+    {
+        PipelineCacheStats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.unknown = unknown;
+        stats.createMilliseconds = createMicroseconds / 1000.0;
+        stats.loaded = loaded;
+        return stats;
+    }
+}
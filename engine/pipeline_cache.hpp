@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <atomic>
+#include <string>
+
+namespace engine
+{
+    struct PipelineCacheStats
+    {
+        uint32_t hits;
+        uint32_t misses;
+        // creation feedback was unavailable, the pipeline counts as neither
+        uint32_t unknown;
+        double createMilliseconds;
+        bool loaded;
+    };
+
+    // VkPipelineCache backed by a file. The file is only handed to the driver when its header matches
+    // this device's vendor, device and pipeline cache UUID, and is replaced atomically on destruction.
+    class PipelineCache final
+    {
+    public:
+        // without creationFeedback every pipeline counts as unknown
+        PipelineCache(vk::PhysicalDevice phyDevice, vk::Device device, const std::string &path, bool creationFeedback);
+        ~PipelineCache();
+
+        PipelineCache(const PipelineCache &) = delete;
+        PipelineCache &operator=(const PipelineCache &) = delete;
+
+        // Creates through the cache and records whether the driver reported a cache hit. Thread safe
+        vk::Pipeline CreateGraphicsPipeline(vk::GraphicsPipelineCreateInfo createInfo);
+
+        bool Save();
+
+        vk::PipelineCache get() const { return cache; }
+        PipelineCacheStats GetStats() const;
+
+    private:
+        vk::PhysicalDevice phyDevice;
+        vk::Device device;
+        std::string path;
+        bool creationFeedback;
+        vk::PipelineCache cache;
+        bool loaded = false;
+
+        std::atomic<uint32_t> hits{0};
+        std::atomic<uint32_t> misses{0};
+        std::atomic<uint32_t> unknown{0};
+        std::atomic<uint64_t> createMicroseconds{0};
+
+        bool isCompatible(const std::vector<char> &data) const;
+    };
+}
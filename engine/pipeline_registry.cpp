@@ -0,0 +1,229 @@
+#include "pipeline_registry.hpp"
+#include "render_process.hpp"
+#include "hash.hpp"
+
+#include <vector>
+
+namespace engine
+{
+    bool RenderState::operator==(const RenderState &other) const
+    {
+        return topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode &&
+               frontFace == other.frontFace && depthTest == other.depthTest && depthWrite == other.depthWrite &&
+               depthCompare == other.depthCompare && blend == other.blend;
+    }
+
+    uint64_t PipelineKey::Hash() const
+    {
+        // field by field, so padding never reaches the hash
+        uint64_t hash = HashValue(static_cast<VkShaderModule>(vertexShader));
+        hash = HashCombine(hash, HashValue(static_cast<VkShaderModule>(fragmentShader)));
+        hash = HashCombine(hash, HashValue(vertexLayout));
+        hash = HashCombine(hash, HashValue(vertexInputMask));
+        hash = HashCombine(hash, HashValue(state.topology));
+        hash = HashCombine(hash, HashValue(state.polygonMode));
+        hash = HashCombine(hash, HashValue(static_cast<VkCullModeFlags>(state.cullMode)));
+        hash = HashCombine(hash, HashValue(state.frontFace));
+        hash = HashCombine(hash, HashValue(state.depthTest));
+        hash = HashCombine(hash, HashValue(state.depthWrite));
+        hash = HashCombine(hash, HashValue(state.depthCompare));
+        hash = HashCombine(hash, HashValue(state.blend));
+        hash = HashCombine(hash, HashValue(static_cast<VkPipelineLayout>(layout)));
+        hash = HashCombine(hash, HashValue(static_cast<VkRenderPass>(renderPass)));
+        hash = HashCombine(hash, HashValue(colorFormat));
+        hash = HashCombine(hash, HashValue(depthFormat));
+        return hash;
+    }
+
+    bool PipelineKey::operator==(const PipelineKey &other) const
+    {
+        return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader &&
+               vertexLayout == other.vertexLayout && vertexInputMask == other.vertexInputMask && state == other.state && layout == other.layout &&
+               renderPass == other.renderPass && colorFormat == other.colorFormat && depthFormat == other.depthFormat;
+    }
+
+    PipelineRegistry::PipelineRegistry(const Context *context, ThreadPool *threadPool, uint32_t framesInFlight)
+        : context(context), threadPool(threadPool), framesInFlight(framesInFlight)
+    {
+    }
+
+    PipelineRegistry::~PipelineRegistry()
+    {
+        for (auto &pair : entries)
+        {
+            collect(pair.second, true);
+            context->device.destroyPipeline(pair.second.pipeline);
+        }
+        for (RetiredEntry &old : retired)
+        {
+            collect(old.entry, true);
+            context->device.destroyPipeline(old.entry.pipeline);
+        }
+    }
+
+    PipelineRegistry::Entry &PipelineRegistry::find(const PipelineKey &key)
+    {
+        auto inserted = entries.try_emplace(key);
+        Entry &entry = inserted.first->second;
+        if (!inserted.second)
+        {
+            return entry;
+        }
+
+        const Context *context = this->context;
+        entry.compile = threadPool->Submit([context, key]()
+                                           { return RenderProcess::CreatePipeline(context, key); });
+        compilingCount++;
+        return entry;
+    }
+
+    void PipelineRegistry::collect(Entry &entry, bool wait)
+    {
+        if (!entry.compile.valid())
+        {
+            return;
+        }
+        if (!wait && entry.compile.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return;
+        }
+
+        entry.pipeline = entry.compile.get();
+        compilingCount--;
+        readyCount++;
+    }
+
+    vk::Pipeline PipelineRegistry::Request(const PipelineKey &key, PipelineFallback fallback)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry &entry = find(key);
+        collect(entry, false);
+
+        if (entry.pipeline)
+        {
+            return entry.pipeline;
+        }
+        // the default can only stand in when the bound descriptor sets match its layout
+        if (fallback == PipelineFallback::Skip || key.layout != defaultKey.layout)
+        {
+            return vk::Pipeline();
+        }
+
+        // the previous default stays in use until a replaced default has compiled
+        Entry &defaultEntry = find(defaultKey);
+        collect(defaultEntry, false);
+        if (defaultEntry.pipeline)
+        {
+            setDefaultPipeline(defaultEntry.pipeline);
+        }
+        return defaultPipeline;
+    }
+
+    vk::Pipeline PipelineRegistry::Get(const PipelineKey &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry &entry = find(key);
+        collect(entry, true);
+        return entry.pipeline;
+    }
+
+    void PipelineRegistry::SetDefault(const PipelineKey &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.find(key) == entries.end())
+        {
+            Entry &entry = entries[key];
+            entry.pipeline = RenderProcess::CreatePipeline(context, key);
+            readyCount++;
+        }
+
+        Entry &entry = find(key);
+        collect(entry, true);
+        defaultKey = key;
+        setDefaultPipeline(entry.pipeline);
+    }
+
+    void PipelineRegistry::setDefaultPipeline(vk::Pipeline pipeline)
+    {
+        if (pipeline == defaultPipeline)
+        {
+            return;
+        }
+
+        // a retired default keeps standing in until its replacement is ready
+        for (RetiredEntry &old : retired)
+        {
+            if (old.entry.pipeline == defaultPipeline)
+            {
+                old.frame = frameNumber;
+            }
+        }
+        defaultPipeline = pipeline;
+    }
+
+    uint32_t PipelineRegistry::ReplaceModule(vk::ShaderModule from, vk::ShaderModule to)
+    {
+        if (from == to)
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<PipelineKey> keys;
+        for (auto &pair : entries)
+        {
+            if (pair.first.vertexShader == from || pair.first.fragmentShader == from)
+            {
+                keys.push_back(pair.first);
+            }
+        }
+
+        // command buffers in flight may still use the old variants, they are destroyed in BeginFrame()
+        for (const PipelineKey &key : keys)
+        {
+            PipelineKey replaced = key;
+            if (replaced.vertexShader == from)
+            {
+                replaced.vertexShader = to;
+            }
+            if (replaced.fragmentShader == from)
+            {
+                replaced.fragmentShader = to;
+            }
+
+            find(replaced);
+            if (key == defaultKey)
+            {
+                defaultKey = replaced;
+            }
+
+            auto it = entries.find(key);
+            retired.push_back({std::move(it->second), frameNumber});
+            entries.erase(it);
+        }
+        return static_cast<uint32_t>(keys.size());
+    }
+
+    void PipelineRegistry::BeginFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frameNumber++;
+
+        // Begin() has waited for the frame framesInFlight frames ago, a compile still running was never drawn with
+        for (auto it = retired.begin(); it != retired.end();)
+        {
+            collect(it->entry, false);
+            if (it->entry.compile.valid() || it->entry.pipeline == defaultPipeline || frameNumber < it->frame + framesInFlight)
+            {
+                ++it;
+                continue;
+            }
+            if (it->entry.pipeline)
+            {
+                context->device.destroyPipeline(it->entry.pipeline);
+                readyCount--;
+            }
+            it = retired.erase(it);
+        }
+    }
+}
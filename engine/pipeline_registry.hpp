@@ -0,0 +1,122 @@
+#pragma once
+
+#include "context.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace engine
+{
+    // Fixed function state that varies between materials, everything else is shared by all pipelines
+    struct RenderState
+    {
+        vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+        vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+        vk::CullModeFlags cullMode = vk::CullModeFlagBits::eBack;
+        vk::FrontFace frontFace = vk::FrontFace::eClockwise;
+        bool depthTest = true;
+        bool depthWrite = true;
+        vk::CompareOp depthCompare = vk::CompareOp::eLess;
+        bool blend = false;
+
+        bool operator==(const RenderState &other) const;
+    };
+
+    struct PipelineKey
+    {
+        vk::ShaderModule vertexShader;
+        vk::ShaderModule fragmentShader;
+        VertexLayout vertexLayout = VertexLayout::Float;
+        // reflected vertex shader inputs, attributes outside it are not declared
+        uint32_t vertexInputMask = 0;
+        RenderState state;
+        vk::PipelineLayout layout;
+        vk::RenderPass renderPass;
+        vk::Format colorFormat = vk::Format::eUndefined;
+        vk::Format depthFormat = vk::Format::eUndefined;
+
+        uint64_t Hash() const;
+        bool operator==(const PipelineKey &other) const;
+    };
+
+    struct PipelineKeyHasher
+    {
+        size_t operator()(const PipelineKey &key) const { return static_cast<size_t>(key.Hash()); }
+    };
+
+    enum class PipelineFallback
+    {
+        // the draw is dropped until its variant is ready
+        Skip,
+        // the draw uses the registry's default pipeline meanwhile, if it shares the pipeline layout
+        Default,
+    };
+
+    // Pipelines deduplicated by PipelineKey. A variant seen for the first time is compiled on the thread
+    // pool while the requesting draw gets the fallback, so new state combinations never stall a frame.
+    // Variants replaced by a shader reload are destroyed once the frames that may have drawn with them are done.
+    class PipelineRegistry final
+    {
+    public:
+        PipelineRegistry(const Context *context, ThreadPool *threadPool, uint32_t framesInFlight);
+        ~PipelineRegistry();
+
+        PipelineRegistry(const PipelineRegistry &) = delete;
+        PipelineRegistry &operator=(const PipelineRegistry &) = delete;
+
+        // Never blocks, returns a null handle for PipelineFallback::Skip while the variant compiles
+        vk::Pipeline Request(const PipelineKey &key, PipelineFallback fallback);
+        // Blocks until key is compiled
+        vk::Pipeline Get(const PipelineKey &key);
+
+        // Compiles key on the calling thread and uses it as the PipelineFallback::Default pipeline
+        void SetDefault(const PipelineKey &key);
+
+        // Queues a rebuild of every variant that uses from, with to in its place, and retires the old ones.
+        // The default pipeline switches over once its rebuild is done. Returns the number of variants queued
+        uint32_t ReplaceModule(vk::ShaderModule from, vk::ShaderModule to);
+
+        // Call right after FrameRing::Begin(), destroys retired pipelines no frame in flight can still use
+        void BeginFrame();
+
+        uint32_t get_pipeline_count() const { return readyCount; }
+        uint32_t get_compiling_count() const { return compilingCount; }
+
+    private:
+        struct Entry
+        {
+            vk::Pipeline pipeline;
+            std::future<vk::Pipeline> compile;
+        };
+
+        struct RetiredEntry
+        {
+            Entry entry;
+            // the last frame that may have drawn with it
+            uint64_t frame;
+        };
+
+        const Context *context;
+        ThreadPool *threadPool;
+        uint32_t framesInFlight;
+
+        std::mutex mutex;
+        // the hash only picks the bucket, keys are compared in full
+        std::unordered_map<PipelineKey, Entry, PipelineKeyHasher> entries;
+        PipelineKey defaultKey;
+        vk::Pipeline defaultPipeline;
+        std::vector<RetiredEntry> retired;
+        uint64_t frameNumber = 0;
+        std::atomic<uint32_t> readyCount{0};
+        std::atomic<uint32_t> compilingCount{0};
+
+        // expects mutex to be held
+        Entry &find(const PipelineKey &key);
+        void collect(Entry &entry, bool wait);
+        void setDefaultPipeline(vk::Pipeline pipeline);
+    };
+}
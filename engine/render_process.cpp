@@ -4,60 +4,97 @@
 
 namespace engine
 {
-    void RenderProcess::InitPipeline(const Shader *shader, int width, int height)
+    std::vector<vk::VertexInputAttributeDescription> RenderProcess::getVertexAttributes(VertexLayout vertexLayout, vk::VertexInputBindingDescription &binding)
+    {
+        binding.setBinding(0)
+            .setInputRate(vk::VertexInputRate::eVertex);
+
+        std::vector<vk::VertexInputAttributeDescription> attr(3);
+        attr[0].setBinding(0).setLocation(0);
+        attr[1].setBinding(0).setLocation(1);
+        attr[2].setBinding(0).setLocation(2);
+
+        if (vertexLayout == VertexLayout::Packed)
+        {
+            // unorm position is dequantized by the model matrix, the shader is shared with the float layout
+            binding.setStride(sizeof(PackedVertex));
+            attr[0].setFormat(vk::Format::eR16G16B16A16Unorm)
+                .setOffset(offsetof(PackedVertex, position));
+            attr[1].setFormat(vk::Format::eR8G8B8A8Unorm)
+                .setOffset(offsetof(PackedVertex, color));
+            attr[2].setFormat(vk::Format::eR16G16Sfloat)
+                .setOffset(offsetof(PackedVertex, texCoord));
+        }
+        else
+        {
+            binding.setStride(sizeof(Vertex));
+            attr[0].setFormat(vk::Format::eR32G32B32Sfloat)
+                .setOffset(offsetof(Vertex, position));
+            attr[1].setFormat(vk::Format::eR32G32B32A32Sfloat)
+                .setOffset(offsetof(Vertex, color));
+            attr[2].setFormat(vk::Format::eR32G32Sfloat)
+                .setOffset(offsetof(Vertex, texCoord));
+        }
+        return attr;
+    }
+
+    vk::Pipeline RenderProcess::CreatePipeline(const engine::Context *context, const PipelineKey &key)
     {
         vk::GraphicsPipelineCreateInfo pipelineInfo;
 
         // 1. vertex input
         vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
         vk::VertexInputBindingDescription binding;
-        binding.setBinding(0)
-            .setInputRate(vk::VertexInputRate::eVertex)
-            .setStride(sizeof(Vertex));
-
-        vk::VertexInputAttributeDescription attr[3];
-        attr[0].setBinding(0)
-            .setFormat(vk::Format::eR32G32B32Sfloat)
-            .setLocation(0)
-            .setOffset(offsetof(Vertex, position));
-        attr[1].setBinding(0)
-            .setFormat(vk::Format::eR32G32B32A32Sfloat)
-            .setLocation(1)
-            .setOffset(offsetof(Vertex, color));
-        attr[2].setBinding(0)
-            .setFormat(vk::Format::eR32G32Sfloat)
-            .setLocation(2)
-            .setOffset(offsetof(Vertex, texCoord));
+        std::vector<vk::VertexInputAttributeDescription> layoutAttributes = getVertexAttributes(key.vertexLayout, binding);
+
+        // only the locations the vertex shader reads
+        std::vector<vk::VertexInputAttributeDescription> attributes;
+        for (const auto &attribute : layoutAttributes)
+        {
+            if (key.vertexInputMask & (1u << attribute.location))
+            {
+                attributes.push_back(attribute);
+            }
+        }
 
         vertexInputInfo.setVertexBindingDescriptions(binding)
-            .setVertexAttributeDescriptions(attr);
+            .setVertexAttributeDescriptions(attributes);
 
         pipelineInfo.setPVertexInputState(&vertexInputInfo);
 
         // 2. vertex input assembly
         vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
         inputAssembly.setPrimitiveRestartEnable(VK_FALSE)
-            .setTopology(vk::PrimitiveTopology::eTriangleList);
+            .setTopology(key.state.topology);
         pipelineInfo.setPInputAssemblyState(&inputAssembly);
 
         // 3. shader
-        auto stages = shader->GetStage();
+        std::array<vk::PipelineShaderStageCreateInfo, 2> stages;
+        stages[0].setStage(vk::ShaderStageFlagBits::eVertex)
+            .setModule(key.vertexShader)
+            .setPName("main");
+        stages[1].setStage(vk::ShaderStageFlagBits::eFragment)
+            .setModule(key.fragmentShader)
+            .setPName("main");
         pipelineInfo.setStages(stages);
 
         // 4. viewport
         vk::PipelineViewportStateCreateInfo viewportInfo;
-        vk::Viewport viewport(0, 0, width, height, 0, 1);
-        viewportInfo.setViewports(viewport);
-        vk::Rect2D scissor({0, 0}, {static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
-        viewportInfo.setScissors(scissor);
+        viewportInfo.setViewportCount(1)
+            .setScissorCount(1);
         pipelineInfo.setPViewportState(&viewportInfo);
 
+        std::array<vk::DynamicState, 2> dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+        vk::PipelineDynamicStateCreateInfo dynamicInfo;
+        dynamicInfo.setDynamicStates(dynamicStates);
+        pipelineInfo.setPDynamicState(&dynamicInfo);
+
         // 5. Rasterization
         vk::PipelineRasterizationStateCreateInfo rasterizerInfo;
         rasterizerInfo.setRasterizerDiscardEnable(VK_FALSE)
-            .setCullMode(vk::CullModeFlagBits::eBack)
-            .setFrontFace(vk::FrontFace::eClockwise)
-            .setPolygonMode(vk::PolygonMode::eFill)
+            .setCullMode(key.state.cullMode)
+            .setFrontFace(key.state.frontFace)
+            .setPolygonMode(key.state.polygonMode)
             .setLineWidth(1.0f);
         pipelineInfo.setPRasterizationState(&rasterizerInfo);
 
@@ -69,9 +106,9 @@ namespace engine
 
         // 7. test - stencil, depth
         vk::PipelineDepthStencilStateCreateInfo depthStencilInfo;
-        depthStencilInfo.setDepthTestEnable(VK_TRUE)
-            .setDepthWriteEnable(VK_TRUE)
-            .setDepthCompareOp(vk::CompareOp::eLess)
+        depthStencilInfo.setDepthTestEnable(key.state.depthTest)
+            .setDepthWriteEnable(key.state.depthWrite)
+            .setDepthCompareOp(key.state.depthCompare)
             .setDepthBoundsTestEnable(VK_FALSE)
             .setMinDepthBounds(0.0f)
             .setMaxDepthBounds(1.0f)
@@ -81,7 +118,13 @@ namespace engine
         // 8. color blending
         vk::PipelineColorBlendStateCreateInfo colorBlendingInfo;
         vk::PipelineColorBlendAttachmentState colorBlendAttachment;
-        colorBlendAttachment.setBlendEnable(VK_FALSE)
+        colorBlendAttachment.setBlendEnable(key.state.blend)
+            .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+            .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+            .setColorBlendOp(vk::BlendOp::eAdd)
+            .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+            .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+            .setAlphaBlendOp(vk::BlendOp::eAdd)
             .setColorWriteMask(vk::ColorComponentFlagBits::eA |
                                vk::ColorComponentFlagBits::eB |
                                vk::ColorComponentFlagBits::eG |
@@ -92,32 +135,20 @@ namespace engine
         pipelineInfo.setPColorBlendState(&colorBlendingInfo);
 
         // 9. renderPass and layout
-        pipelineInfo.setRenderPass(renderPass)
-            .setLayout(layout);
+        pipelineInfo.setRenderPass(key.renderPass)
+            .setLayout(key.layout);
 
         // result
-        auto result = context->device.createGraphicsPipeline(nullptr, pipelineInfo);
-        if (result.result != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
-        pipeline = result.value;
+        return context->pipelineCache->CreateGraphicsPipeline(pipelineInfo);
     }
 
-    void RenderProcess::InitLayout()
-    {
-        vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-        pipelineLayoutInfo.setSetLayouts(context->descriptorSetLayout);
-        layout = context->device.createPipelineLayout(pipelineLayoutInfo);
-    }
-
-    void RenderProcess::InitRenderPass(const Swapchain *swapchain, vk::Format depthFormat)
+    void RenderProcess::InitRenderPass(vk::Format colorFormat, vk::Format depthFormat, vk::ImageLayout finalLayout)
     {
         vk::RenderPassCreateInfo renderPassInfo;
         vk::AttachmentDescription attachDesc;
-        attachDesc.setFormat(swapchain->swapchainInfo.format.format)
+        attachDesc.setFormat(colorFormat)
             .setInitialLayout(vk::ImageLayout::eUndefined)
-            .setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
+            .setFinalLayout(finalLayout)
             .setLoadOp(vk::AttachmentLoadOp::eClear)
             .setStoreOp(vk::AttachmentStoreOp::eStore)
             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
@@ -148,28 +179,68 @@ namespace engine
             .setPColorAttachments(&attachRef)
             .setPDepthStencilAttachment(&depthRef);
 
+        // the depth image is shared by every frame in flight, so its clear waits for the previous frame's tests
         vk::SubpassDependency dependency;
         dependency.setSrcSubpass(VK_SUBPASS_EXTERNAL)
             .setDstSubpass(0)
-            .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+            .setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+            .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests)
+            .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests);
+
+        // a color target that is copied out after the pass, the implicit external dependency does not cover transfers
+        vk::SubpassDependency readbackDependency;
+        readbackDependency.setSrcSubpass(0)
+            .setDstSubpass(VK_SUBPASS_EXTERNAL)
+            .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
             .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-            .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            .setDstStageMask(vk::PipelineStageFlagBits::eTransfer);
+
+        std::array<vk::SubpassDependency, 2> dependencies = {dependency, readbackDependency};
+        uint32_t dependencyCount = finalLayout == vk::ImageLayout::eTransferSrcOptimal ? 2 : 1;
 
         std::array<vk::AttachmentDescription, 2> attachments = {attachDesc, depthDesc};
         renderPassInfo.setAttachmentCount(2)
                     .setPAttachments(attachments.data())
                     .setSubpassCount(1)
                     .setPSubpasses(&subpass)
-                    .setDependencyCount(1)
-                    .setPDependencies(&dependency);
+                    .setDependencyCount(dependencyCount)
+                    .setPDependencies(dependencies.data());
 
         renderPass = context->device.createRenderPass(renderPassInfo);
     }
 
+    bool RenderProcess::IsVertexLayoutSupported(const engine::Context *context, VertexLayout vertexLayout)
+    {
+        if (vertexLayout == VertexLayout::Float)
+        {
+            return true;
+        }
+
+        for (vk::Format format : {vk::Format::eR16G16B16A16Unorm, vk::Format::eR8G8B8A8Unorm, vk::Format::eR16G16Sfloat})
+        {
+            if (!(context->phyDevice.getFormatProperties(format).bufferFeatures & vk::FormatFeatureFlagBits::eVertexBuffer))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t RenderProcess::GetVertexAttributeMask(VertexLayout vertexLayout)
+    {
+        vk::VertexInputBindingDescription binding;
+        uint32_t mask = 0;
+        for (const auto &attribute : getVertexAttributes(vertexLayout, binding))
+        {
+            mask |= 1u << attribute.location;
+        }
+        return mask;
+    }
+
     RenderProcess::~RenderProcess()
     {
         context->device.destroyRenderPass(renderPass);
-        context->device.destroyPipelineLayout(layout);
-        context->device.destroyPipeline(pipeline);
     }
 }
\ No newline at end of file
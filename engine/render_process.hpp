@@ -2,6 +2,7 @@
 
 #include "vulkan/vulkan.hpp"
 #include "shader.hpp"
+#include "pipeline_registry.hpp"
 
 namespace engine
 {
@@ -10,8 +11,6 @@ namespace engine
     class RenderProcess final
     {
     public:
-        vk::Pipeline pipeline;
-        vk::PipelineLayout layout;
         vk::RenderPass renderPass;
 
         RenderProcess(const engine::Context *context)
@@ -20,11 +19,21 @@ namespace engine
         }
         ~RenderProcess();
 
-        void InitLayout();
-        void InitRenderPass(const Swapchain *swapchain, vk::Format depthFormat);
-        void InitPipeline(const Shader *shader, int width, int height);
+        // finalLayout is ePresentSrcKHR for the swapchain, eTransferSrcOptimal when the color target is read back
+        void InitRenderPass(vk::Format colorFormat, vk::Format depthFormat, vk::ImageLayout finalLayout = vk::ImageLayout::ePresentSrcKHR);
+
+        // Builds the pipeline described by key through the context's pipeline cache. Thread safe.
+        // Viewport and scissor are dynamic, so pipelines survive swapchain resizes
+        static vk::Pipeline CreatePipeline(const engine::Context *context, const PipelineKey &key);
+
+        static bool IsVertexLayoutSupported(const engine::Context *context, VertexLayout vertexLayout);
+        // bit n is set when vertexLayout feeds location n
+        static uint32_t GetVertexAttributeMask(VertexLayout vertexLayout);
 
     private:
         const engine::Context *context;
+
+        // every attribute vertexLayout provides, binding receives its stride
+        static std::vector<vk::VertexInputAttributeDescription> getVertexAttributes(VertexLayout vertexLayout, vk::VertexInputBindingDescription &binding);
     };
 }
\ No newline at end of file
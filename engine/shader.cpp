@@ -1,59 +1,92 @@
 #include "shader.hpp"
-#include "context.hpp"
-#include <fstream>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 namespace engine
 {
-    std::string ReadWholeFile(const std::string &filePath)
+    Shader::Shader(const Context *context, ShaderLibrary *library, const std::string &vertexName, const std::string &fragmentName)
+        : library(library), vertexName(vertexName), fragmentName(fragmentName)
     {
-        std::ifstream file(filePath, std::ios::ate | std::ios::binary);
-        if (!file.is_open())
+        // loads both now, so a missing shader fails at startup rather than on the first frame
+        ShaderReflection vertex = library->GetReflection(vertexName);
+        ShaderReflection fragment = library->GetReflection(fragmentName);
+        if (vertex.stage != vk::ShaderStageFlagBits::eVertex || fragment.stage != vk::ShaderStageFlagBits::eFragment)
         {
-            throw std::runtime_error("Failed to open file: " + filePath);
+            throw std::runtime_error("Shader stages do not match: " + vertexName + ", " + fragmentName);
         }
 
-        size_t fileSize = (size_t)file.tellg();
-        std::string buffer(fileSize, ' ');
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-
-        return buffer;
-    }
-
-    Shader::Shader(const engine::Context *context, const std::string &vertexPath, const std::string &fragmentPath)
-    {
-        this->context = context;
-
-        std::string vertexSource = ReadWholeFile(vertexPath);
-        std::string fragmentSource = ReadWholeFile(fragmentPath);
+        merge(vertex);
+        merge(fragment);
 
-        vk::ShaderModuleCreateInfo vertexInfo;
-        vertexInfo.codeSize = vertexSource.size();
-        vertexInfo.pCode = reinterpret_cast<const uint32_t *>(vertexSource.data());
-
-        vertexModule = context->device.createShaderModule(vertexInfo);
-
-        vk::ShaderModuleCreateInfo fragmentInfo;
-        fragmentInfo.codeSize = fragmentSource.size();
-        fragmentInfo.pCode = reinterpret_cast<const uint32_t *>(fragmentSource.data());
+        vertexInputs = vertex.vertexInputs;
+        for (const VertexInput &input : vertexInputs)
+        {
+            vertexInputMask |= 1u << input.location;
+        }
 
-        fragmentModule = context->device.createShaderModule(fragmentInfo);
+        // every uniform buffer is fed from a UniformRing, which binds it with a dynamic offset
+        uint32_t setCount = 0;
+        for (DescriptorBinding &binding : bindings)
+        {
+            if (binding.type == vk::DescriptorType::eUniformBuffer)
+            {
+                binding.type = vk::DescriptorType::eUniformBufferDynamic;
+            }
+            setCount = std::max(setCount, binding.set + 1);
+        }
 
-        initStage();
+        // sets the shader skips still need a layout, an empty one
+        for (uint32_t set = 0; set < setCount; set++)
+        {
+            std::vector<vk::DescriptorSetLayoutBinding> setBindings;
+            for (const DescriptorBinding &binding : bindings)
+            {
+                if (binding.set == set)
+                {
+                    setBindings.emplace_back(binding.binding, binding.type, binding.count, binding.stages);
+                }
+            }
+            setLayouts.push_back(context->layoutCache->GetSetLayout(setBindings));
+        }
+        pipelineLayout = context->layoutCache->GetPipelineLayout(setLayouts, pushConstants);
     }
 
-    Shader::~Shader()
+    void Shader::merge(const ShaderReflection &reflection)
     {
-        context->device.destroyShaderModule(vertexModule);
-        context->device.destroyShaderModule(fragmentModule);
-    }
+        for (const DescriptorBinding &binding : reflection.bindings)
+        {
+            auto it = std::find_if(bindings.begin(), bindings.end(), [&](const DescriptorBinding &other)
+                                   { return other.set == binding.set && other.binding == binding.binding; });
+            if (it == bindings.end())
+            {
+                bindings.push_back(binding);
+                continue;
+            }
+            if (it->type != binding.type || it->count != binding.count)
+            {
+                throw std::runtime_error("Shader stages disagree on set " + std::to_string(binding.set) +
+                                         " binding " + std::to_string(binding.binding));
+            }
+            it->stages |= binding.stages;
+        }
 
-    void Shader::initStage()
-    {
-        stage_.resize(2);
-        stage_[0].setStage(vk::ShaderStageFlagBits::eVertex).setModule(vertexModule).setPName("main");
-        stage_[1].setStage(vk::ShaderStageFlagBits::eFragment).setModule(fragmentModule).setPName("main");
+        // one range per block, a block shared by both stages becomes a single range covering both
+        if (reflection.pushConstants.size == 0)
+        {
+            return;
+        }
+        if (pushConstants.empty())
+        {
+            pushConstants.push_back(reflection.pushConstants);
+            return;
+        }
+        vk::PushConstantRange &range = pushConstants.front();
+        uint32_t begin = std::min(range.offset, reflection.pushConstants.offset);
+        uint32_t end = std::max(range.offset + range.size, reflection.pushConstants.offset + reflection.pushConstants.size);
+        range.setStageFlags(range.stageFlags | reflection.pushConstants.stageFlags)
+            .setOffset(begin)
+            .setSize(end - begin);
     }
-
-}
\ No newline at end of file
+}
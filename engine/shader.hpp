@@ -2,37 +2,49 @@
 
 #include "vulkan/vulkan.hpp"
 #include "context.hpp"
+#include "shader_library.hpp"
 
 namespace engine
 {
+    // A vertex / fragment pair by source name. Modules are looked up in the library on every call,
+    // so a hot reloaded source is picked up by the next pipeline request. The set layouts, push constant
+    // ranges and pipeline layout are reflected from both modules once and shared through the layout cache
     class Shader
     {
     public:
-        Shader(const engine::Context *context, const std::string &vertexPath, const std::string &fragmentPath);
-        ~Shader();
+        Shader(const Context *context, ShaderLibrary *library, const std::string &vertexName, const std::string &fragmentName);
+        ~Shader() = default;
 
-        const vk::ShaderModule &getVertexModule() const
+        vk::ShaderModule getVertexModule() const
         {
-            return vertexModule;
+            return library->Get(vertexName);
         }
 
-        const vk::ShaderModule &getFragmentModule() const
+        vk::ShaderModule getFragmentModule() const
         {
-            return fragmentModule;
+            return library->Get(fragmentName);
         }
 
-        std::vector<vk::PipelineShaderStageCreateInfo> GetStage() const
-        {
-            return stage_;
-        }
+        vk::PipelineLayout get_pipeline_layout() const { return pipelineLayout; }
+        vk::DescriptorSetLayout get_set_layout(uint32_t set) const { return setLayouts.at(set); }
+        const std::vector<DescriptorBinding> &get_bindings() const { return bindings; }
+        const std::vector<vk::PushConstantRange> &get_push_constants() const { return pushConstants; }
+        const std::vector<VertexInput> &get_vertex_inputs() const { return vertexInputs; }
+        // bit n is set when the vertex shader reads location n
+        uint32_t get_vertex_input_mask() const { return vertexInputMask; }
 
     private:
-        vk::ShaderModule vertexModule;
-        vk::ShaderModule fragmentModule;
-        std::vector<vk::PipelineShaderStageCreateInfo> stage_;
-
-        const engine::Context *context;
-
-        void initStage();
+        ShaderLibrary *library;
+        std::string vertexName;
+        std::string fragmentName;
+
+        std::vector<DescriptorBinding> bindings;
+        std::vector<vk::PushConstantRange> pushConstants;
+        std::vector<VertexInput> vertexInputs;
+        uint32_t vertexInputMask = 0;
+        std::vector<vk::DescriptorSetLayout> setLayouts;
+        vk::PipelineLayout pipelineLayout;
+
+        void merge(const ShaderReflection &reflection);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,241 @@
+#include "shader_library.hpp"
+#include "cpu_profiler.hpp"
+#include "hash.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef ENGINE_SHADERC
+#include "shaderc/shaderc.hpp"
+#endif
+
+namespace engine
+{
+    namespace
+    {
+        // bump when compile options change, old cache entries are then simply never looked up
+        const uint64_t ShaderCacheVersion = 2;
+
+        bool readFile(const std::string &path, std::string &contents)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open())
+            {
+                return false;
+            }
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        std::vector<uint32_t> toWords(const std::string &bytes)
+        {
+            std::vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+            memcpy(words.data(), bytes.data(), words.size() * sizeof(uint32_t));
+            return words;
+        }
+
+        std::filesystem::file_time_type timestampOf(const std::string &path)
+        {
+            std::error_code error;
+            auto timestamp = std::filesystem::last_write_time(path, error);
+            return error ? std::filesystem::file_time_type() : timestamp;
+        }
+    }
+
+    ShaderLibrary::ShaderLibrary(const Context *context, const std::string &sourceDir, const std::string &spirvDir,
+                                 const std::string &cacheDir)
+        : context(context), sourceDir(sourceDir), spirvDir(spirvDir), cacheDir(cacheDir)
+    {
+#ifdef ENGINE_SHADERC
+        std::error_code error;
+        std::filesystem::create_directories(cacheDir, error);
+#endif
+    }
+
+    ShaderLibrary::~ShaderLibrary()
+    {
+        for (auto &pair : modules)
+        {
+            context->device.destroyShaderModule(pair.second.module);
+        }
+        for (auto &module : retired)
+        {
+            context->device.destroyShaderModule(module);
+        }
+    }
+
+    vk::ShaderModule ShaderLibrary::Get(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = modules.find(name);
+        if (it != modules.end())
+        {
+            return it->second.module;
+        }
+
+        Module module;
+        module.timestamp = timestampOf(sourceDir + "/" + name);
+        std::vector<uint32_t> spirv = loadSpirv(name);
+        if (spirv.empty())
+        {
+            throw std::runtime_error("Failed to load shader: " + name);
+        }
+        module.reflection = ReflectSpirv(spirv);
+        module.module = createModule(spirv);
+        modules[name] = module;
+        return module.module;
+    }
+
+    ShaderReflection ShaderLibrary::GetReflection(const std::string &name)
+    {
+        Get(name);
+        std::lock_guard<std::mutex> lock(mutex);
+        return modules[name].reflection;
+    }
+
+    std::vector<std::pair<vk::ShaderModule, vk::ShaderModule>> ShaderLibrary::Poll()
+    {
+        PROFILE_FUNCTION();
+        std::vector<std::pair<vk::ShaderModule, vk::ShaderModule>> replaced;
+#ifdef ENGINE_SHADERC
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &pair : modules)
+        {
+            auto timestamp = timestampOf(sourceDir + "/" + pair.first);
+            if (timestamp == pair.second.timestamp)
+            {
+                continue;
+            }
+
+            // editors save in several steps, the source is picked up again on its next change
+            pair.second.timestamp = timestamp;
+            std::vector<uint32_t> spirv = loadSpirv(pair.first);
+            if (spirv.empty())
+            {
+                continue;
+            }
+            if (!(ReflectSpirv(spirv) == pair.second.reflection))
+            {
+                std::cout << "Shader " << pair.first << " changed its resource interface, restart to apply" << std::endl;
+                continue;
+            }
+
+            vk::ShaderModule module = createModule(spirv);
+            replaced.emplace_back(pair.second.module, module);
+            retired.push_back(pair.second.module);
+            pair.second.module = module;
+            std::cout << "Reloaded shader " << pair.first << std::endl;
+        }
+#endif
+        return replaced;
+    }
+
+    void ShaderLibrary::ReleaseRetired()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &module : retired)
+        {
+            context->device.destroyShaderModule(module);
+        }
+        retired.clear();
+    }
+
+    std::vector<uint32_t> ShaderLibrary::loadSpirv(const std::string &name)
+    {
+#ifdef ENGINE_SHADERC
+        std::string source;
+        if (readFile(sourceDir + "/" + name, source))
+        {
+            uint64_t hash = HashCombine(HashBytes(source.data(), source.size()), HashValue(ShaderCacheVersion));
+            hash = HashCombine(hash, HashBytes(name.data(), name.size()));
+            char fileName[32];
+            snprintf(fileName, sizeof(fileName), "%016llx.spv", static_cast<unsigned long long>(hash));
+            std::string cachePath = cacheDir + "/" + fileName;
+
+            std::string cached;
+            if (readFile(cachePath, cached) && !cached.empty())
+            {
+                cacheHits++;
+                return toWords(cached);
+            }
+
+            std::vector<uint32_t> spirv = compile(name, source);
+            if (!spirv.empty())
+            {
+                std::string tmpPath = cachePath + ".tmp";
+                std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+                out.write(reinterpret_cast<const char *>(spirv.data()), static_cast<std::streamsize>(spirv.size() * sizeof(uint32_t)));
+                out.close();
+                if (!out.good() || std::rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+                {
+                    std::remove(tmpPath.c_str());
+                }
+            }
+            return spirv;
+        }
+#endif
+
+        std::string prebuilt;
+        if (!readFile(spirvDir + "/" + name + ".spv", prebuilt))
+        {
+            return {};
+        }
+        return toWords(prebuilt);
+    }
+
+    std::vector<uint32_t> ShaderLibrary::compile(const std::string &name, const std::string &source)
+    {
+        PROFILE_FUNCTION();
+#ifdef ENGINE_SHADERC
+        shaderc_shader_kind kind;
+        std::string extension = std::filesystem::path(name).extension().string();
+        if (extension == ".vert")
+        {
+            kind = shaderc_vertex_shader;
+        }
+        else if (extension == ".frag")
+        {
+            kind = shaderc_fragment_shader;
+        }
+        else if (extension == ".comp")
+        {
+            kind = shaderc_compute_shader;
+        }
+        else
+        {
+            std::cout << "Unknown shader stage: " << name << std::endl;
+            return {};
+        }
+
+        shaderc::Compiler compiler;
+        shaderc::CompileOptions options;
+        // SPIR-V 1.0 like the build's glslc, so a reload never needs more than the prebuilt module did
+        options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+        shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind, name.c_str(), options);
+        if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+        {
+            std::cout << "Failed to compile shader " << name << ":\n"
+                      << result.GetErrorMessage() << std::endl;
+            return {};
+        }
+
+        compileCount++;
+        return std::vector<uint32_t>(result.cbegin(), result.cend());
+#else
+        return {};
+#endif
+    }
+
+    vk::ShaderModule ShaderLibrary::createModule(const std::vector<uint32_t> &spirv)
+    {
+        vk::ShaderModuleCreateInfo createInfo;
+        createInfo.setCode(spirv);
+        return context->device.createShaderModule(createInfo);
+    }
+}
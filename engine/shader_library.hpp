@@ -0,0 +1,66 @@
+#pragma once
+
+#include "context.hpp"
+#include "shader_reflection.hpp"
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace engine
+{
+    // Owns every shader module by source name ("shader.vert"). With shaderc available (ENGINE_SHADERC)
+    // GLSL is compiled at runtime into a SPIR-V cache addressed by the hash of the source, and Poll()
+    // recompiles sources whose timestamp changed. Without it the build time <name>.spv files are loaded.
+    class ShaderLibrary final
+    {
+    public:
+        ShaderLibrary(const Context *context, const std::string &sourceDir, const std::string &spirvDir,
+                      const std::string &cacheDir = "shader_cache");
+        ~ShaderLibrary();
+
+        ShaderLibrary(const ShaderLibrary &) = delete;
+        ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+
+        // Loads name on first use, throws when it neither compiles nor has a prebuilt module
+        vk::ShaderModule Get(const std::string &name);
+        ShaderReflection GetReflection(const std::string &name);
+
+        // Recompiles changed sources and returns (old, new) module pairs. A source that fails to compile
+        // or changes its resource interface keeps its old module, layouts are fixed once created.
+        // Old modules stay alive until ReleaseRetired(), pipelines still compiling may reference them
+        std::vector<std::pair<vk::ShaderModule, vk::ShaderModule>> Poll();
+        // Destroys the modules Poll() replaced, call only while no pipeline is being compiled from them
+        void ReleaseRetired();
+
+        uint32_t get_cache_hits() const { return cacheHits; }
+        uint32_t get_compile_count() const { return compileCount; }
+
+    private:
+        struct Module
+        {
+            vk::ShaderModule module;
+            ShaderReflection reflection;
+            std::filesystem::file_time_type timestamp;
+        };
+
+        const Context *context;
+        std::string sourceDir;
+        std::string spirvDir;
+        std::string cacheDir;
+
+        std::mutex mutex;
+        std::unordered_map<std::string, Module> modules;
+        std::vector<vk::ShaderModule> retired;
+        uint32_t cacheHits = 0;
+        uint32_t compileCount = 0;
+
+        // empty on failure, the error is printed
+        std::vector<uint32_t> loadSpirv(const std::string &name);
+        std::vector<uint32_t> compile(const std::string &name, const std::string &source);
+        vk::ShaderModule createModule(const std::vector<uint32_t> &spirv);
+    };
+}
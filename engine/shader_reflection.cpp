@@ -0,0 +1,529 @@
+#include "shader_reflection.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+namespace engine
+{
+    namespace
+    {
+        // the subset of the SPIR-V specification the reflection needs
+        const uint32_t SpirvMagic = 0x07230203;
+
+        enum Op : uint32_t
+        {
+            OpEntryPoint = 15,
+            OpTypeInt = 21,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeMatrix = 24,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpConstant = 43,
+            OpSpecConstant = 50,
+            OpSpecConstantOp = 52,
+            OpVariable = 59,
+            OpDecorate = 71,
+            OpMemberDecorate = 72,
+        };
+
+        enum Decoration : uint32_t
+        {
+            DecorationBlock = 2,
+            DecorationBufferBlock = 3,
+            DecorationArrayStride = 6,
+            DecorationMatrixStride = 7,
+            DecorationBuiltIn = 11,
+            DecorationLocation = 30,
+            DecorationBinding = 33,
+            DecorationDescriptorSet = 34,
+            DecorationOffset = 35,
+        };
+
+        enum StorageClass : uint32_t
+        {
+            StorageUniformConstant = 0,
+            StorageInput = 1,
+            StorageUniform = 2,
+            StoragePushConstant = 9,
+            StorageStorageBuffer = 12,
+        };
+
+        const uint32_t DimBuffer = 5;
+        const uint32_t DimSubpassData = 6;
+
+        struct Member
+        {
+            uint32_t offset = 0;
+            uint32_t matrixStride = 0;
+            bool builtIn = false;
+        };
+
+        struct Id
+        {
+            uint32_t opcode = 0;
+            // pointee, element, component or column type
+            uint32_t type = 0;
+            uint32_t storageClass = 0;
+            // bit width of scalars, component count of vectors and matrices, length id of arrays
+            uint32_t count = 0;
+            bool isSigned = false;
+            uint32_t dim = 0;
+            uint32_t sampled = 0;
+            uint32_t value = 0;
+            std::vector<uint32_t> members;
+
+            uint32_t set = 0;
+            uint32_t binding = 0;
+            uint32_t location = 0;
+            uint32_t arrayStride = 0;
+            bool hasBinding = false;
+            bool hasLocation = false;
+            bool builtIn = false;
+            bool block = false;
+            bool bufferBlock = false;
+            std::vector<Member> memberDecorations;
+        };
+
+        class Parser
+        {
+        public:
+            explicit Parser(const std::vector<uint32_t> &code)
+            {
+                if (code.size() < 5 || code[0] != SpirvMagic)
+                {
+                    throw std::runtime_error("Not a SPIR-V module");
+                }
+                ids.resize(code[3]);
+
+                size_t i = 5;
+                while (i < code.size())
+                {
+                    uint32_t wordCount = code[i] >> 16;
+                    if (wordCount == 0 || i + wordCount > code.size())
+                    {
+                        throw std::runtime_error("Malformed SPIR-V instruction");
+                    }
+                    parse(code[i] & 0xffff, &code[i], wordCount);
+                    i += wordCount;
+                }
+            }
+
+            ShaderReflection Reflect() const
+            {
+                ShaderReflection reflection;
+                reflection.stage = stage;
+
+                for (uint32_t id = 0; id < ids.size(); id++)
+                {
+                    const Id &variable = ids[id];
+                    if (variable.opcode != OpVariable)
+                    {
+                        continue;
+                    }
+                    uint32_t type = pointee(variable);
+
+                    switch (variable.storageClass)
+                    {
+                    case StorageUniformConstant:
+                    case StorageUniform:
+                    case StorageStorageBuffer:
+                        if (variable.hasBinding)
+                        {
+                            reflection.bindings.push_back(reflectBinding(variable, type));
+                        }
+                        break;
+                    case StoragePushConstant:
+                        reflection.pushConstants = reflectPushConstants(type);
+                        break;
+                    case StorageInput:
+                        if (stage == vk::ShaderStageFlagBits::eVertex && variable.hasLocation && !variable.builtIn && !isBuiltInBlock(type))
+                        {
+                            reflection.vertexInputs.push_back({variable.location, vertexFormat(type)});
+                        }
+                        break;
+                    default:
+                        break;
+                    }
+                }
+
+                std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+                          [](const DescriptorBinding &a, const DescriptorBinding &b)
+                          { return std::tie(a.set, a.binding) < std::tie(b.set, b.binding); });
+                std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+                          [](const VertexInput &a, const VertexInput &b)
+                          { return a.location < b.location; });
+                return reflection;
+            }
+
+        private:
+            std::vector<Id> ids;
+            vk::ShaderStageFlagBits stage = vk::ShaderStageFlagBits::eVertex;
+
+            Id &at(uint32_t id)
+            {
+                if (id >= ids.size())
+                {
+                    throw std::runtime_error("SPIR-V id out of bounds");
+                }
+                return ids[id];
+            }
+
+            const Id &at(uint32_t id) const
+            {
+                if (id >= ids.size())
+                {
+                    throw std::runtime_error("SPIR-V id out of bounds");
+                }
+                return ids[id];
+            }
+
+            void parse(uint32_t opcode, const uint32_t *words, uint32_t wordCount)
+            {
+                switch (opcode)
+                {
+                case OpEntryPoint:
+                    stage = executionModel(words[1]);
+                    break;
+                case OpTypeInt:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).count = words[2];
+                    at(words[1]).isSigned = words[3] != 0;
+                    break;
+                case OpTypeFloat:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).count = words[2];
+                    break;
+                case OpTypeVector:
+                case OpTypeMatrix:
+                case OpTypeArray:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).type = words[2];
+                    at(words[1]).count = words[3];
+                    break;
+                case OpTypeImage:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).dim = words[3];
+                    at(words[1]).sampled = words[7];
+                    break;
+                case OpTypeSampler:
+                    at(words[1]).opcode = opcode;
+                    break;
+                case OpTypeSampledImage:
+                case OpTypeRuntimeArray:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).type = words[2];
+                    break;
+                case OpTypeStruct:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).members.assign(words + 2, words + wordCount);
+                    at(words[1]).memberDecorations.resize(wordCount - 2);
+                    break;
+                case OpTypePointer:
+                    at(words[1]).opcode = opcode;
+                    at(words[1]).storageClass = words[2];
+                    at(words[1]).type = words[3];
+                    break;
+                case OpConstant:
+                    at(words[2]).opcode = opcode;
+                    at(words[2]).value = words[3];
+                    break;
+                case OpSpecConstant:
+                case OpSpecConstantOp:
+                    at(words[2]).opcode = opcode;
+                    break;
+                case OpVariable:
+                    at(words[2]).opcode = opcode;
+                    at(words[2]).type = words[1];
+                    at(words[2]).storageClass = words[3];
+                    break;
+                case OpDecorate:
+                    decorate(at(words[1]), words[2], wordCount > 3 ? words[3] : 0);
+                    break;
+                case OpMemberDecorate:
+                    decorateMember(at(words[1]), words[2], words[3], wordCount > 4 ? words[4] : 0);
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static void decorate(Id &id, uint32_t decoration, uint32_t value)
+            {
+                switch (decoration)
+                {
+                case DecorationBlock:
+                    id.block = true;
+                    break;
+                case DecorationBufferBlock:
+                    id.bufferBlock = true;
+                    break;
+                case DecorationArrayStride:
+                    id.arrayStride = value;
+                    break;
+                case DecorationBuiltIn:
+                    id.builtIn = true;
+                    break;
+                case DecorationLocation:
+                    id.location = value;
+                    id.hasLocation = true;
+                    break;
+                case DecorationBinding:
+                    id.binding = value;
+                    id.hasBinding = true;
+                    break;
+                case DecorationDescriptorSet:
+                    id.set = value;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static void decorateMember(Id &id, uint32_t member, uint32_t decoration, uint32_t value)
+            {
+                // member decorations may precede the struct declaration
+                if (member >= id.memberDecorations.size())
+                {
+                    id.memberDecorations.resize(member + 1);
+                }
+                switch (decoration)
+                {
+                case DecorationOffset:
+                    id.memberDecorations[member].offset = value;
+                    break;
+                case DecorationMatrixStride:
+                    id.memberDecorations[member].matrixStride = value;
+                    break;
+                case DecorationBuiltIn:
+                    id.memberDecorations[member].builtIn = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static vk::ShaderStageFlagBits executionModel(uint32_t model)
+            {
+                switch (model)
+                {
+                case 0:
+                    return vk::ShaderStageFlagBits::eVertex;
+                case 1:
+                    return vk::ShaderStageFlagBits::eTessellationControl;
+                case 2:
+                    return vk::ShaderStageFlagBits::eTessellationEvaluation;
+                case 3:
+                    return vk::ShaderStageFlagBits::eGeometry;
+                case 4:
+                    return vk::ShaderStageFlagBits::eFragment;
+                case 5:
+                    return vk::ShaderStageFlagBits::eCompute;
+                default:
+                    throw std::runtime_error("Unsupported SPIR-V execution model");
+                }
+            }
+
+            uint32_t pointee(const Id &variable) const
+            {
+                const Id &pointer = at(variable.type);
+                if (pointer.opcode != OpTypePointer)
+                {
+                    throw std::runtime_error("SPIR-V variable is not a pointer");
+                }
+                return pointer.type;
+            }
+
+            DescriptorBinding reflectBinding(const Id &variable, uint32_t type) const
+            {
+                DescriptorBinding binding;
+                binding.set = variable.set;
+                binding.binding = variable.binding;
+                binding.stages = stage;
+
+                if (at(type).opcode == OpTypeRuntimeArray)
+                {
+                    binding.count = 0;
+                    type = at(type).type;
+                }
+                else if (at(type).opcode == OpTypeArray)
+                {
+                    binding.count = arrayLength(at(type));
+                    type = at(type).type;
+                }
+
+                const Id &resource = at(type);
+                switch (resource.opcode)
+                {
+                case OpTypeStruct:
+                    binding.type = variable.storageClass == StorageStorageBuffer || resource.bufferBlock
+                                       ? vk::DescriptorType::eStorageBuffer
+                                       : vk::DescriptorType::eUniformBuffer;
+                    break;
+                case OpTypeSampledImage:
+                    binding.type = vk::DescriptorType::eCombinedImageSampler;
+                    break;
+                case OpTypeSampler:
+                    binding.type = vk::DescriptorType::eSampler;
+                    break;
+                case OpTypeImage:
+                    // sampled 2 is a storage image, 1 is read through a sampler
+                    if (resource.dim == DimSubpassData)
+                    {
+                        binding.type = vk::DescriptorType::eInputAttachment;
+                    }
+                    else if (resource.dim == DimBuffer)
+                    {
+                        binding.type = resource.sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer
+                                                             : vk::DescriptorType::eUniformTexelBuffer;
+                    }
+                    else
+                    {
+                        binding.type = resource.sampled == 2 ? vk::DescriptorType::eStorageImage
+                                                             : vk::DescriptorType::eSampledImage;
+                    }
+                    break;
+                default:
+                    throw std::runtime_error("Unsupported SPIR-V descriptor type");
+                }
+                return binding;
+            }
+
+            vk::PushConstantRange reflectPushConstants(uint32_t type) const
+            {
+                const Id &block = at(type);
+                uint32_t begin = UINT32_MAX;
+                uint32_t end = 0;
+                for (size_t i = 0; i < block.members.size(); i++)
+                {
+                    const Member &member = block.memberDecorations[i];
+                    begin = std::min(begin, member.offset);
+                    end = std::max(end, member.offset + sizeOf(block.members[i], member.matrixStride));
+                }
+
+                vk::PushConstantRange range;
+                if (end > 0)
+                {
+                    range.setStageFlags(stage)
+                        .setOffset(begin)
+                        .setSize(end - begin);
+                }
+                return range;
+            }
+
+            // the length operand must be a plain constant, a specialization constant is only known at pipeline creation
+            uint32_t arrayLength(const Id &array) const
+            {
+                const Id &length = at(array.count);
+                if (length.opcode == OpSpecConstant || length.opcode == OpSpecConstantOp)
+                {
+                    throw std::runtime_error("SPIR-V array sized by a specialization constant is not supported by reflection");
+                }
+                if (length.opcode != OpConstant)
+                {
+                    throw std::runtime_error("SPIR-V array length is not a constant");
+                }
+                return length.value;
+            }
+
+            // size in bytes under the explicit layout decorations
+            uint32_t sizeOf(uint32_t type, uint32_t matrixStride) const
+            {
+                const Id &id = at(type);
+                switch (id.opcode)
+                {
+                case OpTypeInt:
+                case OpTypeFloat:
+                    return id.count / 8;
+                case OpTypeVector:
+                    return id.count * sizeOf(id.type, 0);
+                case OpTypeMatrix:
+                    return id.count * (matrixStride ? matrixStride : sizeOf(id.type, 0));
+                case OpTypeArray:
+                    return arrayLength(id) * (id.arrayStride ? id.arrayStride : sizeOf(id.type, matrixStride));
+                case OpTypeStruct:
+                {
+                    uint32_t size = 0;
+                    for (size_t i = 0; i < id.members.size(); i++)
+                    {
+                        const Member &member = id.memberDecorations[i];
+                        size = std::max(size, member.offset + sizeOf(id.members[i], member.matrixStride));
+                    }
+                    return size;
+                }
+                default:
+                    throw std::runtime_error("Unsupported SPIR-V type in push constant block");
+                }
+            }
+
+            bool isBuiltInBlock(uint32_t type) const
+            {
+                const Id &id = at(type);
+                return id.opcode == OpTypeStruct &&
+                       std::any_of(id.memberDecorations.begin(), id.memberDecorations.end(),
+                                   [](const Member &member)
+                                   { return member.builtIn; });
+            }
+
+            vk::Format vertexFormat(uint32_t type) const
+            {
+                uint32_t components = 1;
+                if (at(type).opcode == OpTypeVector)
+                {
+                    components = at(type).count;
+                    type = at(type).type;
+                }
+
+                const Id &scalar = at(type);
+                if (components < 1 || components > 4 || scalar.count != 32)
+                {
+                    return vk::Format::eUndefined;
+                }
+
+                static const vk::Format floatFormats[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat,
+                                                          vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+                static const vk::Format sintFormats[] = {vk::Format::eR32Sint, vk::Format::eR32G32Sint,
+                                                         vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint};
+                static const vk::Format uintFormats[] = {vk::Format::eR32Uint, vk::Format::eR32G32Uint,
+                                                         vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint};
+                if (scalar.opcode == OpTypeFloat)
+                {
+                    return floatFormats[components - 1];
+                }
+                if (scalar.opcode == OpTypeInt)
+                {
+                    return scalar.isSigned ? sintFormats[components - 1] : uintFormats[components - 1];
+                }
+                return vk::Format::eUndefined;
+            }
+        };
+    }
+
+    bool DescriptorBinding::operator==(const DescriptorBinding &other) const
+    {
+        return set == other.set && binding == other.binding && type == other.type && count == other.count &&
+               stages == other.stages;
+    }
+
+    bool VertexInput::operator==(const VertexInput &other) const
+    {
+        return location == other.location && format == other.format;
+    }
+
+    bool ShaderReflection::operator==(const ShaderReflection &other) const
+    {
+        return stage == other.stage && bindings == other.bindings && pushConstants == other.pushConstants &&
+               vertexInputs == other.vertexInputs;
+    }
+
+    ShaderReflection ReflectSpirv(const std::vector<uint32_t> &code)
+    {
+        return Parser(code).Reflect();
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <vector>
+
+namespace engine
+{
+    struct DescriptorBinding
+    {
+        uint32_t set = 0;
+        uint32_t binding = 0;
+        vk::DescriptorType type = vk::DescriptorType::eUniformBuffer;
+        // 0 for a runtime sized array
+        uint32_t count = 1;
+        vk::ShaderStageFlags stages;
+
+        bool operator==(const DescriptorBinding &other) const;
+    };
+
+    struct VertexInput
+    {
+        uint32_t location = 0;
+        // the shader side type, e.g. eR32G32B32Sfloat for a vec3
+        vk::Format format = vk::Format::eUndefined;
+
+        bool operator==(const VertexInput &other) const;
+    };
+
+    // The resource interface of one SPIR-V module
+    struct ShaderReflection
+    {
+        vk::ShaderStageFlagBits stage = vk::ShaderStageFlagBits::eVertex;
+        std::vector<DescriptorBinding> bindings;
+        // size 0 when the module has no push constant block
+        vk::PushConstantRange pushConstants;
+        // vertex stage only, built-ins excluded
+        std::vector<VertexInput> vertexInputs;
+
+        bool operator==(const ShaderReflection &other) const;
+    };
+
+    // Parses the decorations, types and global variables of a module. Throws on malformed SPIR-V
+    ShaderReflection ReflectSpirv(const std::vector<uint32_t> &code);
+}
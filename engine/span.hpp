@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace engine
+{
+    // Non-owning view over a contiguous range (C++17 stand-in for std::span)
+    template <typename T>
+    class Span
+    {
+    public:
+        Span() = default;
+        Span(T *data, size_t count) : ptr(data), count(count) {}
+
+        T *data() const { return ptr; }
+        size_t size() const { return count; }
+        size_t size_bytes() const { return count * sizeof(T); }
+        bool empty() const { return count == 0; }
+
+        T *begin() const { return ptr; }
+        T *end() const { return ptr + count; }
+        T &operator[](size_t i) const { return ptr[i]; }
+
+        Span subspan(size_t offset, size_t length) const
+        {
+            return Span(ptr + offset, length);
+        }
+
+    private:
+        T *ptr = nullptr;
+        size_t count = 0;
+    };
+}
@@ -0,0 +1,81 @@
+#include "staging_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine
+{
+    StagingRing::StagingRing(vk::PhysicalDevice phyDevice, vk::Device device, GpuAllocator *allocator, vk::DeviceSize size)
+        : device(device), allocator(allocator)
+    {
+        // 16 covers every texel and compressed block size for buffer to image copies
+        alignment = std::max<vk::DeviceSize>(phyDevice.getProperties().limits.optimalBufferCopyOffsetAlignment, 16);
+        this->size = (size + alignment - 1) / alignment * alignment;
+
+        vk::BufferCreateInfo bufferInfo = {};
+        bufferInfo.size = this->size;
+        bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+        bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+        if (device.createBuffer(&bufferInfo, nullptr, &buffer) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to create staging ring buffer");
+        }
+
+        memory = allocator->AllocateBuffer(buffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    StagingRing::~StagingRing()
+    {
+        device.destroyBuffer(buffer);
+        allocator->Free(memory);
+    }
+
+    bool StagingRing::TryAllocate(vk::DeviceSize allocationSize, StagingAllocation &allocation)
+    {
+        vk::DeviceSize alignedSize = (allocationSize + alignment - 1) / alignment * alignment;
+        if (alignedSize > size)
+        {
+            throw std::runtime_error("Staging allocation larger than the ring");
+        }
+
+        uint64_t start = head;
+        vk::DeviceSize offset = start % size;
+        if (offset + alignedSize > size)
+        {
+            // skip the tail end of the buffer, it is released together with this allocation
+            start += size - offset;
+            offset = 0;
+        }
+        if (start + alignedSize - tail > size)
+        {
+            return false;
+        }
+
+        head = start + alignedSize;
+        allocation.buffer = buffer;
+        allocation.offset = offset;
+        allocation.data = static_cast<uint8_t *>(memory.mapped) + offset;
+        return true;
+    }
+
+    void StagingRing::Fence(uint64_t ticket)
+    {
+        if (head == fenced)
+        {
+            return;
+        }
+
+        pending.push_back({head, ticket});
+        fenced = head;
+    }
+
+    void StagingRing::Reclaim(uint64_t completedTicket)
+    {
+        while (!pending.empty() && pending.front().ticket <= completedTicket)
+        {
+            tail = pending.front().end;
+            pending.pop_front();
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "gpu_allocator.hpp"
+
+#include <deque>
+
+namespace engine
+{
+    struct StagingAllocation
+    {
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+        void *data = nullptr;
+    };
+
+    // One persistently mapped, host coherent transfer source buffer used as a FIFO. Allocations are
+    // fenced by the ticket of the batch that reads them and their space comes back once it completes,
+    // so streaming never has to allocate staging memory after startup.
+    class StagingRing final
+    {
+    public:
+        StagingRing(vk::PhysicalDevice phyDevice, vk::Device device, GpuAllocator *allocator, vk::DeviceSize size);
+        ~StagingRing();
+
+        StagingRing(const StagingRing &) = delete;
+        StagingRing &operator=(const StagingRing &) = delete;
+
+        // Returns false when size bytes are not free yet, allocations never wrap around the end of the buffer
+        bool TryAllocate(vk::DeviceSize size, StagingAllocation &allocation);
+
+        // Everything allocated since the previous Fence() is released once ticket completes
+        void Fence(uint64_t ticket);
+        void Reclaim(uint64_t completedTicket);
+
+        // Ticket to wait for before more space can be reclaimed, 0 when nothing is fenced
+        uint64_t get_oldest_ticket() const { return pending.empty() ? 0 : pending.front().ticket; }
+        vk::DeviceSize get_size() const { return size; }
+        vk::DeviceSize get_used() const { return head - tail; }
+        vk::DeviceSize get_alignment() const { return alignment; }
+
+    private:
+        struct Region
+        {
+            uint64_t end;
+            uint64_t ticket;
+        };
+
+        vk::Device device;
+        GpuAllocator *allocator;
+        vk::Buffer buffer;
+        GpuAllocation memory;
+        vk::DeviceSize size;
+        vk::DeviceSize alignment;
+
+        // monotonic byte positions, the buffer offset is position % size
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        uint64_t fenced = 0;
+        std::deque<Region> pending;
+    };
+}
@@ -0,0 +1,149 @@
+#include "texture_loader.hpp"
+#include "cpu_profiler.hpp"
+
+#include <stdexcept>
+
+namespace engine
+{
+    TextureLoader::TextureLoader(Context *context, GpuAllocator *allocator, UploadManager *uploads, ThreadPool *threadPool)
+        : context(context), allocator(allocator), uploads(uploads), threadPool(threadPool)
+    {
+    }
+
+    TextureLoader::~TextureLoader()
+    {
+        // outstanding decodes are finished and discarded
+        for (auto &entry : pending)
+        {
+            entry.decode.wait();
+        }
+
+        for (auto &texture : textures)
+        {
+            context->device.destroyImageView(texture->view);
+            context->device.destroyImage(texture->image);
+            allocator->Free(texture->memory);
+        }
+    }
+
+    TextureHandle TextureLoader::Load(const std::string &path)
+    {
+        TextureHandle texture = std::make_shared<Texture>();
+        texture->source = path;
+
+        vk::PhysicalDevice phyDevice = context->phyDevice;
+        Pending entry;
+        entry.texture = texture;
+        entry.decode = threadPool->Submit([path, phyDevice]()
+                                          {
+                                              PROFILE_ZONE("decode texture");
+                                              return std::make_unique<Image>(path, phyDevice); });
+        pending.push_back(std::move(entry));
+        return texture;
+    }
+
+    UploadTicket TextureLoader::Update()
+    {
+        PROFILE_FUNCTION();
+        bool queued = false;
+        for (size_t i = 0; i < pending.size();)
+        {
+            if (pending[i].decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+
+            std::unique_ptr<Image> image = pending[i].decode.get();
+            create(*pending[i].texture, *image);
+            textures.push_back(pending[i].texture);
+            pending.erase(pending.begin() + i);
+            queued = true;
+        }
+
+        if (!queued)
+        {
+            return 0;
+        }
+
+        UploadTicket ticket = uploads->Submit();
+        for (auto &texture : textures)
+        {
+            if (texture->ticket == 0)
+            {
+                texture->ticket = ticket;
+            }
+        }
+        return ticket;
+    }
+
+    UploadTicket TextureLoader::Wait(const TextureHandle &texture)
+    {
+        for (auto &entry : pending)
+        {
+            if (entry.texture == texture)
+            {
+                entry.decode.wait();
+                Update();
+                break;
+            }
+        }
+        return texture->ticket;
+    }
+
+    void TextureLoader::create(Texture &texture, const Image &image)
+    {
+        texture.format = image.get_format();
+        texture.width = image.get_width();
+        texture.height = image.get_height();
+        texture.mipLevels = image.get_level_count();
+
+        vk::ImageCreateInfo imageInfo = {};
+        imageInfo.imageType = vk::ImageType::e2D;
+        imageInfo.extent = vk::Extent3D{texture.width, texture.height, 1};
+        imageInfo.mipLevels = texture.mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = texture.format;
+        imageInfo.tiling = vk::ImageTiling::eOptimal;
+        imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+        imageInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+        imageInfo.samples = vk::SampleCountFlagBits::e1;
+        imageInfo.sharingMode = vk::SharingMode::eExclusive;
+
+        if (context->device.createImage(&imageInfo, nullptr, &texture.image) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to create texture image: " + texture.source);
+        }
+        texture.memory = allocator->AllocateImage(texture.image, vk::ImageTiling::eOptimal, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        std::vector<vk::BufferImageCopy> regions;
+        for (uint32_t level = 0; level < texture.mipLevels; level++)
+        {
+            const ImageLevel &imageLevel = image.get_levels()[level];
+            vk::BufferImageCopy region = {};
+            region.bufferOffset = imageLevel.offset;
+            region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = vk::Extent3D{imageLevel.width, imageLevel.height, 1};
+            regions.push_back(region);
+        }
+
+        vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, texture.mipLevels, 0, 1};
+        uploads->CopyToImage(image.get_data(), texture.image, texture.format, regions, range, vk::ImageLayout::eShaderReadOnlyOptimal,
+                             vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+
+        vk::ImageViewCreateInfo viewInfo = {};
+        viewInfo.image = texture.image;
+        viewInfo.viewType = vk::ImageViewType::e2D;
+        viewInfo.format = texture.format;
+        viewInfo.components = image.get_components();
+        viewInfo.subresourceRange = range;
+
+        if (context->device.createImageView(&viewInfo, nullptr, &texture.view) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to create texture image view: " + texture.source);
+        }
+    }
+}
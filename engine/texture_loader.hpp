@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Image.hpp"
+#include "gpu_allocator.hpp"
+#include "thread_pool.hpp"
+#include "upload_manager.hpp"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine
+{
+    struct Texture
+    {
+        std::string source;
+        vk::Image image;
+        vk::ImageView view;
+        GpuAllocation memory;
+        vk::Format format = vk::Format::eUndefined;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 0;
+        // 0 until the upload is queued, the texture may be sampled once this ticket has completed
+        UploadTicket ticket = 0;
+    };
+
+    using TextureHandle = std::shared_ptr<Texture>;
+
+    // Decodes textures on the thread pool and queues their uploads from the main thread once decoding
+    // is done, so UploadManager::Submit() and the graphics queue never leave the thread that owns them.
+    class TextureLoader final
+    {
+    public:
+        TextureLoader(Context *context, GpuAllocator *allocator, UploadManager *uploads, ThreadPool *threadPool);
+        ~TextureLoader();
+
+        TextureLoader(const TextureLoader &) = delete;
+        TextureLoader &operator=(const TextureLoader &) = delete;
+
+        // Returns immediately, the handle is filled in by Update() after the decode finishes
+        TextureHandle Load(const std::string &path);
+
+        // Main thread: creates images for finished decodes, queues their copies and submits them.
+        // Returns the ticket of that submit, or 0 when nothing finished
+        UploadTicket Update();
+
+        // Blocks until texture's decode has finished and its upload has been submitted
+        UploadTicket Wait(const TextureHandle &texture);
+
+        bool IsResident(const TextureHandle &texture) const { return texture->ticket != 0 && uploads->IsComplete(texture->ticket); }
+        uint32_t get_pending_count() const { return static_cast<uint32_t>(pending.size()); }
+        uint32_t get_texture_count() const { return static_cast<uint32_t>(textures.size()); }
+
+    private:
+        struct Pending
+        {
+            TextureHandle texture;
+            std::future<std::unique_ptr<Image>> decode;
+        };
+
+        Context *context;
+        GpuAllocator *allocator;
+        UploadManager *uploads;
+        ThreadPool *threadPool;
+
+        std::vector<Pending> pending;
+        std::vector<TextureHandle> textures;
+
+        void create(Texture &texture, const Image &image);
+    };
+}
@@ -0,0 +1,136 @@
+#include "thread_pool.hpp"
+#include "cpu_profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+
+namespace engine
+{
+    ThreadPool::ThreadPool(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back([this, i]()
+                                 {
+                                     PROFILE_THREAD("worker " + std::to_string(i));
+                                     workerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]()
+                               { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)> &func)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        struct State
+        {
+            std::function<void(uint32_t)> func;
+            uint32_t count;
+            std::atomic<uint32_t> next{0};
+            std::atomic<uint32_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        };
+
+        auto state = std::make_shared<State>();
+        state->func = func;
+        state->count = count;
+
+        auto work = [state]()
+        {
+            uint32_t index;
+            while ((index = state->next.fetch_add(1)) < state->count)
+            {
+                try
+                {
+                    state->func(index);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error)
+                    {
+                        state->error = std::current_exception();
+                    }
+                }
+
+                if (state->done.fetch_add(1) + 1 == state->count)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        uint32_t helpers = std::min(count - 1, get_thread_count());
+        for (uint32_t i = 0; i < helpers; i++)
+        {
+            enqueue(work);
+        }
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&]()
+                             { return state->done.load() == state->count; });
+
+        if (state->error)
+        {
+            std::rethrow_exception(state->error);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine
+{
+    class ThreadPool final
+    {
+    public:
+        // threadCount == 0 picks one worker per hardware thread, minus the calling thread
+        explicit ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        template <typename F>
+        auto Submit(F &&func) -> std::future<decltype(func())>
+        {
+            using Result = decltype(func());
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+            std::future<Result> future = task->get_future();
+            enqueue([task]()
+                    { (*task)(); });
+            return future;
+        }
+
+        // Runs func(0..count-1) on the workers and the calling thread, returns when every index is done.
+        // Safe to call from inside a worker: the caller drains indices itself instead of waiting on queued helpers.
+        void ParallelFor(uint32_t count, const std::function<void(uint32_t)> &func);
+
+        uint32_t get_thread_count() const { return static_cast<uint32_t>(workers.size()); }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void enqueue(std::function<void()> task);
+        void workerLoop();
+    };
+}
@@ -0,0 +1,53 @@
+#include "uniform_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine
+{
+    UniformRing::UniformRing(vk::PhysicalDevice phyDevice, vk::Device device, GpuAllocator *allocator,
+                             uint32_t frameCount, vk::DeviceSize frameSize)
+        : device(device), allocator(allocator), frameCount(frameCount)
+    {
+        alignment = std::max<vk::DeviceSize>(phyDevice.getProperties().limits.minUniformBufferOffsetAlignment, 16);
+        this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+        vk::BufferCreateInfo bufferInfo = {};
+        bufferInfo.size = this->frameSize * frameCount;
+        bufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+        bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+        if (device.createBuffer(&bufferInfo, nullptr, &buffer) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to create uniform ring buffer");
+        }
+
+        memory = allocator->AllocateBuffer(buffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    UniformRing::~UniformRing()
+    {
+        device.destroyBuffer(buffer);
+        allocator->Free(memory);
+    }
+
+    void UniformRing::BeginFrame(uint32_t frameIndex)
+    {
+        frameStart = (frameIndex % frameCount) * frameSize;
+        head = frameStart;
+    }
+
+    uint32_t UniformRing::Allocate(vk::DeviceSize size, void **data)
+    {
+        vk::DeviceSize offset = head;
+        vk::DeviceSize end = offset + (size + alignment - 1) / alignment * alignment;
+        if (end > frameStart + frameSize)
+        {
+            throw std::runtime_error("Uniform ring frame region exhausted");
+        }
+
+        head = end;
+        *data = static_cast<uint8_t *>(memory.mapped) + offset;
+        return static_cast<uint32_t>(offset);
+    }
+}
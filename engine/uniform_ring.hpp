@@ -0,0 +1,53 @@
+#pragma once
+
+#include "gpu_allocator.hpp"
+
+#include <cstring>
+
+namespace engine
+{
+    // One persistently mapped, host coherent uniform buffer split into a region per frame in flight.
+    // Constants are bump-allocated into the current frame's region and bound as UNIFORM_BUFFER_DYNAMIC,
+    // so descriptor sets point at the whole buffer once and only the dynamic offset changes.
+    class UniformRing final
+    {
+    public:
+        UniformRing(vk::PhysicalDevice phyDevice, vk::Device device, GpuAllocator *allocator,
+                    uint32_t frameCount, vk::DeviceSize frameSize = 1ull << 20);
+        ~UniformRing();
+
+        UniformRing(const UniformRing &) = delete;
+        UniformRing &operator=(const UniformRing &) = delete;
+
+        // Starts writing into the region of frameIndex, the caller must have waited for that frame's fence
+        void BeginFrame(uint32_t frameIndex);
+
+        // Returns the dynamic offset of size bytes reserved in the current frame, data points at their mapping
+        uint32_t Allocate(vk::DeviceSize size, void **data);
+
+        template <typename T>
+        uint32_t Push(const T &value)
+        {
+            void *data;
+            uint32_t offset = Allocate(sizeof(T), &data);
+            memcpy(data, &value, sizeof(T));
+            return offset;
+        }
+
+        vk::Buffer get_buffer() const { return buffer; }
+        vk::DeviceSize get_frame_size() const { return frameSize; }
+        vk::DeviceSize get_used() const { return head - frameStart; }
+
+    private:
+        vk::Device device;
+        GpuAllocator *allocator;
+        vk::Buffer buffer;
+        GpuAllocation memory;
+        vk::DeviceSize alignment;
+        vk::DeviceSize frameSize;
+        uint32_t frameCount;
+
+        vk::DeviceSize frameStart = 0;
+        vk::DeviceSize head = 0;
+    };
+}
@@ -0,0 +1,439 @@
+#include "upload_manager.hpp"
+#include "cpu_profiler.hpp"
+
+#include "vulkan/vulkan_format_traits.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace engine
+{
+    UploadManager::UploadManager(Context *context, GpuAllocator *allocator, vk::DeviceSize stagingSize)
+        : context(context)
+    {
+        staging = std::make_unique<StagingRing>(context->phyDevice, context->device, allocator, stagingSize);
+        // quarters keep the copy engine busy on one chunk while the next one is filled
+        chunkSize = std::max<vk::DeviceSize>(staging->get_size() / 4, staging->get_alignment());
+
+        transferFamily = context->queueFamilyIndices.transferQueue.value();
+        graphicsFamily = context->queueFamilyIndices.graphicsQueue.value();
+
+        vk::CommandPoolCreateInfo poolInfo;
+        poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(transferFamily);
+        transferPool = context->device.createCommandPool(poolInfo);
+        poolInfo.setQueueFamilyIndex(graphicsFamily);
+        acquirePool = context->device.createCommandPool(poolInfo);
+
+        vk::SemaphoreTypeCreateInfo typeInfo;
+        typeInfo.setSemaphoreType(vk::SemaphoreType::eTimeline)
+            .setInitialValue(0);
+        vk::SemaphoreCreateInfo semaphoreInfo;
+        semaphoreInfo.setPNext(&typeInfo);
+        timeline = context->device.createSemaphore(semaphoreInfo);
+
+        // the queries are reset from the host, the copy queue cannot reset them itself
+        uint32_t validBits = context->phyDevice.getQueueFamilyProperties()[transferFamily].timestampValidBits;
+        if (validBits > 0 && context->hostQueryReset)
+        {
+            timestampPeriod = context->phyDevice.getProperties().limits.timestampPeriod;
+            timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        }
+    }
+
+    UploadManager::~UploadManager()
+    {
+        submit();
+        Wait(lastTicket);
+        retire();
+        for (auto &batch : retired)
+        {
+            context->device.destroyQueryPool(batch.timestamps);
+        }
+
+        staging.reset();
+        context->device.destroySemaphore(timeline);
+        context->device.destroyCommandPool(acquirePool);
+        context->device.destroyCommandPool(transferPool);
+    }
+
+    void UploadManager::begin()
+    {
+        if (current.recording)
+        {
+            return;
+        }
+
+        retire();
+        if (!retired.empty())
+        {
+            current = std::move(retired.back());
+            retired.pop_back();
+        }
+        else
+        {
+            vk::CommandBufferAllocateInfo allocInfo;
+            allocInfo.setLevel(vk::CommandBufferLevel::ePrimary)
+                .setCommandBufferCount(1)
+                .setCommandPool(transferPool);
+            current.transferCommands = context->device.allocateCommandBuffers(allocInfo)[0];
+            allocInfo.setCommandPool(acquirePool);
+            current.acquireCommands = context->device.allocateCommandBuffers(allocInfo)[0];
+            if (has_gpu_timing())
+            {
+                vk::QueryPoolCreateInfo queryInfo;
+                queryInfo.setQueryType(vk::QueryType::eTimestamp)
+                    .setQueryCount(2);
+                current.timestamps = context->device.createQueryPool(queryInfo);
+            }
+        }
+
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        current.transferCommands.reset();
+        current.transferCommands.begin(beginInfo);
+        if (current.timestamps)
+        {
+            context->device.resetQueryPool(current.timestamps, 0, 2);
+            current.transferCommands.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, current.timestamps, 0);
+        }
+        current.recording = true;
+    }
+
+    void UploadManager::retire()
+    {
+        uint64_t completed = context->device.getSemaphoreCounterValue(timeline);
+        staging->Reclaim(completed);
+
+        while (!inFlight.empty() && inFlight.front().ticket <= completed)
+        {
+            Batch batch = std::move(inFlight.front());
+            inFlight.pop_front();
+
+            // the ticket has signaled, the results are ready without waiting
+            if (batch.timestamps)
+            {
+                uint64_t results[4] = {};
+                vk::QueryResultFlags flags = vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability;
+                vk::Result result = context->device.getQueryPoolResults(batch.timestamps, 0, 2, sizeof(results), results, 2 * sizeof(uint64_t), flags);
+                if (result == vk::Result::eSuccess && results[1] && results[3])
+                {
+                    gpuNanoseconds += ((results[2] - results[0]) & timestampMask) * static_cast<double>(timestampPeriod);
+                }
+            }
+
+            batch.bufferAcquires.clear();
+            batch.imageAcquires.clear();
+            batch.acquireStages = vk::PipelineStageFlags();
+            batch.recording = false;
+            retired.push_back(std::move(batch));
+        }
+    }
+
+    StagingAllocation UploadManager::stage(vk::DeviceSize size)
+    {
+        StagingAllocation allocation;
+        while (!staging->TryAllocate(size, allocation))
+        {
+            if (staging->get_oldest_ticket() == 0)
+            {
+                // the open batch holds the whole ring, it has to go out before anything can be reused
+                submit();
+            }
+            Wait(staging->get_oldest_ticket());
+            retire();
+        }
+
+        begin();
+        return allocation;
+    }
+
+    void UploadManager::CopyToBuffer(const void *data, vk::DeviceSize size, vk::Buffer buffer, vk::DeviceSize offset,
+                                     vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const uint8_t *source = static_cast<const uint8_t *>(data);
+        for (vk::DeviceSize copied = 0; copied < size;)
+        {
+            vk::DeviceSize length = std::min(size - copied, chunkSize);
+            StagingAllocation allocation = stage(length);
+            memcpy(allocation.data, source + copied, (size_t)length);
+
+            vk::BufferCopy region;
+            region.setSrcOffset(allocation.offset)
+                .setDstOffset(offset + copied)
+                .setSize(length);
+            current.transferCommands.copyBuffer(allocation.buffer, buffer, region);
+            copied += length;
+        }
+        begin();
+
+        vk::BufferMemoryBarrier barrier;
+        barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(dstAccess)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setBuffer(buffer)
+            .setOffset(offset)
+            .setSize(size);
+
+        if (!has_transfer_queue())
+        {
+            current.transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStage, {}, nullptr, barrier, nullptr);
+            return;
+        }
+
+        // release on the transfer queue, the matching acquire is recorded at submit
+        barrier.setDstAccessMask({})
+            .setSrcQueueFamilyIndex(transferFamily)
+            .setDstQueueFamilyIndex(graphicsFamily);
+        current.transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, barrier, nullptr);
+
+        barrier.setSrcAccessMask({})
+            .setDstAccessMask(dstAccess);
+        current.bufferAcquires.push_back(barrier);
+        current.acquireStages |= dstStage;
+    }
+
+    void UploadManager::CopyToImage(const void *data, vk::Image image, vk::Format format, const std::vector<vk::BufferImageCopy> &regions,
+                                    const vk::ImageSubresourceRange &range, vk::ImageLayout finalLayout,
+                                    vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        begin();
+
+        vk::ImageMemoryBarrier barrier;
+        barrier.setOldLayout(vk::ImageLayout::eUndefined)
+            .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setSrcAccessMask({})
+            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(image)
+            .setSubresourceRange(range);
+        current.transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+        // sizes are counted in texel blocks so block compressed formats split on block rows
+        std::array<uint8_t, 3> blockExtent = vk::blockExtent(format);
+        vk::DeviceSize blockSize = vk::blockSize(format);
+        auto blocks = [](uint32_t texels, uint32_t extent)
+        { return (texels + extent - 1) / extent; };
+
+        std::vector<vk::BufferImageCopy> sorted(regions);
+        std::sort(sorted.begin(), sorted.end(), [](const vk::BufferImageCopy &a, const vk::BufferImageCopy &b)
+                  { return a.bufferOffset < b.bufferOffset; });
+
+        std::vector<vk::DeviceSize> rowPitches(sorted.size());
+        std::vector<vk::DeviceSize> regionEnds(sorted.size());
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            const vk::BufferImageCopy &region = sorted[i];
+            uint32_t rowLength = region.bufferRowLength ? region.bufferRowLength : region.imageExtent.width;
+            uint32_t imageHeight = region.bufferImageHeight ? region.bufferImageHeight : region.imageExtent.height;
+            uint32_t slices = region.imageExtent.depth * region.imageSubresource.layerCount;
+
+            rowPitches[i] = blocks(rowLength, blockExtent[0]) * blockSize;
+            vk::DeviceSize slicePitch = blocks(imageHeight, blockExtent[1]) * rowPitches[i];
+            regionEnds[i] = region.bufferOffset + slicePitch * (slices - 1) +
+                            rowPitches[i] * (blocks(region.imageExtent.height, blockExtent[1]) - 1) +
+                            blocks(region.imageExtent.width, blockExtent[0]) * blockSize;
+        }
+
+        const uint8_t *source = static_cast<const uint8_t *>(data);
+        std::vector<vk::BufferImageCopy> copies;
+        for (size_t first = 0; first < sorted.size();)
+        {
+            vk::DeviceSize start = sorted[first].bufferOffset;
+            if (regionEnds[first] - start > chunkSize)
+            {
+                const vk::BufferImageCopy &region = sorted[first];
+                if (region.imageExtent.depth != 1 || region.imageSubresource.layerCount != 1)
+                {
+                    throw std::runtime_error("Image region too large for the staging ring");
+                }
+
+                vk::DeviceSize rowPitch = rowPitches[first];
+                vk::DeviceSize rowBytes = blocks(region.imageExtent.width, blockExtent[0]) * blockSize;
+                uint32_t blockRows = blocks(region.imageExtent.height, blockExtent[1]);
+                uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<vk::DeviceSize>(chunkSize / rowPitch, 1));
+                for (uint32_t row = 0; row < blockRows; row += rowsPerChunk)
+                {
+                    uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+                    vk::DeviceSize length = rowPitch * (rows - 1) + rowBytes;
+                    StagingAllocation allocation = stage(length);
+                    memcpy(allocation.data, source + start + row * rowPitch, (size_t)length);
+
+                    vk::BufferImageCopy copy = region;
+                    copy.bufferOffset = allocation.offset;
+                    copy.bufferImageHeight = 0;
+                    copy.imageOffset.y += static_cast<int32_t>(row * blockExtent[1]);
+                    copy.imageExtent.height = std::min(rows * blockExtent[1], region.imageExtent.height - row * blockExtent[1]);
+                    current.transferCommands.copyBufferToImage(allocation.buffer, image, vk::ImageLayout::eTransferDstOptimal, copy);
+                }
+                first++;
+                continue;
+            }
+
+            // pack as many whole regions as fit in one chunk, mip tails end up in a single copy
+            vk::DeviceSize end = regionEnds[first];
+            size_t last = first + 1;
+            while (last < sorted.size() && std::max(end, regionEnds[last]) - start <= chunkSize)
+            {
+                end = std::max(end, regionEnds[last]);
+                last++;
+            }
+
+            vk::DeviceSize length = end - start;
+            StagingAllocation allocation = stage(length);
+            memcpy(allocation.data, source + start, (size_t)length);
+
+            copies.assign(sorted.begin() + first, sorted.begin() + last);
+            for (auto &copy : copies)
+            {
+                copy.bufferOffset = copy.bufferOffset - start + allocation.offset;
+            }
+            current.transferCommands.copyBufferToImage(allocation.buffer, image, vk::ImageLayout::eTransferDstOptimal, copies);
+            first = last;
+        }
+        begin();
+
+        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(finalLayout)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(dstAccess);
+
+        if (!has_transfer_queue())
+        {
+            current.transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStage, {}, nullptr, nullptr, barrier);
+            return;
+        }
+
+        // the layout transition happens once, as part of the release/acquire pair
+        barrier.setDstAccessMask({})
+            .setSrcQueueFamilyIndex(transferFamily)
+            .setDstQueueFamilyIndex(graphicsFamily);
+        current.transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, barrier);
+
+        barrier.setSrcAccessMask({})
+            .setDstAccessMask(dstAccess);
+        current.imageAcquires.push_back(barrier);
+        current.acquireStages |= dstStage;
+    }
+
+    UploadTicket UploadManager::Submit()
+    {
+        PROFILE_FUNCTION();
+        std::lock_guard<std::mutex> lock(mutex);
+        return submit();
+    }
+
+    UploadTicket UploadManager::submit()
+    {
+        if (!current.recording)
+        {
+            return lastTicket;
+        }
+
+        if (current.timestamps)
+        {
+            current.transferCommands.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, current.timestamps, 1);
+        }
+        current.transferCommands.end();
+
+        vk::TimelineSemaphoreSubmitInfo timelineInfo;
+        vk::SubmitInfo submitInfo;
+        submitInfo.setPNext(&timelineInfo)
+            .setCommandBuffers(current.transferCommands)
+            .setSignalSemaphores(timeline);
+
+        if (!has_transfer_queue())
+        {
+            uint64_t signalValue = ++timelineValue;
+            timelineInfo.setSignalSemaphoreValues(signalValue);
+            if (context->graphicsQueue.submit(1, &submitInfo, nullptr) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed to submit upload batch");
+            }
+        }
+        else
+        {
+            uint64_t transferValue = ++timelineValue;
+            timelineInfo.setSignalSemaphoreValues(transferValue);
+            if (context->transferQueue.submit(1, &submitInfo, nullptr) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed to submit upload batch");
+            }
+
+            // without a copy nothing changes owner and the transfer value completes the batch,
+            // an acquire barrier would need a zero stage mask
+            if (!current.bufferAcquires.empty() || !current.imageAcquires.empty())
+            {
+                vk::CommandBufferBeginInfo beginInfo;
+                beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+                current.acquireCommands.reset();
+                current.acquireCommands.begin(beginInfo);
+                current.acquireCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, current.acquireStages, {},
+                                                        nullptr, current.bufferAcquires, current.imageAcquires);
+                current.acquireCommands.end();
+
+                uint64_t acquireValue = ++timelineValue;
+                vk::PipelineStageFlags waitStage = current.acquireStages;
+                vk::TimelineSemaphoreSubmitInfo acquireTimelineInfo;
+                acquireTimelineInfo.setWaitSemaphoreValues(transferValue)
+                    .setSignalSemaphoreValues(acquireValue);
+                vk::SubmitInfo acquireInfo;
+                acquireInfo.setPNext(&acquireTimelineInfo)
+                    .setWaitSemaphores(timeline)
+                    .setWaitDstStageMask(waitStage)
+                    .setCommandBuffers(current.acquireCommands)
+                    .setSignalSemaphores(timeline);
+                if (context->graphicsQueue.submit(1, &acquireInfo, nullptr) != vk::Result::eSuccess)
+                {
+                    throw std::runtime_error("Failed to submit upload acquire");
+                }
+            }
+        }
+
+        current.ticket = timelineValue;
+        current.recording = false;
+        staging->Fence(current.ticket);
+        lastTicket = current.ticket;
+        inFlight.push_back(std::move(current));
+        current = {};
+
+        return lastTicket;
+    }
+
+    float UploadManager::TakeGpuMilliseconds()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire();
+        float milliseconds = static_cast<float>(gpuNanoseconds / 1e6);
+        gpuNanoseconds = 0.0;
+        return milliseconds;
+    }
+
+    bool UploadManager::IsComplete(UploadTicket ticket) const
+    {
+        return ticket <= context->device.getSemaphoreCounterValue(timeline);
+    }
+
+    void UploadManager::Wait(UploadTicket ticket) const
+    {
+        if (ticket == 0)
+        {
+            return;
+        }
+
+        vk::SemaphoreWaitInfo waitInfo;
+        waitInfo.setSemaphores(timeline)
+            .setValues(ticket);
+        if (context->device.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to wait for upload");
+        }
+    }
+}
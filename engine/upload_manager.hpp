@@ -0,0 +1,97 @@
+#pragma once
+
+#include "context.hpp"
+#include "gpu_allocator.hpp"
+#include "staging_ring.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace engine
+{
+    // Timeline value signalled once an upload batch is visible to the graphics queue, 0 is always complete
+    using UploadTicket = uint64_t;
+
+    // Records copies and layout transitions into one command buffer per batch and submits them together.
+    // Runs on the dedicated transfer family when there is one and hands the resources to the graphics
+    // family with a release/acquire pair. Submit() must run on the thread that owns the graphics queue.
+    // Source data is copied into a fixed staging ring in chunks; when the ring is full the open batch is
+    // submitted and the oldest batch waited for, so uploads larger than the ring still go through.
+    class UploadManager final
+    {
+    public:
+        UploadManager(Context *context, GpuAllocator *allocator, vk::DeviceSize stagingSize = 64ull << 20);
+        ~UploadManager();
+
+        UploadManager(const UploadManager &) = delete;
+        UploadManager &operator=(const UploadManager &) = delete;
+
+        // data only has to stay valid for the call. dstStage / dstAccess describe the first use on the graphics queue
+        void CopyToBuffer(const void *data, vk::DeviceSize size, vk::Buffer buffer, vk::DeviceSize offset,
+                          vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+        // region buffer offsets are relative to data, the image ends up in finalLayout. A single region larger
+        // than a chunk is split by texel block rows, which needs a single layer, single slice region
+        void CopyToImage(const void *data, vk::Image image, vk::Format format, const std::vector<vk::BufferImageCopy> &regions,
+                         const vk::ImageSubresourceRange &range, vk::ImageLayout finalLayout,
+                         vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+
+        // Submits the open batch, returns the ticket of the last batch if nothing was recorded
+        UploadTicket Submit();
+        bool IsComplete(UploadTicket ticket) const;
+        void Wait(UploadTicket ticket) const;
+
+        // Graphics submits can wait on this at a ticket value instead of blocking the CPU
+        vk::Semaphore get_semaphore() const { return timeline; }
+        bool has_transfer_queue() const { return transferFamily != graphicsFamily; }
+        vk::DeviceSize get_staging_size() const { return staging->get_size(); }
+        vk::DeviceSize get_staging_used() const { return staging->get_used(); }
+
+        // GPU time of the batches completed since the last call, measured with timestamps on the copy queue
+        float TakeGpuMilliseconds();
+        bool has_gpu_timing() const { return timestampPeriod > 0.0f; }
+
+    private:
+        struct Batch
+        {
+            vk::CommandBuffer transferCommands;
+            vk::CommandBuffer acquireCommands;
+            // begin and end of transferCommands, null without GPU timing
+            vk::QueryPool timestamps;
+            UploadTicket ticket = 0;
+            std::vector<vk::BufferMemoryBarrier> bufferAcquires;
+            std::vector<vk::ImageMemoryBarrier> imageAcquires;
+            vk::PipelineStageFlags acquireStages;
+            bool recording = false;
+        };
+
+        Context *context;
+        std::unique_ptr<StagingRing> staging;
+        vk::DeviceSize chunkSize;
+        uint32_t transferFamily;
+        uint32_t graphicsFamily;
+
+        vk::CommandPool transferPool;
+        vk::CommandPool acquirePool;
+        vk::Semaphore timeline;
+        uint64_t timelineValue = 0;
+        UploadTicket lastTicket = 0;
+
+        // 0 when the transfer family has no timestamps
+        float timestampPeriod = 0.0f;
+        uint64_t timestampMask = 0;
+        double gpuNanoseconds = 0.0;
+
+        std::mutex mutex;
+        Batch current;
+        std::deque<Batch> inFlight;
+        std::vector<Batch> retired;
+
+        void begin();
+        void retire();
+        UploadTicket submit();
+        // Blocks until size bytes of the ring are free, may submit the open batch
+        StagingAllocation stage(vk::DeviceSize size);
+    };
+}
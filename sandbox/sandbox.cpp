@@ -1,4 +1,8 @@
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include "SDL.h"
@@ -6,11 +10,14 @@
 #include "glm/glm.hpp"
 
 #include "engine/engine.hpp"
+#include "engine/benchmark.hpp"
 
 class Sandbox
 {
 public:
-    Sandbox(unsigned int width, unsigned int height) : workDir(SDL_GetBasePath()), width(width), height(height)
+    // configure runs before the engine is initialized
+    Sandbox(unsigned int width, unsigned int height, const std::function<void(engine::Engine &)> &configure = nullptr)
+        : workDir(SDL_GetBasePath()), width(width), height(height)
     {
         std::cout << "Working directory: " << workDir << std::endl;
 
@@ -35,6 +42,10 @@ public:
         std::vector<const char *> extensions(extensionCount);
         SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensions.data());
 
+        if (configure)
+        {
+            configure(engine);
+        }
         engine.Init(
             extensions,
             [&](vk::Instance instance)
@@ -55,13 +66,19 @@ public:
         SDL_Quit();
     }
 
-    void Run()
+    // with a benchmark, returns once it has measured every frame
+    void Run(engine::Benchmark *benchmark = nullptr)
     {
         bool shouldClose = false;
         SDL_Event event;
 
         while (!shouldClose)
         {
+            if (benchmark && !benchmark->BeginFrame())
+            {
+                break;
+            }
+
             while (SDL_PollEvent(&event))
             {
                 ImGui_ImplSDL2_ProcessEvent(&event);
@@ -72,9 +89,15 @@ public:
             }
 
             engine.Tick(shouldClose);
+            if (benchmark)
+            {
+                benchmark->EndFrame();
+            }
         }
     }
 
+    engine::Engine &get_engine() { return engine; }
+
 private:
     std::string workDir;
     unsigned int width;
@@ -84,8 +107,186 @@ private:
     engine::Engine engine;
 };
 
+static bool ParseSize(const char *value, unsigned int &width, unsigned int &height)
+{
+    if (sscanf(value, "%ux%u", &width, &height) != 2 || width == 0 || height == 0)
+    {
+        std::cerr << "Invalid size, expected WIDTHxHEIGHT" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// sandbox --headless [--size 1200x800] [--frames 60] [--output frame] [--trace N]
+// renders without a display and writes frame_0000.png, frame_0001.png, ... when --output is given
+static int RunHeadless(int argc, char **argv)
+{
+    unsigned int width = 1200;
+    unsigned int height = 800;
+    unsigned int frameCount = 60;
+    std::string output;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (!ParseSize(argv[++i], width, height))
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frameCount = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+    }
+
+    engine::Engine engine;
+    engine.InitHeadless(width, height);
+    if (!output.empty())
+    {
+        engine.onReadback = [&](const engine::ReadbackImage &image)
+        {
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "_%04llu.png", static_cast<unsigned long long>(image.frame));
+            engine::OffscreenTarget::WritePng(output + suffix, image);
+        };
+    }
+    for (unsigned int i = 0; i < frameCount; i++)
+    {
+        engine.TickHeadless();
+    }
+    engine.Quit();
+
+    return 0;
+}
+
+// sandbox --benchmark [--headless] [--model file.obj] [--texture file.png] [--size 1200x800] [--frames 600]
+//         [--warmup 60] [--timestep 0.016667] [--camera path.txt] [--report benchmark.json]
+// renders a fixed number of frames without vsync, stepping the animation and camera by --timestep per frame,
+// and writes the frame time percentiles to the report. --camera holds "time x y z" keys, the default orbits the model
+static int RunBenchmark(int argc, char **argv)
+{
+    unsigned int width = 1200;
+    unsigned int height = 800;
+    bool headless = false;
+    std::string modelPath;
+    std::string texturePath;
+    std::string reportPath = "benchmark.json";
+    engine::BenchmarkSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (!ParseSize(argv[++i], width, height))
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+        {
+            modelPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc)
+        {
+            texturePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            settings.frameCount = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            settings.warmupFrames = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--timestep") == 0 && i + 1 < argc)
+        {
+            settings.timestep = std::stof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc)
+        {
+            settings.cameraPath = engine::Benchmark::LoadCameraPath(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+        {
+            reportPath = argv[++i];
+        }
+    }
+
+    auto configure = [&](engine::Engine &engine)
+    {
+        engine.vsync = false;
+        engine.fixedTimestep = settings.timestep;
+        if (!modelPath.empty())
+        {
+            engine.modelPath = modelPath;
+        }
+        if (!texturePath.empty())
+        {
+            engine.texturePath = texturePath;
+        }
+    };
+
+    if (headless)
+    {
+        engine::Engine engine;
+        configure(engine);
+        engine.InitHeadless(width, height);
+        engine::Benchmark benchmark(&engine, settings);
+        while (benchmark.BeginFrame())
+        {
+            engine.TickHeadless();
+            benchmark.EndFrame();
+        }
+        benchmark.WriteReport(reportPath);
+        engine.Quit();
+    }
+    else
+    {
+        Sandbox sandbox(width, height, configure);
+        engine::Benchmark benchmark(&sandbox.get_engine(), settings);
+        sandbox.Run(&benchmark);
+        benchmark.WriteReport(reportPath);
+    }
+    std::cout << "Benchmark report written to " << reportPath << std::endl;
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    // --trace N writes the CPU zones of startup and the first N frames to cpu_trace.json
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--trace") == 0)
+        {
+            engine::CpuProfiler::Capture(std::stoul(argv[i + 1]), "cpu_trace.json");
+        }
+    }
+    PROFILE_THREAD("main");
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            return RunBenchmark(argc, argv);
+        }
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            return RunHeadless(argc, argv);
+        }
+    }
+
     Sandbox sandbox(1200, 800);
     sandbox.Run();
 